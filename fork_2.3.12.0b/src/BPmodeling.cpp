@@ -84,6 +84,25 @@ BPmodeling::Reset()
   memset(BP, 0, dim);
 }
 
+/*!
+Cambia le dimensioni della maschera (ad esempio quando cambia il binning della detection): 
+il modello viene riallocato e resettato.
+
+\param i_w [in] Nuova larghezza della maschera
+\param i_h [in] Nuova altezza della maschera
+*/
+void
+BPmodeling::Resize(const int i_w, const int i_h)
+{
+  width = i_w;
+  height = i_h;
+  dim = 2*(width-2*border_x)*(height-2*border_y)*sizeof(unsigned short);
+  free(BP);
+  BP = (unsigned short*) malloc(dim);
+
+  Reset();
+}
+
 /*
 GetMask()  Restituisce l'immagine che rappresenta la modellazione dei pixel neri.
 In particolare verr&agrave; creata una immagine delle dimensioni passate come parametro, in cui
@@ -107,24 +126,7 @@ BPmodeling::GetMask(unsigned char* const & o_BPbw, const int i_width, const int
   assert(i_width == width);
   assert(i_height == height);
   
-  num_mask_pixel = 0;
-  memset(o_BPbw, 0, (width*height));
-  for (int r=border_y; r<height-border_y; ++r)
-  {
-    int index_r1 = (r * width);
-    int index_r2 = ((r-border_y) * (width-2*border_x));
-    unsigned short* ptr_row_BP = &(BP[2*index_r2]);
-    for (int c=border_x; c<width-border_x; ++c, ptr_row_BP+=2)
-    {
-      if (ptr_row_BP[0] > ptr_row_BP[1]/4 && ptr_row_BP[0] > 54)
-      {
-        o_BPbw[index_r1 + c] = 255;
-        ++num_mask_pixel;
-      }
-      else
-        o_BPbw[index_r1 + c] = 0;
-    }
-  }
+  _update_and_get_mask(NULL, o_BPbw);
 }
 
 /*!
@@ -143,32 +145,11 @@ BPmodeling::UpdateModel(const unsigned char* const & i_bp_mask, const int i_widt
   assert(i_width == width);
   assert(i_height == height);
 
-  const unsigned short MAX_VAL = 3700;  // 7/4*N=54*60*2=6480 => N=3700 cioe' 2min di solo nero (o di solo "altro" cio di livelli diversi da zero)
-
 #ifdef SHOW_BP
   unsigned char* BPbw = (unsigned char*) malloc(width*height);
 #endif
 
-  for (int r=border_y; r<height-border_y; ++r)
-  {
-    const unsigned char* ptr_row_DSP = &(i_bp_mask[r * width + border_x]);
-
-    int index_r = ((r-border_y) * (width-2*border_x));
-    unsigned short* ptr_row_BP = &(BP[2*index_r]);
-    for (int c=border_x; c<width-border_x; ++c, ++ptr_row_DSP, ptr_row_BP+=2)
-    {
-      unsigned short value = (*ptr_row_DSP == 0);
-      if (ptr_row_BP[value] < MAX_VAL)
-        ptr_row_BP[value]++;
-      else
-      {
-        // se il contatore da incrementare &egrave; saturo decremento entrambi i contatori
-        //ptr_row_BP[value]--;  // essendo saturo questo contatore lo posso sicuramente decrementare
-        if (ptr_row_BP[1-value] > 0)  // questo contatore potrebbe essere 0 e quindi controllo
-          ptr_row_BP[1-value]--;
-      }
-    }
-  }
+  _update_and_get_mask(i_bp_mask, NULL);
 
 #ifdef SHOW_BP
   //cvNamedWindow("BP", 1);
@@ -193,6 +174,75 @@ BPmodeling::UpdateModel(const unsigned char* const & i_bp_mask, const int i_widt
 #endif
 }
 
+/*!
+UpdateModelAndGetMask() Equivale a UpdateModel() seguita da GetMask() ma i contatori
+vengono letti una sola volta.
+
+\param i_bp_mask  [in]     Maschera dei pixel neri del frame corrente
+\param o_BPbw     [in|out] Immagine che rappresenta la presenza o meno di pixel neri
+\param i_width    [in]     Larghezza della maschera
+\param i_height   [in]     Altezza della maschera
+*/
+void
+BPmodeling::UpdateModelAndGetMask(const unsigned char* const & i_bp_mask, unsigned char* const & o_BPbw, const int i_width, const int i_height)
+{
+  assert(i_width == width);
+  assert(i_height == height);
+
+  _update_and_get_mask(i_bp_mask, o_BPbw);
+}
+
+/*!
+_update_and_get_mask() Aggiornamento dei contatori (se i_bp_mask non &egrave; NULL) e 
+creazione della maschera dei pixel neri (se o_BPbw non &egrave; NULL) in una sola scansione del modello.
+*/
+void
+BPmodeling::_update_and_get_mask(const unsigned char* const i_bp_mask, unsigned char* const o_BPbw)
+{
+  const unsigned short MAX_VAL = 3700;  // 7/4*N=54*60*2=6480 => N=3700 cioe' 2min di solo nero (o di solo "altro" cio di livelli diversi da zero)
+
+  if (o_BPbw != NULL)
+  {
+    num_mask_pixel = 0;
+    memset(o_BPbw, 0, (width*height));
+  }
+
+  for (int r=border_y; r<height-border_y; ++r)
+  {
+    const unsigned char* ptr_row_DSP = (i_bp_mask != NULL) ? &(i_bp_mask[r * width + border_x]) : NULL;
+    unsigned char* ptr_row_BW = (o_BPbw != NULL) ? &(o_BPbw[r * width + border_x]) : NULL;
+
+    int index_r = ((r-border_y) * (width-2*border_x));
+    unsigned short* ptr_row_BP = &(BP[2*index_r]);
+    for (int c=border_x; c<width-border_x; ++c, ptr_row_BP+=2)
+    {
+      if (ptr_row_DSP != NULL)
+      {
+        unsigned short value = (*ptr_row_DSP++ == 0);
+        if (ptr_row_BP[value] < MAX_VAL)
+          ptr_row_BP[value]++;
+        else
+        {
+          // se il contatore da incrementare &egrave; saturo decremento entrambi i contatori
+          //ptr_row_BP[value]--;  // essendo saturo questo contatore lo posso sicuramente decrementare
+          if (ptr_row_BP[1-value] > 0)  // questo contatore potrebbe essere 0 e quindi controllo
+            ptr_row_BP[1-value]--;
+        }
+      }
+
+      if (ptr_row_BW != NULL)
+      {
+        if (ptr_row_BP[0] > ptr_row_BP[1]/4 && ptr_row_BP[0] > 54)
+        {
+          *ptr_row_BW = 255;
+          ++num_mask_pixel;
+        }
+        ++ptr_row_BW;
+      }
+    }
+  }
+}
+
 /*!
 GetBP() Ritorna il modello corrente dei pixel neri
 
@@ -21,6 +21,7 @@ private:
   int border_x;  ///< Bordo delle X ( Si usa la maschera binnata di conseguenza questi valori sono settati a 0)
   int border_y;  ///< Bordo delle Y
 
+  void _update_and_get_mask(const unsigned char* const i_bp_mask, unsigned char* const o_BPbw);  ///< Aggiornamento del modello e/o calcolo della maschera in una sola passata
 
 public:
   int num_mask_pixel;  ///< Numero di pixel neri trovati dal modello per ogni frame
@@ -30,8 +31,10 @@ public:
   ~BPmodeling();  ///< Distruttore.
  
   void Reset();  ///> resetta il modello dei pixel neri
+  void Resize(const int i_w, const int i_h);  ///< Cambia le dimensioni della maschera (es. cambio di binning) e resetta il modello
   void UpdateModel(const unsigned char* const & i_bp_mask, const int i_width, const int i_height);  ///< Aggiorna il modello
   void GetMask(unsigned char* const & o_BPbw, const int i_width, const int i_height);   //<Restituisce il modello finale
+  void UpdateModelAndGetMask(const unsigned char* const & i_bp_mask, unsigned char* const & o_BPbw, const int i_width, const int i_height);  ///< UpdateModel() + GetMask() in una sola passata
   const unsigned short* GetBP(int & o_BPwidth, int & o_BPheight);  //Restituisce la maschera che contiene i contatori di ogni pixel
 
 
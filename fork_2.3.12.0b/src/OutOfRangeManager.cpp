@@ -28,7 +28,6 @@ presenza di un determinato set-up.
 #endif
 
 int g_nrows, g_ncols, g_border_x, g_border_y;
-static const float DIM_BINNED_IMG = 1610.0f; ///< Dimensione dell'immagine binnata
 
 
 extern unsigned char handle_oor; // 20130715 eVS, manage OOR after system reboot
@@ -80,26 +79,26 @@ Conta i pixel neri (valore nella mappa uguale a 0) presenti nel frame
 e calcola le coordinate del centroide di cui si tiene conto la storia nel 
 caso di out-of-range. 
 
+Durante la detection lo stesso conteggio viene fatto da image_binning_bg_subtraction() 
+e passato con SetBlackPixelCount().
+
 \param disparityMap [in|out] Mappa di disparit&agrave;
 \see isBackgroundCheckInProgress()
 */
 int
 OutOfRangeManager::CountBlackPixels(unsigned char* const & disparityMap)
 {
-  // Inizializzo i limiti della finestra per il conteggio dei pixel neri
-  int black_pixel_cnt = 0; // Contatore dei pixel neri
-  unsigned char*disvec;  // Puntatore mappa di disparit&agrave;
+  return count_black_pixels(disparityMap);
+}
 
-  // Determinazione del numero di pixel neri
-  for (int r = BORDER_Y; r <= NY-BORDER_Y-1; ++r)
-  {
-    disvec = &(disparityMap[r*NX + BORDER_X]); // Mi posizione sulla riga r-esima della mappa di disparit&agrave;
-    for (int c = BORDER_X; c <= NX-BORDER_X-1; ++c, ++disvec)
-      if (*disvec == 0) // Se il valore della mappa di disparit&agrave; &egrave; 0 allora aumento il contatore
-        ++black_pixel_cnt;
-  }
 
-  return black_pixel_cnt;
+/*!
+\brief Memorizza il numero di pixel neri del frame corrente (calcolato da image_binning_bg_subtraction()).
+*/
+void
+OutOfRangeManager::SetBlackPixelCount(const int black_pixel_cnt)
+{
+  m_black_pixel_cnt = black_pixel_cnt;
 }
 
 
@@ -191,8 +190,8 @@ static int weight_dsp[256];  ///< pesi usati in _count_black_pixels_around() e i
 Questa funzione dovrebbe essere lanciata dal costruttore di OutOfRangeManager in modo
 che i calcoli per il riempimento dei vettori non facciano perdere frame o causino
 problemi di sincronia con l'FPGA. Ma per sicurezza anche la _count_black_pixels_around()
-chiama questa funzione che, grazie alla flag statica first_time si limitera' a fare un 
-solo if.
+chiama questa funzione che, grazie alla variabile statica weights_binning si limitera' a fare un 
+solo if (i pesi vengono ricalcolati solo quando cambia il binning).
 */
 int
 init_out_of_range_centroid_weights()
@@ -203,10 +202,10 @@ init_out_of_range_centroid_weights()
   // la map ha disparita' multiple di 16
   const int min_dsp = MIN_DISP_FOR_OUT_OF_RANGE_CHECK*16;
   const int max_dsp_in_map = MAX_DISP*16;
-  static bool first_time = true;
-  if (first_time)
+  static int weights_binning = 0;  // binning per cui sono stati calcolati i pesi
+  if (weights_binning != binning)
   {
-    first_time = false;
+    weights_binning = binning;
 
     printf("init_out_of_range_centroid_weights(): inizializzazione pesi.\n");
 
@@ -555,7 +554,7 @@ OutOfRangeManager::HandleOutOfRange(
     bool correct_background;
 
 #ifndef DISABLE_BACKGROUND_CHECK
-    isBackgroundCheckInProgress(black_pixel_cnt, correct_background);
+    isBackgroundCheckInProgress(m_black_pixel_cnt, correct_background);
 #else
     correct_background = true;
 #endif
@@ -617,45 +616,45 @@ gestire la corretta copia del blob virtuale nella mappa.
 */
 void OutOfRangeManager::CreateVirtualBlob()
 {
-  static bool first_time = true;  // Permette di creare il blob virtuale una volta sola. Sara' mantenuta poi in memoria
+  static int blob_binning = 0;  // Permette di creare il blob virtuale una volta sola per binning. Sara' mantenuta poi in memoria
 
   assert(DISP_VALUE_FOR_VIRTUAL_BLOB_BORDER != OUT_OF_RANGE_OR_STEREO_FAILURE && 
     DISP_VALUE_FOR_VIRTUAL_BLOB_BORDER != UNIFORM_ZONE_OR_DISP_1 &&  // altrimenti i bordi scuri appositamente aggiunti vengono poi eliminati dal procedimento corrispondente alla direttiva USE_BINNING_WITH_CHECK
     DISP_VALUE_FOR_VIRTUAL_BLOB_BORDER < MIN_M);  // altrimenti viene coinvolto nel calcolo dei picchi
 
-  if (first_time)
+  if (blob_binning != binning)
   {
-    printf("CreateVirtualBlob(): inizializzazione blob virtuale.\n");
+    printf("CreateVirtualBlob(): inizializzazione blob virtuale (binning %d).\n", binning);
 
     // Creo il vettore dei colori del blob tramite una gaussiana
-    first_time = false;
+    blob_binning = binning;
     const float sigma = 120.0f/binning;
     const float var = sigma*sigma;
 
-    for (int i = 0; i < VIRTUAL_BLOB_RAY; ++i)
+    for (int i = 0; i < m_virtual_blob_ray; ++i)
       kernel_color_weights[i] = (unsigned int) (255*exp(-(i*i)/var));
-    for (int i = VIRTUAL_BLOB_RAY; i < DIM_KERNEL_COLORS; ++i)
+    for (int i = m_virtual_blob_ray; i < m_dim_kernel_colors; ++i)
       kernel_color_weights[i] = DISP_VALUE_FOR_VIRTUAL_BLOB_BORDER;
 
-    // Creo il blob virtuale di base con raggio OutOfRangeManager::MAX_RAY
+    // Creo il blob virtuale di base con raggio m_max_ray
     unsigned char* ptr_virtual_blob = virtual_blob;
     memset(virtual_blob, 0, sizeof(virtual_blob));
-    for (int r = 0; r < VIRTUAL_BLOB_BOX; ++r)
+    for (int r = 0; r < m_virtual_blob_box; ++r)
     {
       bool first_found = false;  // Serve per determinare l'offset
-      for (int c = 0; c < VIRTUAL_BLOB_BOX; ++c, ++ptr_virtual_blob)
+      for (int c = 0; c < m_virtual_blob_box; ++c, ++ptr_virtual_blob)
       {
-        unsigned int tmp_i = (r - MAX_RAY)*(r - MAX_RAY);
-        unsigned int tmp_j = (c - MAX_RAY)*(c - MAX_RAY);
+        unsigned int tmp_i = (r - m_max_ray)*(r - m_max_ray);
+        unsigned int tmp_j = (c - m_max_ray)*(c - m_max_ray);
         unsigned int dist = tmp_i + tmp_j;  // distanza dal centroide..il valore indicizza il colore nel kernel
-        if (dist <= MAX_RAY*MAX_RAY)
+        if (dist <= m_max_ray*m_max_ray)
         {
           if (!first_found)  // salvo l'offset
           {
             first_found = true;
-            orig_virtual_blob_col_deltas[r] = c - MAX_RAY;
+            orig_virtual_blob_col_deltas[r] = c - m_max_ray;
           }
-          int indx = max(0, min(DIM_KERNEL_COLORS-1, (int)(sqrt(float(dist)) + 0.5f)));
+          int indx = max(0, min(m_dim_kernel_colors-1, (int)(sqrt(float(dist)) + 0.5f)));
           *ptr_virtual_blob = kernel_color_weights[indx];  // Assegno il colore al blob virtuale
         }
       }
@@ -664,8 +663,8 @@ void OutOfRangeManager::CreateVirtualBlob()
 
 #ifdef SHOW_VIRTUAL_BLOB
   cvNamedWindow("Virtual_blob", 1);
-  IplImage* tmp_virtual_blob = cvCreateImage(cvSize(VIRTUAL_BLOB_BOX, VIRTUAL_BLOB_BOX), IPL_DEPTH_8U, 1);
-  cvSetData(tmp_virtual_blob, virtual_blob, VIRTUAL_BLOB_BOX);
+  IplImage* tmp_virtual_blob = cvCreateImage(cvSize(m_virtual_blob_box, m_virtual_blob_box), IPL_DEPTH_8U, 1);
+  cvSetData(tmp_virtual_blob, virtual_blob, m_virtual_blob_box);
   cvShowImage("Virtual_blob", tmp_virtual_blob);
   cvReleaseImageHeader(&tmp_virtual_blob);
 #endif
@@ -674,7 +673,7 @@ void OutOfRangeManager::CreateVirtualBlob()
 
 /*!
 Controlla se si verifica la presenza di una situazione di out-of-range.
-In particolare se il numero di pixel neri #num_black_pixels &egrave; maggiore della soglia #NUM_BLACK_PIXEL_ON (di cui se ne considera una percentuale in
+In particolare se il numero di pixel neri #num_black_pixels &egrave; maggiore della soglia #m_num_black_pixel_on (di cui se ne considera una percentuale in
 base al numero di pixel neri modellati dall'oggetto BPmodeling).
 Successivamente viene valutata la possibilit&agrave; che il blob virtuale sia statico considerando il movimento del suo centroide e il numero di pixel neri trovati.
 In caso affermativo incremento il contatore statico ad ogni frame.
@@ -686,7 +685,7 @@ scatta l'OOR .
 Se ho un numero di pixel neri maggiori della soglia e ero gi in una situazione di OOR aggiornando 
 i campi dell'ogetto pesando i nuovi valori che lo caratterizzano 3 volte in pi&ugrave; rispetto alla storia dei valori precedente.
 
-Infine se la soglia dei pixel neri &egrave; minore della soglia #NUM_BLACK_PIXEL_OFF ed ero in OOR re-inizializzo tutti i contatori altrimenti mantengo attivo il blob virtuale per garantire
+Infine se la soglia dei pixel neri &egrave; minore della soglia #m_num_black_pixel_off ed ero in OOR re-inizializzo tutti i contatori altrimenti mantengo attivo il blob virtuale per garantire
 l'uscita di scena ( In sostanza si tratta di un'isteresi che ci permette di evitare una situazione di continua attivazione/spegnimento del blob virtuale)
 
 \return true se c&egrave; una situazione di out-of-range, false altrimenti
@@ -705,9 +704,10 @@ OutOfRangeManager::CheckOutOfRangeAndUpdate(
   static int num_frame_blob_static = 0;  // contatore del numero di frame in cui il blob si presume statico
 #endif 
 
+  const float DIM_BINNED_IMG = (float)(g_nrows*g_ncols);  // Dimensione dell'immagine binnata
   assert(num_mask_pixel <= DIM_BINNED_IMG);  // controllo paranoico
   float perc_mask_bp = (float)(1-(num_mask_pixel/DIM_BINNED_IMG));  // percentuale di pixel neri nella maschera calcolata dal modello dei BP
-  int current_threshold_on = (int)(NUM_BLACK_PIXEL_ON * perc_mask_bp);  // soglia corrente, varia in base alla perc_mask_bp
+  int current_threshold_on = (int)(m_num_black_pixel_on * perc_mask_bp);  // soglia corrente, varia in base alla perc_mask_bp
 
 #ifdef _DEBUG
  /* printf(" num_mask_pixel: %d \n",num_mask_pixel);
@@ -775,7 +775,7 @@ OutOfRangeManager::CheckOutOfRangeAndUpdate(
   {
     if (m_is_out_of_range)  // sono in out-of-range
     {
-      if (m_num_black_pixels < (int)(NUM_BLACK_PIXEL_OFF * perc_mask_bp) ||  // se la soglia &egrave; sotto a soglia di OFF
+      if (m_num_black_pixels < (int)(m_num_black_pixel_off * perc_mask_bp) ||  // se la soglia &egrave; sotto a soglia di OFF
         (m_is_from_high && m_cent_r >= 0 && m_cent_r > door_threshold + DELTA_DOOR_TH/binning && m_num_black_pixels < current_threshold_on) ||  // se la soglia &egrave; sotto a soglia di ON e il blob virtuale &egrave; passato da sopra a sotto
         (!m_is_from_high && m_cent_r >= 0 && m_cent_r < door_threshold - DELTA_DOOR_TH/binning && m_num_black_pixels < current_threshold_on))  // se la soglia &egrave; sotto a soglia di ON e il blob virtuale &egrave; passato da sotto a sopra
       {
@@ -839,13 +839,13 @@ OutOfRangeManager::CopyVirtualBlob(unsigned char* const & disparityMap , const u
   for (int r = min_row; r <= max_row; ++r)
   {
     const int scaled_row_delta = (r - cent_r);  // differenza sulle righe del blob di raggio ray che voglio disegnare
-    const int orig_virtual_blob_delta = (OutOfRangeManager::MAX_RAY * scaled_row_delta) / ray;
-    orig_virtual_blob_rows[r] = OutOfRangeManager::MAX_RAY + orig_virtual_blob_delta;  // scalo la differenza in modo da accedere al blob originale
-    orig_virtual_blob_rows[r] = max(0, min(OutOfRangeManager::VIRTUAL_BLOB_BOX-1, orig_virtual_blob_rows[r]));  // controllo necessario a causa di possibili errori di arrotondamenti
+    const int orig_virtual_blob_delta = (m_max_ray * scaled_row_delta) / ray;
+    orig_virtual_blob_rows[r] = m_max_ray + orig_virtual_blob_delta;  // scalo la differenza in modo da accedere al blob originale
+    orig_virtual_blob_rows[r] = max(0, min(m_virtual_blob_box-1, orig_virtual_blob_rows[r]));  // controllo necessario a causa di possibili errori di arrotondamenti
     const int & virtual_blob_row = orig_virtual_blob_rows[r];  // creo alias per agevolare scrittura
 
     // Procediamo con lo scalare il orig_virtual_blob_col_deltas in modo coerente al nuovo raggio ray
-    int scaled_delta = (OutOfRangeManager::orig_virtual_blob_col_deltas[virtual_blob_row] * ray) / OutOfRangeManager::MAX_RAY;
+    int scaled_delta = (OutOfRangeManager::orig_virtual_blob_col_deltas[virtual_blob_row] * ray) / m_max_ray;
 
     // Offset di sinistra
     int local_delta_fc = scaled_delta;  // si noti che OutOfRangeManager::orig_virtual_blob_col_deltas sono negativi
@@ -869,7 +869,7 @@ OutOfRangeManager::CopyVirtualBlob(unsigned char* const & disparityMap , const u
 
     // Verifico che gli indici siano corretti
     assert(cent_c+scaled_delta_fc[virtual_blob_row] >= 0 && cent_c+scaled_delta_fc[virtual_blob_row] < g_ncols);
-    assert(orig_virtual_blob_rows[r] >=0 && orig_virtual_blob_rows[r] <= OutOfRangeManager::VIRTUAL_BLOB_BOX-1);
+    assert(orig_virtual_blob_rows[r] >=0 && orig_virtual_blob_rows[r] <= m_virtual_blob_box-1);
   }
 
   //{
@@ -896,7 +896,7 @@ OutOfRangeManager::CopyVirtualBlob(unsigned char* const & disparityMap , const u
   for (int r = min_row; r <= max_row; ++r)
   {
     const int & virtual_blob_row = orig_virtual_blob_rows[r];  // l'offset di riga e' stato gia' controllato essere tra 0 e VIRTUAL_BLOB_BOX-1
-    int row_offset = virtual_blob_row * OutOfRangeManager::VIRTUAL_BLOB_BOX;  // offset in base a riga per accesso al virtual blob originale
+    int row_offset = virtual_blob_row * m_virtual_blob_box;  // offset in base a riga per accesso al virtual blob originale
     int disp_col = cent_c + scaled_delta_fc[virtual_blob_row];  // colonna nella mappa di disparit dove copiare il virtual blob riscalato (questo offset e' gia' stato controllato creando scaled_delta_fc)
     unsigned char* disp_map_ptr = &disparityMap[r * g_ncols + disp_col];
     const unsigned char* BP_Map_ptr = &BP_Map[r * g_ncols + disp_col];
@@ -904,10 +904,10 @@ OutOfRangeManager::CopyVirtualBlob(unsigned char* const & disparityMap , const u
     // il codice che segue e' troppo pesante sul PCN
     for (int delta_c = scaled_delta_fc[virtual_blob_row]; delta_c <= scaled_delta_lc[virtual_blob_row]; ++delta_c, ++disp_map_ptr, ++BP_Map_ptr)
     {
-      int virtual_blob_c = OutOfRangeManager::MAX_RAY + (delta_c * OutOfRangeManager::MAX_RAY) / ray;
-      virtual_blob_c = max(0, min(OutOfRangeManager::VIRTUAL_BLOB_BOX-1, virtual_blob_c));  // mi assicuro che l'offset di colonna sia tra 0 e VIRTUAL_BLOB_BOX-1 (causa arrotondamenti potrebbe non essere cosi')
+      int virtual_blob_c = m_max_ray + (delta_c * m_max_ray) / ray;
+      virtual_blob_c = max(0, min(m_virtual_blob_box-1, virtual_blob_c));  // mi assicuro che l'offset di colonna sia tra 0 e VIRTUAL_BLOB_BOX-1 (causa arrotondamenti potrebbe non essere cosi')
       const int idx = row_offset + virtual_blob_c;
-      assert(idx >= 0 && idx < OutOfRangeManager::VIRTUAL_BLOB_BOX*OutOfRangeManager::VIRTUAL_BLOB_BOX);  // paranoid check
+      assert(idx >= 0 && idx < m_virtual_blob_box*m_virtual_blob_box);  // paranoid check
       int w = (int) (*disp_map_ptr >= min_dsp || *BP_Map_ptr != 0);
       *disp_map_ptr = w*OutOfRangeManager::virtual_blob[idx] + (1-w)*(*disp_map_ptr);
     }
@@ -1050,7 +1050,7 @@ OutOfRangeManager::ComputeRay()
   //{
   //  printf("ComputeRay(): inizializzazione dati raggio blob virtuale.\n");
   //  first_time = false;
-  //  _create_adaptive_ray(ray_value_vec, OutOfRangeManager::MIN_RAY, OutOfRangeManager::MAX_RAY);
+  //  _create_adaptive_ray(ray_value_vec, OutOfRangeManager::MIN_RAY, m_max_ray);
   //}
 
   //int ray = -1;  // Raggio finale
@@ -1140,14 +1140,38 @@ e si crea il blob virtuale che verr&agrave; tenuto in memoria.
 */
 OutOfRangeManager::OutOfRangeManager()
 {
-  compute_binned_nrow_ncols(NY, NX, binning, BORDER_X, BORDER_Y, g_nrows, g_ncols);
-  g_border_x = g_border_y = 0;
-
   if (handle_oor == 0)
     m_enable_handle_out_of_range = false;
   else
     m_enable_handle_out_of_range = true;
 
+  m_black_pixel_cnt = 0;
+  SetBinning();
+}
+
+
+/*!
+Reinizializza il manager per il binning corrente della detection (vedi set_detection_binning()): 
+ricalcola le dimensioni della mappa binnata, le costanti che dipendono dal binning, il blob virtuale 
+e i pesi del centroide. Lo stato di out-of-range viene azzerato perch&eacute; centroide e raggio 
+sono espressi in coordinate della mappa binnata.
+*/
+void
+OutOfRangeManager::SetBinning()
+{
+  compute_binned_nrow_ncols(NY, NX, binning, BORDER_X, BORDER_Y, g_nrows, g_ncols);
+  g_border_x = g_border_y = 0;
+
+  m_num_black_pixel_on = 600/(binning*binning);
+  m_num_black_pixel_off = (2*m_num_black_pixel_on)/3;
+  m_virtual_blob_ray = (90+binning/2)/binning;
+  m_virtual_blob_border_dim = (20+binning/2)/binning;
+  m_max_ray = m_virtual_blob_ray+m_virtual_blob_border_dim;
+  m_min_ray = m_max_ray-18/binning;
+  m_dim_kernel_colors = m_max_ray + 1;
+  m_virtual_blob_box = (m_max_ray * 2 + 1);
+  assert(m_virtual_blob_box <= MAX_VIRTUAL_BLOB_BOX);
+  assert(g_nrows <= NY/MIN_BINNING);
 
   m_is_out_of_range = false;
   m_num_black_pixels = 0;
@@ -13,6 +13,9 @@
 #include "morphology.h"
 
 #include <limits.h>
+#if defined(MORPH_BENCHMARK) || defined(CLUSTERING_BENCHMARK) || defined(GAUSSIAN_CONV_TEST)
+#include <time.h>
+#endif
 
 #define USE_PEAKS_PRUNING
 
@@ -52,33 +55,145 @@ const int   min_area_orig = 12*12; // min area of a blob in the 160x120 map, if
 const int   min_w_orig = 12; // min width of a blob in the 160x120 map, if 0 not check is performed
 const int   min_h_orig = 12; // min height of a blob in the 160x120 map, if 0 not check is performed
 
-/* binned parameters */
-const int   strel_sze_h = strel_sze_orig_h/binning + (strel_sze_orig_h%binning > 0); ///< closing on the binned image
-const int   strel_sze_v = strel_sze_orig_v/binning + (strel_sze_orig_v%binning > 0); ///< closing on the binned image
-const int   strel_sze2_h = strel_sze2_orig_h/binning + (strel_sze2_orig_h%binning > 0); ///< opening on the binned image
-const int   strel_sze2_v = strel_sze2_orig_v/binning + (strel_sze2_orig_v%binning > 0); ///< opening on the binned image
-const int   min_area = min_area_orig/(binning*binning); // min area of a blob in the binned image
-const int   min_w = min_w_orig/binning; // min width of a blob in the binned image
-const int   min_h = min_h_orig/binning; // min height of a blob in the binned image
-const int   BINNED_DIM = (NX-2*BORDER_X+binning)*(NY-2*BORDER_Y+binning)/(binning*binning); ///< binned dimension obtained using round up
+/* binned parameters (updated by set_detection_binning()) */
+int binning = DEFAULT_BINNING;
+int strel_sze_h = strel_sze_orig_h/DEFAULT_BINNING + (strel_sze_orig_h%DEFAULT_BINNING > 0); ///< closing on the binned image
+int strel_sze_v = strel_sze_orig_v/DEFAULT_BINNING + (strel_sze_orig_v%DEFAULT_BINNING > 0); ///< closing on the binned image
+int strel_sze2_h = strel_sze2_orig_h/DEFAULT_BINNING + (strel_sze2_orig_h%DEFAULT_BINNING > 0); ///< opening on the binned image
+int strel_sze2_v = strel_sze2_orig_v/DEFAULT_BINNING + (strel_sze2_orig_v%DEFAULT_BINNING > 0); ///< opening on the binned image
+int min_area = min_area_orig/(DEFAULT_BINNING*DEFAULT_BINNING); // min area of a blob in the binned image
+int min_w = min_w_orig/DEFAULT_BINNING; // min width of a blob in the binned image
+int min_h = min_h_orig/DEFAULT_BINNING; // min height of a blob in the binned image
+int from_disp_to_shoulder = FROM_DISP_TO_SHOULDER; // FROM_DISP_TO_SHOULDER rescaled to the current binning
+const int BINNED_DIM = (NX-2*BORDER_X+MIN_BINNING)*(NY-2*BORDER_Y+MIN_BINNING)/(MIN_BINNING*MIN_BINNING); ///< max binned dimension obtained using round up
+const int MAX_BINNED_ROWS = (NY-2*BORDER_Y+MIN_BINNING)/MIN_BINNING; ///< max binned height obtained using round up
+const int MAX_BINNED_COLS = (NX-2*BORDER_X+MIN_BINNING)/MIN_BINNING; ///< max binned width obtained using round up
+const int MAX_STREL_SZE = (max(max(strel_sze_orig_h, strel_sze_orig_v), max(strel_sze2_orig_h, strel_sze2_orig_v))/MIN_BINNING + 1) | 1; ///< max binned structuring element
+#if defined(SHOW_DILATED_IMAGE) || defined(SHOW_ERODED_IMAGE)
+#define SHOW_CLOSE_OPEN // the intermediate images are available only with the four operations in sequence
+#undef FUSED_CLOSE_OPEN
+#endif
+#ifndef FUSED_CLOSE_OPEN
+const int MORPH_SCRATCH_DIM = MORPH_SCRATCH_MAX_SIZE((NY-2*BORDER_Y+MIN_BINNING)/MIN_BINNING, MAX_BINNED_COLS, MAX_STREL_SZE); ///< work buffer of the closing/opening
+#else
+const int MORPH_SCRATCH_DIM = MORPH_CLOSEOPEN_SCRATCH_SIZE(MAX_BINNED_COLS, MAX_STREL_SZE); ///< work buffer of the closing/opening
+#endif
+#if defined(SHOW_CLOSE_OPEN) || (!defined(PERFORMANCE_TEST) && defined(SHOW_UNBINNED_IMAGE)) || \
+    defined(USE_REPLICATE_IN_CONV_H) || defined(USE_REPLICATE_IN_CONV_V) || defined(CHECK_GAUSSIAN_CONV)
+#define FULL_FRAME_DETECTION // the whole map is processed (intermediate images, replicated borders or check of the convolution), see tRowBand
+#endif
 
 #ifdef USE_PEAK_MIN_DIST
-const int   peak_min_dist = max(1,peak_min_dist_orig/binning); // min_dist among peaks in the binned image
+int peak_min_dist = max(1,peak_min_dist_orig/DEFAULT_BINNING); // min_dist among peaks in the binned image
 #endif
 
 /* Kernel dependent parameters */
-#define KERNEL_X_DIM 13 //odd number
-#define KERNEL_Y_DIM 13 //11 // odd number
+#define KERNEL_X_DIM 13 //odd number, kernel dimension with DEFAULT_BINNING
+#define KERNEL_Y_DIM 13 //11 // odd number, kernel dimension with DEFAULT_BINNING
+#define KERNEL_SIGMA 4.246f // gaussian sigma with DEFAULT_BINNING
+#define MAX_KERNEL_DIM ((KERNEL_X_DIM*DEFAULT_BINNING/MIN_BINNING) | 1) // kernel dimension with MIN_BINNING
 //#define SUM_Z 53 // sum of all the gaussian coefficients of the 2D mask (not the two 1D masks but the originale 2D mask)
 #define NORM_FACT 256 // if 1024 then a simple gaussian filter is performed: it should be 1) less then 1024, 2) a power of two, and 3) such that (SUM_Z*255*1024^2)/(NORM_FACT^2) can be represented by an unsigned int
-
-unsigned int kernel_x[KERNEL_X_DIM]; //= {139, 255, 421, 621, 820, 969, 1024, 969, 820, 621, 421, 255, 139};
-unsigned int kernel_y[KERNEL_Y_DIM]; //= {139, 255, 421, 621, 820, 969, 1024, 969, 820, 621, 421, 255, 139};
+#define NORM_SHIFT 8 // log2(NORM_FACT)
+
+int kernel_x_dim = KERNEL_X_DIM; // odd number, see peak_detection_init()
+int kernel_y_dim = KERNEL_Y_DIM; // odd number, see peak_detection_init()
+unsigned int kernel_x[MAX_KERNEL_DIM]; //= {139, 255, 421, 621, 820, 968, 1024, 968, 820, 621, 421, 255, 139};
+unsigned int kernel_y[MAX_KERNEL_DIM]; //= {139, 255, 421, 621, 820, 968, 1024, 968, 820, 621, 421, 255, 139};
+
+/*
+Half gaussian kernels for each binning from MIN_BINNING to MAX_BINNING: (unsigned int)(1024*exp(-i*i/var))
+with var = (KERNEL_SIGMA*DEFAULT_BINNING/binning)^2, and sum of the 2D kernel (float exp()) used for the threshold.
+They must be regenerated if KERNEL_SIGMA or the kernel dimensions change (checked by peak_detection_init() in debug).
+*/
+#define KERNEL_HALF_DIM (MAX_KERNEL_DIM/2+1)
+static const unsigned int kernel_half[MAX_BINNING-MIN_BINNING+1][KERNEL_HALF_DIM] = {
+  {1024, 999, 927, 820, 690, 552, 421, 305, 211, 139},  // binning 2 (19 coefficients)
+  {1024, 968, 820, 621, 421, 255, 139,   0,   0,   0},  // binning 3 (13 coefficients)
+  {1024, 927, 690, 421, 211,   0,   0,   0,   0,   0}   // binning 4 (9 coefficients)
+};
+static const float kernel_sum[MAX_BINNING-MIN_BINNING+1] = {118.786446f, 53.3316689f, 29.1229973f};
+#if (KERNEL_X_DIM != 13) || (KERNEL_Y_DIM != 13) || (NORM_FACT != (1 << NORM_SHIFT))
+#error "kernel_half[] and kernel_sum[] must be regenerated"
+#endif
 //const unsigned int threshold = (unsigned int)(th_fact*min_disp*SUM_Z);
 
 /* Support data */
-const int MIN_PEAKS_DIST = 2;
-const int MAX_NUM_PEAKS = ((((NX-2*BORDER_X)/binning)/(MIN_PEAKS_DIST+1))*(((NY-2*BORDER_Y)/binning)/(MIN_PEAKS_DIST+1)))/2;
+const int MIN_PEAKS_DIST = 2; // min distance among peaks with DEFAULT_BINNING
+const int MAX_NUM_PEAKS = ((((NX-2*BORDER_X)/MIN_BINNING)/(MIN_PEAKS_DIST+1))*(((NY-2*BORDER_Y)/MIN_BINNING)/(MIN_PEAKS_DIST+1)))/2; // upper bound for max_num_peaks
+int min_peaks_dist = MIN_PEAKS_DIST; // min distance among peaks in the binned image
+const int MAX_NMS_WIN = 2*max(1,MAX_KERNEL_DIM/4)+1; // max window of the local maxima (see _peak_detection())
+const int MAX_PEAK_GRID_DIM = ((MAX_BINNED_ROWS+1)/2+2)*((MAX_BINNED_COLS+1)/2+2); // grid of the accepted peaks with min_peaks_dist >= 1
+int max_num_peaks = ((((NX-2*BORDER_X)/DEFAULT_BINNING)/(MIN_PEAKS_DIST+1))*(((NY-2*BORDER_Y)/DEFAULT_BINNING)/(MIN_PEAKS_DIST+1)))/2;
+
+
+/*!
+\brief Binning pi&ugrave; grossolano che risolve ancora le teste all'altezza di installazione data (in cm).
+
+Le teste sono tanto pi&ugrave; grandi nella mappa quanto pi&ugrave; sono vicine al sensore: 
+con installazioni basse si usa #MAX_BINNING, altrimenti il #DEFAULT_BINNING su cui sono tarati 
+kernel e soglie (con installazioni alte le teste sono piccole e un binning maggiore le perderebbe).
+
+Usata solo con #DETECTION_BINNING a 0: il binning 4 sulle installazioni basse non &egrave; ancora 
+stato validato sulle sequenze registrate, per cui di default la detection usa #DEFAULT_BINNING.
+*/
+int
+select_detection_binning(const int i_inst_height)
+{
+  const int LOW_INSTALLATION_HEIGHT = 210; // cm, under this height heads are at least 4/3 larger than at 225 cm
+
+  if (i_inst_height > 0 && i_inst_height < LOW_INSTALLATION_HEIGHT)
+    return MAX_BINNING;
+  return DEFAULT_BINNING;
+}
+
+
+/*!
+\brief Imposta il binning della detection e ricalcola i parametri che ne dipendono.
+
+Dimensioni degli elementi strutturanti, area e dimensioni minime dei blob, kernel gaussiano 
+(dimensione e sigma) e distanza minima tra i picchi sono riscalati rispetto ai valori 
+tarati con #DEFAULT_BINNING; con #DEFAULT_BINNING si ottengono esattamente i valori originali.
+
+Va chiamata tra un frame e l'altro dal thread che esegue la detection: chi usa 
+mappe o modelli binnati (BPmodeling, OutOfRangeManager) deve essere reinizializzato 
+se la funzione restituisce true.
+
+\param i_binning [in] binning tra #MIN_BINNING e #MAX_BINNING (altrimenti viene saturato)
+\return true se il binning &egrave; cambiato
+*/
+bool
+set_detection_binning(const int i_binning)
+{
+  const int new_binning = max(MIN_BINNING, min(MAX_BINNING, i_binning));
+  if (new_binning == binning)
+    return false;
+
+  binning = new_binning;
+
+  // the structuring elements must have odd dimensions (see _immorph())
+  strel_sze_h = (strel_sze_orig_h/binning + (strel_sze_orig_h%binning > 0)) | 1;
+  strel_sze_v = (strel_sze_orig_v/binning + (strel_sze_orig_v%binning > 0)) | 1;
+  strel_sze2_h = (strel_sze2_orig_h/binning + (strel_sze2_orig_h%binning > 0)) | 1;
+  strel_sze2_v = (strel_sze2_orig_v/binning + (strel_sze2_orig_v%binning > 0)) | 1;
+  min_area = min_area_orig/(binning*binning);
+  min_w = min_w_orig/binning;
+  min_h = min_h_orig/binning;
+  from_disp_to_shoulder = (FROM_DISP_TO_SHOULDER*binning + DEFAULT_BINNING/2)/DEFAULT_BINNING;
+#ifdef USE_PEAK_MIN_DIST
+  peak_min_dist = max(1,peak_min_dist_orig/binning);
+#endif
+
+  kernel_x_dim = (KERNEL_X_DIM*DEFAULT_BINNING/binning) | 1;
+  kernel_y_dim = (KERNEL_Y_DIM*DEFAULT_BINNING/binning) | 1;
+  assert(kernel_x_dim <= MAX_KERNEL_DIM && kernel_y_dim <= MAX_KERNEL_DIM);
+
+  min_peaks_dist = max(1, (MIN_PEAKS_DIST*DEFAULT_BINNING+binning/2)/binning);
+  max_num_peaks = ((((NX-2*BORDER_X)/binning)/(min_peaks_dist+1))*(((NY-2*BORDER_Y)/binning)/(min_peaks_dist+1)))/2;
+  assert(max_num_peaks <= MAX_NUM_PEAKS);
+
+  return true;
+}
 
 
 void
@@ -95,76 +210,235 @@ compute_binned_nrow_ncols(const int nrows, const int ncols,
 }
 
 
-void image_binning(const unsigned char * const & map, 
+////////////////////////////////////////////////////////////////////////////////
+// word-parallel (4 pixels per 32 bit word) row helpers used by image_binning_bg_subtraction()
+static const unsigned int SWAR_H = 0x80808080u;  // bit alto di ogni byte
+static const unsigned int SWAR_L = 0x7f7f7f7fu;  // 7 bit bassi di ogni byte
+
+// bit alto acceso nei byte di v uguali a zero
+static inline unsigned int
+_swar_zero_bytes(const unsigned int v)
+{
+  return ~(((v & SWAR_L) + SWAR_L) | v | SWAR_L);
+}
+
+
+/*!
+\brief Copia una riga della mappa spegnendo i pixel di sfondo e conta i pixel a zero della riga originale.
+
+Un pixel viene spento se &egrave; minore o uguale alla soglia i_thr (vedi UpdateBkgThreshold()) 
+e non vale #UNIFORM_ZONE_OR_DISP_1. Se i puntatori sono allineati a word vengono 
+elaborati 4 pixel alla volta senza salti. Se i_thr &egrave; NULL la riga viene solo copiata.
+Se o_row &egrave; NULL viene solo fatto il conteggio.
+
+\return numero di pixel di i_row uguali a zero.
+*/
+static int
+_subtract_background_row(
+  const unsigned char* const i_row,  //!< [in] riga della mappa di disparit&agrave;
+  const unsigned char* const i_thr,  //!< [in] riga corrispondente della soglia (pu&ograve; essere NULL)
+  unsigned char* const o_row,        //!< [out] riga della mappa senza sfondo (pu&ograve; essere NULL o coincidere con i_row)
+  const int i_len)                   //!< [in] numero di pixel
+{
+  int c = 0;
+  int num_zeros = 0;
+
+  if ((((size_t)i_row | (size_t)i_thr | (size_t)o_row) & 3) == 0)
+  {
+    const unsigned int U = 0x01010101u*UNIFORM_ZONE_OR_DISP_1;
+    const unsigned int* ptr_in = (const unsigned int*) i_row;
+    const unsigned int* ptr_thr = (const unsigned int*) i_thr;
+    unsigned int* ptr_out = (unsigned int*) o_row;
+
+    for (; c+4<=i_len; c+=4, ++ptr_in)
+    {
+      const unsigned int m = *ptr_in;
+      num_zeros += (int)(((_swar_zero_bytes(m) >> 7) * 0x01010101u) >> 24);
+
+      if (ptr_out == NULL)
+        continue;
+
+      if (ptr_thr == NULL)
+      {
+        *ptr_out++ = m;
+        continue;
+      }
+
+      const unsigned int t = *ptr_thr++;
+      // bit alto acceso nei byte con t >= m (senza prestiti tra byte)
+      const unsigned int d = (t | SWAR_H) - (m & SWAR_L);
+      const unsigned int off = ((t & ~m) | (~(t ^ m) & d)) & SWAR_H;
+      // i byte uguali a UNIFORM_ZONE_OR_DISP_1 non vengono spenti; 0x80 -> 0xFF nei byte da spegnere
+      const unsigned int clr = ((off & ~_swar_zero_bytes(m ^ U)) >> 7) * 0xFFu;
+      *ptr_out++ = m & ~clr;
+    }
+  }
+
+  for (; c<i_len; ++c)
+  {
+    const unsigned char elem = i_row[c];
+    num_zeros += (elem == 0);
+    if (o_row != NULL)
+      o_row[c] = (i_thr != NULL && elem <= i_thr[c] && elem != UNIFORM_ZONE_OR_DISP_1) ? 0 : elem;
+  }
+
+  return num_zeros;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// binning kernels specialized for the binning factors 2, 3 and 4
+
+const int MAX_FAST_BINNING = 4;  ///< fattore di binning massimo con kernel specializzato
+
+/*!
+Reciproci in virgola fissa (16 bit frazionari, arrotondati per eccesso) del numero di pixel 
+validi di un blocco: (sum*bin_recip[n]) >> 16 == sum/n per ogni sum <= 255*n e n <= 16.
+*/
+static const unsigned int bin_recip[MAX_FAST_BINNING*MAX_FAST_BINNING+1] = {
+  0, 65536, 32768, 21846, 16384, 13108, 10923, 9363, 8192, 7282, 6554, 5958, 5462, 5042, 4682, 4370, 4096
+};
+
+
+// accumula un pixel nei totali del blocco binnato
+static inline void
+_bin_accumulate(const unsigned char elem, unsigned int & sum, int & num_pixels, int & num_zeros)
+{
+#ifdef USE_BINNING_WITH_CHECK
+  if (elem != OUT_OF_RANGE_OR_STEREO_FAILURE && elem != UNIFORM_ZONE_OR_DISP_1)
+#endif
+  {
+    sum += elem;
+    ++num_pixels;
+  }
+  num_zeros += (elem == OUT_OF_RANGE_OR_STEREO_FAILURE);
+}
+
+
+// accumula i primi N pixel di una riga di un blocco (srotolato a tempo di compilazione)
+template <int N>
+struct BinRow
+{
+  static inline void accumulate(const unsigned char* const ptr, unsigned int & sum, int & num_pixels, int & num_zeros)
+  {
+    BinRow<N-1>::accumulate(ptr, sum, num_pixels, num_zeros);
+    _bin_accumulate(ptr[N-1], sum, num_pixels, num_zeros);
+  }
+};
+
+template <>
+struct BinRow<0>
+{
+  static inline void accumulate(const unsigned char* const, unsigned int &, int &, int &) {}
+};
+
+
+/*!
+\brief Corpo di image_binning_bg_subtraction() per il fattore di binning B (0 = fattore qualsiasi, passato in i_binning).
+*/
+template <int B>
+static int
+_image_binning_bg_subtraction(const unsigned char * const & map, 
+  const unsigned char * const & thr,
   const int nrows, const int ncols, 
-  const int binning,
+  const int i_binning,
   const int border_x, const int border_y,
+  unsigned char * const & o_map,
   unsigned char * const & bmap,
   unsigned char * const & i_bp_mask,
   int & bnrows, int & bncols)
 {
-  assert(border_x>binning);
-  assert(border_y>binning);
+  const int bin = (B > 0) ? B : i_binning;
 
-  compute_binned_nrow_ncols(nrows, ncols, binning, border_x, border_y, bnrows, bncols);
+  assert(border_x>bin);
+  assert(border_y>bin);
+  assert(B <= MAX_FAST_BINNING);
 
-  unsigned char** conv_ptr = (unsigned char**) malloc(binning*sizeof(unsigned char*)); // puntatori di riga
+  compute_binned_nrow_ncols(nrows, ncols, bin, border_x, border_y, bnrows, bncols);
+  assert(border_x+bncols*bin <= ncols);  // nessun blocco esce dalla mappa (border_x > bin)
+  assert(border_y+bnrows*bin <= nrows);
 
-  unsigned char* ptr_bmap = (unsigned char*)bmap;
-  unsigned int sum_square;
-  int last_col;
+  // totali delle colonne binnate della riga binnata corrente
+  unsigned int sum_square[NX];
+  int num_pixels[NX];
+  int num_zeros[NX];
+  assert(bncols <= NX);
+
+  const int roi_cols = ncols-2*border_x;
+  const int last_binned_row = border_y+bnrows*bin;
+  int black_pixel_cnt = 0;
 
-  memset(i_bp_mask, 0, bnrows*bncols);
+  unsigned char* ptr_bmap = (unsigned char*)bmap;
   unsigned char* ptr_bg_mask = (unsigned char*)i_bp_mask;
-  for (int r=border_y; r<border_y+bnrows*binning; r+=binning) 
+
+  for (int r=0; r<nrows; ++r)
   {
-    assert(r < nrows-binning+1);
+    const unsigned char* row = map + r*ncols;
+    unsigned char* out_row = (o_map != NULL) ? o_map + r*ncols : NULL;
+
+    // sottrazione dello sfondo e conteggio dei pixel neri
+    if (r >= border_y && r < nrows-border_y)
+    {
+      if (out_row != NULL)
+      {
+        memcpy(out_row, row, border_x);
+        memcpy(out_row+ncols-border_x, row+ncols-border_x, border_x);
+      }
+      black_pixel_cnt += _subtract_background_row(row+border_x, 
+                                                  (thr != NULL) ? thr+r*ncols+border_x : NULL,
+                                                  (out_row != NULL) ? out_row+border_x : NULL,
+                                                  roi_cols);
+    }
+    else if (out_row != NULL)
+      memcpy(out_row, row, ncols);
 
-    conv_ptr[0] = (unsigned char*)(map + r*ncols + border_x);
-    for (int i=1; i<binning; ++i)
-      conv_ptr[i] = conv_ptr[i-1]+ncols;
+    // binning
+    if (r < border_y || r >= last_binned_row)
+      continue;
 
-    for (int c=border_x; c<border_x+bncols*binning; c+=binning, ++ptr_bmap, ++ptr_bg_mask)
+    const int k = (r-border_y)%bin;
+    if (k == 0)
     {
-      assert (c < ncols-binning+1);
+      memset(sum_square, 0, bncols*sizeof(sum_square[0]));
+      memset(num_pixels, 0, bncols*sizeof(num_pixels[0]));
+      memset(num_zeros, 0, bncols*sizeof(num_zeros[0]));
+    }
 
-      sum_square = 0;
-      last_col = min(ncols, c+binning);
-      int num_pixels = 0;
-      int num_zeros = 0;
-      for (int conv_idx=0; conv_idx<binning; ++conv_idx)
+    const unsigned char* ptr = row+border_x;
+    for (int bc=0; bc<bncols; ++bc, ptr+=bin)
+    {
+      if (B > 0)
+        BinRow<B>::accumulate(ptr, sum_square[bc], num_pixels[bc], num_zeros[bc]);
+      else
       {
-        for (int c2=c; c2<last_col; ++c2, ++conv_ptr[conv_idx])
-        {
-          unsigned char elem = *conv_ptr[conv_idx];
-#ifdef USE_BINNING_WITH_CHECK
-          if (elem != OUT_OF_RANGE_OR_STEREO_FAILURE && elem != UNIFORM_ZONE_OR_DISP_1)
-#endif
-          {
-            sum_square += elem;
-            ++num_pixels;
-          }
-          num_zeros += (elem == OUT_OF_RANGE_OR_STEREO_FAILURE);
-        }
+        for (int c2=0; c2<bin; ++c2)
+          _bin_accumulate(ptr[c2], sum_square[bc], num_pixels[bc], num_zeros[bc]);
       }
+    }
+
+    if (k == bin-1)
+    {
+      for (int bc=0; bc<bncols; ++bc, ++ptr_bmap, ++ptr_bg_mask)
+      {
 #ifdef USE_BINNING_WITH_CHECK
-      if (num_pixels == 0)
-        *ptr_bmap = UNIFORM_ZONE_OR_DISP_1;
-      else
+        if (num_pixels[bc] == 0)
+          *ptr_bmap = UNIFORM_ZONE_OR_DISP_1;
+        else
 #endif
-        *ptr_bmap = sum_square/num_pixels;
+        if (B > 0)
+          *ptr_bmap = (sum_square[bc]*bin_recip[num_pixels[bc]]) >> 16;
+        else
+          *ptr_bmap = sum_square[bc]/num_pixels[bc];
 
-      if (num_zeros >= binning)
-        *ptr_bg_mask = 255;
+        *ptr_bg_mask = (num_zeros[bc] >= bin) ? 255 : 0;
+      }
     }
   }
 
-  free(conv_ptr);
-
 #ifdef SHOW_BINNED_IMAGE
   {
     IplImage* tmp = cvCreateImageHeader(cvSize(bncols, bnrows), IPL_DEPTH_8U, 1);
-    IplImage* tmp_resized = cvCreateImage(cvSize(binning*bncols, binning*bnrows), IPL_DEPTH_8U, 1);
+    IplImage* tmp_resized = cvCreateImage(cvSize(bin*bncols, bin*bnrows), IPL_DEPTH_8U, 1);
     cvSetData(tmp, bmap, bncols);
     cvResize(tmp, tmp_resized, CV_INTER_NN);
     cvShowImage("binned", tmp);
@@ -174,6 +448,80 @@ void image_binning(const unsigned char * const & map,
     cvReleaseImage(&tmp_resized);
   }
 #endif
+
+  return black_pixel_cnt;
+}
+
+
+/*!
+\brief Binning, sottrazione dello sfondo e conteggio dei pixel neri in una sola passata sulla mappa.
+
+La mappa viene letta una sola volta, riga per riga: ogni riga (ancora in cache) viene 
+copiata in o_map spegnendo i pixel di sfondo, vengono contati i suoi pixel a zero 
+e viene accumulata nei totali delle colonne binnate; ogni \a binning righe viene 
+prodotta una riga di bmap e della maschera dei pixel neri i_bp_mask.
+
+Per i fattori di binning 2, 3 e 4 si usa un kernel specializzato (somme srotolate e 
+media calcolata con i reciproci in #bin_recip), per gli altri il kernel generico.
+
+I risultati sono identici a quelli di image_binning() (bmap e i_bp_mask calcolati sulla 
+mappa originale), della sottrazione dello sfondo fatta in detectAndTrack() (su o_map) e di 
+OutOfRangeManager::CountBlackPixels() (valore restituito).
+
+\param map [in] mappa di disparit&agrave; nrows x ncols
+\param thr [in] soglia della sottrazione dello sfondo (#BkgThr), se NULL lo sfondo non viene sottratto
+\param o_map [out] copia di map con lo sfondo sottratto all'interno dei bordi (pu&ograve; essere NULL)
+\return numero di pixel a zero di map all'interno dei bordi
+*/
+int image_binning_bg_subtraction(const unsigned char * const & map, 
+  const unsigned char * const & thr,
+  const int nrows, const int ncols, 
+  const int binning,
+  const int border_x, const int border_y,
+  unsigned char * const & o_map,
+  unsigned char * const & bmap,
+  unsigned char * const & i_bp_mask,
+  int & bnrows, int & bncols)
+{
+  switch (binning)
+  {
+    case 2:
+      return _image_binning_bg_subtraction<2>(map, thr, nrows, ncols, binning, border_x, border_y, o_map, bmap, i_bp_mask, bnrows, bncols);
+    case 3:
+      return _image_binning_bg_subtraction<3>(map, thr, nrows, ncols, binning, border_x, border_y, o_map, bmap, i_bp_mask, bnrows, bncols);
+    case 4:
+      return _image_binning_bg_subtraction<4>(map, thr, nrows, ncols, binning, border_x, border_y, o_map, bmap, i_bp_mask, bnrows, bncols);
+    default:
+      return _image_binning_bg_subtraction<0>(map, thr, nrows, ncols, binning, border_x, border_y, o_map, bmap, i_bp_mask, bnrows, bncols);
+  }
+}
+
+
+/*!
+\brief Binning della mappa di disparit&agrave; e maschera dei pixel neri (vedi image_binning_bg_subtraction()).
+*/
+void image_binning(const unsigned char * const & map, 
+  const int nrows, const int ncols, 
+  const int binning,
+  const int border_x, const int border_y,
+  unsigned char * const & bmap,
+  unsigned char * const & i_bp_mask,
+  int & bnrows, int & bncols)
+{
+  image_binning_bg_subtraction(map, NULL, nrows, ncols, binning, border_x, border_y, 
+                               NULL, bmap, i_bp_mask, bnrows, bncols);
+}
+
+
+/*!
+\brief Conteggio dei pixel a zero all'interno dei bordi di una mappa #NX x #NY.
+*/
+int count_black_pixels(const unsigned char * const & map)
+{
+  int black_pixel_cnt = 0;
+  for (int r=BORDER_Y; r<NY-BORDER_Y; ++r)
+    black_pixel_cnt += _subtract_background_row(map+r*NX+BORDER_X, NULL, NULL, NX-2*BORDER_X);
+  return black_pixel_cnt;
 }
 
 
@@ -428,7 +776,8 @@ peak_unbinning(
 //}
 
 
-// convolve horizontally
+#if defined(USE_REPLICATE_IN_CONV_H) || defined(USE_REPLICATE_IN_CONV_V) || defined(CHECK_GAUSSIAN_CONV) || defined(GAUSSIAN_CONV_TEST)
+// convolve horizontally (reference version, see _gaussH())
 void _convH(
   const unsigned char * const & map,
   const int nrows,
@@ -439,15 +788,12 @@ void _convH(
   const unsigned int* ptr_k;
   unsigned int* ptr_C;
 
-  int radius = KERNEL_X_DIM / 2;
+  int radius = kernel_x_dim / 2;
 
 #ifdef USE_REPLICATE_IN_CONV_H
-  static int sum_weights = 0;
-  if (sum_weights == 0)
-  {
-    for (int i=0; i<KERNEL_X_DIM; ++i)
-      sum_weights += kernel_x[i];
-  }
+  int sum_weights = 0;  // the kernel changes with the binning
+  for (int i=0; i<kernel_x_dim; ++i)
+    sum_weights += kernel_x[i];
 #endif
 
   for (int r=0; r<nrows; ++r)
@@ -536,7 +882,7 @@ void _convH(
 }
 
 
-// convolve vertically
+// convolve vertically (reference version, see _gaussV())
 void _convV(const unsigned int* const & C1, const int nrows, const int ncols, 
             unsigned int* const & C2)
 {
@@ -545,15 +891,12 @@ void _convV(const unsigned int* const & C1, const int nrows, const int ncols,
   const unsigned int* ptr_k;
   unsigned int* ptr_C2 = C2;
 
-  int radius = KERNEL_Y_DIM/2;
+  int radius = kernel_y_dim/2;
 
 #ifdef USE_REPLICATE_IN_CONV_V
-  static int sum_weights = 0;
-  if (sum_weights == 0)
-  {
-    for (int i=0; i<KERNEL_Y_DIM; ++i)
-      sum_weights += kernel_y[i];
-  }
+  int sum_weights = 0;  // the kernel changes with the binning
+  for (int i=0; i<kernel_y_dim; ++i)
+    sum_weights += kernel_y[i];
 #endif
 
   ptr_C1 = C1;
@@ -664,7 +1007,230 @@ void _convV(const unsigned int* const & C1, const int nrows, const int ncols,
 }
 
 
+#endif
+
+
+/*
+Gaussian convolution in fixed point with zero padding: the same sums of _convH()/_convV() (outside the
+map the samples are zero) without the border loops. The kernel is symmetric, so the samples at
+distance i are added before the multiplication (half of the multiplies); the vertical pass works
+on whole rows, padded above and below with a zero row (also inside the map, out of the rows of C1
+that can be non-zero, see tRowBand).
+*/
+
+// convolve horizontally
+static void
+_gaussH(const unsigned char * const & map, const int nrows, const int ncols,
+        unsigned int* const & C)
+{
+  static unsigned char padded[MAX_BINNED_COLS+MAX_KERNEL_DIM];  // one row with radius zeros on both sides
+
+  const int radius = kernel_x_dim/2;
+  const unsigned int* const k = kernel_x+radius;  // k[-i] == k[i]
+  assert(ncols+2*radius <= MAX_BINNED_COLS+MAX_KERNEL_DIM);
+
+  memset(padded, 0, ncols+2*radius);
+  const unsigned char* const p = padded+radius;
+
+  for (int r=0; r<nrows; ++r)
+  {
+    memcpy(padded+radius, map+r*ncols, ncols);
+
+    unsigned int* const ptr_C = C+r*ncols;
+    for (int c=0; c<ncols; ++c)
+    {
+      unsigned int acc = k[0]*p[c];
+      for (int i=1; i<=radius; ++i)
+        acc += k[i]*(p[c-i]+p[c+i]);
+      ptr_C[c] = acc >> NORM_SHIFT;
+    }
+  }
+}
+
+
+// convolve vertically the rows out_first_r..out_last_r, C1 is zero out of the rows first_r..last_r
+static void
+_gaussV(const unsigned int* const & C1, const int first_r, const int last_r, const int ncols,
+        unsigned int* const & C2, const int out_first_r, const int out_last_r)
+{
+  static const unsigned int zero_row[MAX_BINNED_COLS] = {0};  // padding above and below the map
+
+  const int radius = kernel_y_dim/2;
+  const unsigned int* const k = kernel_y+radius;  // k[-i] == k[i]
+  assert(ncols <= MAX_BINNED_COLS);
+
+  for (int r=out_first_r; r<=out_last_r; ++r)
+  {
+    unsigned int* const ptr_C2 = C2+r*ncols;
+    const unsigned int* const row = (r >= first_r && r <= last_r) ? C1+r*ncols : zero_row;
+    const unsigned int k0 = k[0];
+    for (int c=0; c<ncols; ++c)
+      ptr_C2[c] = k0*row[c];
+
+    for (int i=1; i<=radius; ++i)
+    {
+      const unsigned int* const up = (r-i >= first_r && r-i <= last_r) ? C1+(r-i)*ncols : zero_row;
+      const unsigned int* const down = (r+i >= first_r && r+i <= last_r) ? C1+(r+i)*ncols : zero_row;
+      const unsigned int ki = k[i];
+      for (int c=0; c<ncols; ++c)
+        ptr_C2[c] += ki*(up[c]+down[c]);
+    }
+
+    for (int c=0; c<ncols; ++c)
+      ptr_C2[c] >>= NORM_SHIFT;
+  }
+}
+
+
+/*
+Row bands of the binned map with foreground (non-zero pixels): closing, opening, amplification and local
+maxima work only on them. A band holds the rows with foreground dilated by the vertical radius of the
+closing (the only stage that can extend the foreground), so out of the bands the map stays zero and
+cannot contain peaks (see the test on min_disp in _peak_detection()); nms_first_r..nms_last_r are the
+rows of C read by the local maxima of the band. Two bands are merged unless they are so far apart that
+the rows read by their close-open, by their local maxima and by the vertical convolution of these rows
+do not overlap: then they can be processed one at a time, in place, and a band without pixels reaching
+min_disp (not active, e.g. only uniform zones) cannot contain peaks nor change the peaks of the others,
+so it is only closed and opened.
+*/
+typedef struct _RowBand {
+  int first_r, last_r;          // rows that can be non-zero after the close-open
+  int nms_first_r, nms_last_r;  // rows of the amplified map used by the local maxima
+  bool active;                  // some pixel of the band reaches min_disp
+} tRowBand;
+
+const int MAX_ROW_BANDS = MAX_BINNED_ROWS/2+1;
+
+
+// rows searched above and below a pixel by the local maxima of _peak_detection()
+static inline int
+_nms_ray_y(void)
+{
+  return max(1,kernel_y_dim/4);
+}
+
+
+// vertical radius of the closing and rows read above and below a pixel by closing plus opening
+static inline void
+_closeopen_radii(int & close_radius, int & closeopen_radius)
+{
+  const int close_v = (strel_sze_v > 0) ? strel_sze_v : strel_sze_h;
+  const int open_v = (strel_sze2_v > 0) ? strel_sze2_v : strel_sze2_h;
+  close_radius = (strel_sze_h > 0) ? close_v/2 : 0;
+  closeopen_radius = 2*close_radius + ((strel_sze2_h > 0) ? 2*(open_v/2) : 0);
+}
+
+
+static inline void
+_set_row_band(tRowBand* const band, const int first_r, const int last_r, const int nrows, const bool active)
+{
+  const int ray = _nms_ray_y();
+  band->first_r = first_r;
+  band->last_r = last_r;
+  band->nms_first_r = max(0, first_r-ray);
+  band->nms_last_r = min(nrows-1, last_r+ray);
+  band->active = active;
+}
+
+
+// close and open of the map: the four operations in sequence or, with FUSED_CLOSE_OPEN, _imcloseopen() (same result)
+static inline void
+_closeopen(unsigned char * const & map, const int nrows, const int ncols, unsigned char * const scratch)
+{
+#ifdef FUSED_CLOSE_OPEN
+  _imcloseopen(map, nrows, ncols, strel_sze_h, strel_sze_v, strel_sze2_h, strel_sze2_v, scratch);
+#else
+  if (strel_sze_h > 0)
+  {
+    _imdilate(map, nrows, ncols, strel_sze_h, strel_sze_v, scratch);
+    _imerode(map, nrows, ncols, strel_sze_h, strel_sze_v, scratch);
+  }
+  if (strel_sze2_h > 0)
+  {
+    _imerode(map, nrows, ncols, strel_sze2_h, strel_sze2_v, scratch);
+    _imdilate(map, nrows, ncols, strel_sze2_h, strel_sze2_v, scratch);
+  }
+#endif
+}
+
+
+#ifndef FULL_FRAME_DETECTION
+// bands of the rows with at least one non-zero pixel, returns their number (0 if the map is empty)
+static int
+_foreground_bands(const unsigned char* const & map, const int nrows, const int ncols, tRowBand* const bands)
+{
+  int close_radius, closeopen_radius;
+  _closeopen_radii(close_radius, closeopen_radius);
+  const int min_gap = max(2*closeopen_radius, _nms_ray_y()+kernel_y_dim/2);  // rows between two bands
+
+  int num_bands = 0;
+  int first_r = 0, last_r = -1;
+  bool active = false;
+  for (int r=0; r<nrows; ++r)
+  {
+    const unsigned char* map_ptr = map+r*ncols;
+    unsigned int acc = 0;
+    bool row_active = false;
+    for (int c=0; c<ncols && !row_active; ++c)
+    {
+      acc |= map_ptr[c];
+      row_active = (map_ptr[c] >= min_disp);
+    }
+    if (acc == 0)
+      continue;
+
+    const int row_first_r = max(0, r-close_radius);
+    const int row_last_r = min(nrows-1, r+close_radius);
+    if (last_r >= 0 && last_r+min_gap >= row_first_r)
+    {
+      last_r = row_last_r;
+      active = active || row_active;
+    }
+    else
+    {
+      if (last_r >= 0)
+        _set_row_band(&(bands[num_bands++]), first_r, last_r, nrows, active);
+      first_r = row_first_r;
+      last_r = row_last_r;
+      active = row_active;
+    }
+  }
+  if (last_r >= 0)
+    _set_row_band(&(bands[num_bands++]), first_r, last_r, nrows, active);
+
+  assert(num_bands <= MAX_ROW_BANDS);
+  return num_bands;
+}
+
+
+/*
+Close and open of the bands: each band is processed together with the rows read by its close-open, so
+the result in the band is the same of the whole map; the result in those rows is not (they are at the
+border of the processed rows) and they are cleared, as in the whole map they are zero.
+*/
+static void
+_closeopen_bands(unsigned char * const & bmap, const int bnrows, const int bncols,
+                 const tRowBand* const bands, const int num_bands,
+                 unsigned char * const scratch)
+{
+  int close_radius, closeopen_radius;
+  _closeopen_radii(close_radius, closeopen_radius);
+
+  for (int b=0; b<num_bands; ++b)
+  {
+    const tRowBand* band = &(bands[b]);
+    const int first_r = max(0, band->first_r-closeopen_radius);
+    const int last_r = min(bnrows-1, band->last_r+closeopen_radius);
+    _closeopen(bmap+first_r*bncols, last_r-first_r+1, bncols, scratch);
+    memset(bmap+first_r*bncols, 0, (band->first_r-first_r)*bncols);
+    memset(bmap+(band->last_r+1)*bncols, 0, (last_r-band->last_r)*bncols);
+  }
+}
+#endif
+
+
 void _peak_amplification(const unsigned char * const & bmap, const int & bnrows, const int & bncols,
+                         const tRowBand* const bands, const int num_bands,
                          unsigned int** C = NULL)
 {
   static unsigned int C1[BINNED_DIM]; 
@@ -672,8 +1238,37 @@ void _peak_amplification(const unsigned char * const & bmap, const int & bnrows,
 
   assert(bnrows*bncols <= BINNED_DIM);
 
+#if defined(USE_REPLICATE_IN_CONV_H) || defined(USE_REPLICATE_IN_CONV_V)
+  // the renormalization at the borders is available only in the reference version (FULL_FRAME_DETECTION)
   _convH(bmap, bnrows, bncols, C1);
   _convV(C1, bnrows, bncols, C2);
+#else
+  for (int b=0; b<num_bands; ++b)
+  {
+    const tRowBand* band = &(bands[b]);
+    if (!band->active)
+      continue;
+    const int offset = band->first_r*bncols;
+    _gaussH(bmap+offset, band->last_r-band->first_r+1, bncols, C1+offset);
+    _gaussV(C1, band->first_r, band->last_r, bncols, C2, band->nms_first_r, band->nms_last_r);
+  }
+
+#ifdef CHECK_GAUSSIAN_CONV
+  {
+    static unsigned int ref_C1[BINNED_DIM];
+    static unsigned int ref_C2[BINNED_DIM];
+    _convH(bmap, bnrows, bncols, ref_C1);
+    _convV(ref_C1, bnrows, bncols, ref_C2);
+
+    const size_t sz = bnrows*bncols*sizeof(unsigned int);
+    if (memcmp(C1, ref_C1, sz) != 0 || memcmp(C2, ref_C2, sz) != 0)
+    {
+      printf("_peak_amplification(): la convoluzione in virgola fissa differisce da _convH()/_convV()!\n");
+      assert(0);
+    }
+  }
+#endif
+#endif
 
   if (C != NULL)
     *C = C2;
@@ -721,186 +1316,202 @@ _normalize_ldg(unsigned int* const & C,
 }
 
 
-void _findMaxH(const unsigned int * const & map, const int nrows, const int ncols,
-               const int sze, unsigned int * const & mapH)
+/*
+Running maximum of row on windows of 2*ray+1 samples (truncated at the borders) with a monotonic
+deque: dq holds the positions of the current window in decreasing order of value, so its head is
+the maximum; each sample enters and leaves the deque at most once.
+*/
+static inline void
+_running_maxH(const unsigned int* const row, const int ncols, const int ray,
+              unsigned int* const o_row, int* const dq)
 {
-  assert(sze > 0);
-  int radius = sze/2;
-
-  const unsigned int* ptr_map = map;
-  unsigned int* ptr_mapH = mapH;
-
-  for (int r=0; r<nrows; ++r)
+  int head = 0, tail = 0;
+  for (int j=0; j<ncols+ray; ++j)
   {
-    for (int c=0; c<radius; ++c, ++ptr_map, ++ptr_mapH)
-    {
-      *ptr_mapH = *(ptr_map-c); // <- map(r, 0)
-      for (int k=-c+1; k<=radius; ++k)
-      {
-        if (*(ptr_map+k) > *ptr_mapH)
-          *ptr_mapH = *(ptr_map+k); // <- map(r, k)
-      }
-    }
-
-    for (int c=radius; c<ncols-radius; ++c, ++ptr_map, ++ptr_mapH)
+    if (j < ncols)
     {
-      *ptr_mapH = *(ptr_map-radius);
-      for (int k=-radius+1; k<=radius; ++k)
-      {
-        if ( *(ptr_map+k) > *ptr_mapH )
-          *ptr_mapH = *(ptr_map+k);
-      }
+      const unsigned int v = row[j];
+      while (tail > head && row[dq[tail-1]] <= v)
+        --tail;
+      dq[tail++] = j;
     }
 
-    for (int c=ncols-radius; c<ncols; ++c, ++ptr_map, ++ptr_mapH)
+    const int i = j-ray;
+    if (i >= 0)
     {
-      *ptr_mapH = *(ptr_map-radius);
-      for (int k=-radius+1; k<=(ncols-1-c); ++k)
-      {
-        if (*(ptr_map+k) > *ptr_mapH )
-          *ptr_mapH = *(ptr_map+k);
-      }
+      if (dq[head] < i-ray)  // at most one position leaves the window at each step
+        ++head;
+      o_row[i] = row[dq[head]];
     }
   }
 }
 
 
-void _findMaxV(const unsigned int* const & map, const int nrows, const int ncols,
-               const int sze, unsigned int* const & mapV)
+/*
+Local maxima and non-maximum suppression in a single streaming pass over C.
+Each row of C is filtered horizontally with _running_maxH() and pushed into a monotonic deque per
+column (a ring of 2*search_ray_y+1 entries); as soon as the vertical window of row i is complete
+the candidates of row i are tested against the local maximum, so no full-size maxima plane is needed.
+Only the rows of the bands are tested, each one with the rows of C of its local maxima (see tRowBand).
+The peaks closer than min_peaks_dist (in both directions) to an accepted peak are discarded
+by looking at the accepted peaks of the 3x3 neighbouring cells of peak_grid, whose cells are
+(min_peaks_dist+1) wide and therefore contain at most one accepted peak: the cost per candidate
+does not depend on the number of peaks.
+*/
+tPeakProps*
+_peak_detection(const unsigned char* const & map, const unsigned int* const & C, 
+                const int nrows, const int ncols,
+                const tRowBand* const bands, const int num_bands,
+                const float sum,
+                int & num_peaks)
 {
-  assert(sze > 0);
-  int radius = sze/2;
-
-  const unsigned int* ptr_map = map;
-  const unsigned int* tmp;
-  unsigned int* ptr_mapV = mapV;
-
-  for (int r=0; r<radius; ++r)
+  assert(nrows*ncols <= BINNED_DIM);
+  assert(nrows <= MAX_BINNED_ROWS && ncols <= MAX_BINNED_COLS);
+
+  const int search_ray_x = max(1,kernel_x_dim/4);
+  const int search_ray_y = _nms_ray_y();
+  const int win_y = 2*search_ray_y+1;
+  assert(win_y <= MAX_NMS_WIN);
+
+  // horizontal maxima of the current row, deques of the columns and local maxima of the tested row
+  static unsigned int maxH[MAX_BINNED_COLS];
+  static unsigned int local_maxima[MAX_BINNED_COLS];
+  static int dqH[MAX_BINNED_COLS];
+  static unsigned int dqV_val[MAX_BINNED_COLS*MAX_NMS_WIN];
+  static int dqV_row[MAX_BINNED_COLS*MAX_NMS_WIN];
+  static int dqV_head[MAX_BINNED_COLS];
+  static int dqV_len[MAX_BINNED_COLS];
+
+  // accepted peaks: one cell of (min_peaks_dist+1)x(min_peaks_dist+1) pixels holds at most one peak,
+  // the grid has a border of empty cells to avoid tests on the borders
+  static int peak_grid[MAX_PEAK_GRID_DIM];
+  static int col_cell[MAX_BINNED_COLS];
+  const int cell_sze = min_peaks_dist+1;
+  const int grid_cols = (ncols+cell_sze-1)/cell_sze + 2;
+  const int grid_rows = (nrows+cell_sze-1)/cell_sze + 2;
+  assert(grid_rows*grid_cols <= MAX_PEAK_GRID_DIM);
+  for (int i=0; i<grid_rows*grid_cols; ++i)
+    peak_grid[i] = -1;
+  for (int c=0, cell=1, k=0; c<ncols; ++c)
   {
-    for (int c=0; c<ncols; ++c, ++ptr_map, ++ptr_mapV)
+    col_cell[c] = cell;
+    if (++k == cell_sze)
     {
-      *ptr_mapV = *(ptr_map-r*ncols); // <- map(0, c)
-      tmp = ptr_map+(-r+1)*ncols; // tmp -> map(0+1, c)
-      for (int k=-r+1; k<=radius; ++k)
-      {
-        if ( *tmp > *ptr_mapV )
-          *ptr_mapV = *(tmp);
-        tmp+=ncols; // tmp -> map(r+k, c)
-      }
+      k = 0;
+      ++cell;
     }
   }
 
-  for (int r=radius; r<nrows-radius; ++r)
-  {
-    for (int c=0; c<ncols; ++c, ++ptr_map, ++ptr_mapV)
-    {
-      tmp = ptr_map-radius*ncols; // tmp -> map(r-radius, c)
-      *ptr_mapV = *tmp;
-      tmp+=ncols;
-      for (int k=-radius+1; k<=radius; ++k)
-      {
-        if ( *tmp > *ptr_mapV )
-          *ptr_mapV = *(tmp);
-        tmp+=ncols; // tmp -> map(r+k, c)
-      }
-    }
-  }
-
-  for (int r=nrows-radius; r<nrows; ++r)
-  {
-    for (int c=0; c<ncols; ++c, ++ptr_map, ++ptr_mapV)
-    {
-      tmp = ptr_map-radius*ncols; // tmp -> map(r-radius, c)
-      *ptr_mapV = *tmp;
-      tmp+=ncols; // tmp -> map(r-radius+1, c)
-      for (int k=-radius+1; k<=(nrows-1-r); ++k)
-      {
-        if ( *tmp > *ptr_mapV )
-          *ptr_mapV = *tmp;
-        tmp+=ncols; // tmp -> map(r+k, c)
-      }
-    }
-  }
-}
-
-
-bool
-_no_maxima_around(const bool* const & selected_maxima, const int row, const int col, const int ncols, const int nrows, const int ray)
-{
-  bool no_maxima = true;
-  int first_row = max(0,row-ray);
-  int last_row = min(nrows-1,row+ray);
-  int first_col = max(0,col-ray); 
-  int last_col = min(ncols-1,col+ray);
-  for (int r=first_row; r<=last_row; ++r)
-  {
-    const bool* sel_max_ptr = &selected_maxima[r*ncols+first_col];
-    for (int c=first_col; c<=last_col && no_maxima; ++c, ++sel_max_ptr)
-      no_maxima = no_maxima && !(*sel_max_ptr);
-  }
-  return no_maxima;
-}
-
-
-tPeakProps*
-_peak_detection(const unsigned char* const & map, const unsigned int* const & C, 
-                const int nrows, const int ncols,
-                const float sum,
-                int & num_peaks)
-{
-  static unsigned int local_maxima[BINNED_DIM];
-  assert(nrows*ncols <= BINNED_DIM);
-  {
-    static unsigned int maxH[BINNED_DIM]; 
-    int search_ray_x = max(1,KERNEL_X_DIM/4);
-    int search_ray_y = max(1,KERNEL_Y_DIM/4);
-    _findMaxH(C, nrows, ncols, 2*search_ray_x+1, maxH);
-    _findMaxV(maxH, nrows, ncols, 2*search_ray_y+1, local_maxima);
-  }
-
-  unsigned char* map_ptr = (unsigned char*)map;
-  unsigned int* C_ptr = (unsigned int*) C;
-  unsigned int* local_maxima_ptr = (unsigned int*) local_maxima;
-
   static tPeakProps peaks[MAX_NUM_PEAKS];
-  static bool selected_maxima[BINNED_DIM];
-  memset(selected_maxima, 0, BINNED_DIM*sizeof(bool));
-  bool* sel_max_ptr = selected_maxima;
 
   static const int coeff = (1024/NORM_FACT)*(1024/NORM_FACT);
   static const float coeff2 = th_fact*coeff; // minimizzo operazioni float precalcolando il piu' possibile
   const int threshold_min = (int)(sum*min_disp*coeff2);
   const int scaled_sum = (int)(sum*coeff);
   int peaks_idx = 0;
-  for (int r=0; (r<nrows && peaks_idx<MAX_NUM_PEAKS); ++r)
+  for (int b=0; (b<num_bands && peaks_idx<max_num_peaks); ++b)
   {
-    for (int c=0; (c<ncols && peaks_idx<MAX_NUM_PEAKS); ++c, ++map_ptr, ++C_ptr, ++local_maxima_ptr, ++sel_max_ptr)
+    const tRowBand* band = &(bands[b]);
+    if (!band->active)
+      continue;
+    memset(dqV_len, 0, ncols*sizeof(int));
+    memset(dqV_head, 0, ncols*sizeof(int));
+    int row_cell = 1+band->first_r/cell_sze, row_k = band->first_r%cell_sze;  // once per band
+    for (int j=band->nms_first_r; (j<=band->last_r+search_ray_y && peaks_idx<max_num_peaks); ++j)
     {
-      if (*map_ptr>=min_disp && *C_ptr>=threshold_min &&
-         ((*C_ptr/scaled_sum) < *map_ptr-4 || *map_ptr >= min_disp+32))  // solo se la disparit  bassa (=> testa piccola => contenuta nel kernel) il centro della 
-                                                                         // finestra deve essere massimo rispetto al vicinato (solo se la disparit  alta ha senso
-                                                                         // avere zone uniformi nel kernel a causa di una testa molto grande); questo controllo evita
-                                                                         // grandi quantit di picchi sullo sfondo che poi causa grosso carico CPU per PCN.
+      const int r = j-search_ray_y;  // row whose vertical window is complete
+      const bool feed = (j <= band->nms_last_r);
+      if (feed)
+        _running_maxH(C+j*ncols, ncols, search_ray_x, maxH, dqH);
+
+      for (int c=0; c<ncols; ++c)
       {
-        if (*C_ptr == *local_maxima_ptr)
+        unsigned int* const val = dqV_val+c*MAX_NMS_WIN;
+        int* const row = dqV_row+c*MAX_NMS_WIN;
+        int & head = dqV_head[c];
+        int & len = dqV_len[c];
+
+        if (len > 0 && row[head] < j-2*search_ray_y)  // the oldest row leaves the window
         {
-          if (_no_maxima_around(selected_maxima, r, c, ncols, nrows, MIN_PEAKS_DIST))
+          if (++head == win_y)
+            head = 0;
+          --len;
+        }
+
+        if (feed)
+        {
+          const unsigned int v = maxH[c];
+          while (len > 0)
           {
-            *sel_max_ptr = true;
-            peaks[peaks_idx].x = c;
-            peaks[peaks_idx].y = r;
-            peaks[peaks_idx].z = *map_ptr;
-            peaks[peaks_idx].a = -1;
-#ifdef USE_NEW_DETECTION2
-            peaks[peaks_idx].wx = -1;
-            peaks[peaks_idx].wy = -1;
-#else
-            peaks[peaks_idx].w = -1;
-#endif
-            peaks_idx++;
+            int back = head+len-1;
+            if (back >= win_y)
+              back -= win_y;
+            if (val[back] > v)
+              break;
+            --len;
+          }
+          int pos = head+len;
+          if (pos >= win_y)
+            pos -= win_y;
+          val[pos] = v;
+          row[pos] = j;
+          ++len;
+        }
+
+        if (r >= band->first_r)
+          local_maxima[c] = val[head];
+      }
+
+      if (r < band->first_r)
+        continue;
+
+      const unsigned char* map_ptr = map+r*ncols;
+      const unsigned int* C_ptr = C+r*ncols;
+      const unsigned int* local_maxima_ptr = local_maxima;
+      for (int c=0; (c<ncols && peaks_idx<max_num_peaks); ++c, ++map_ptr, ++C_ptr, ++local_maxima_ptr)
+      {
+        if (*map_ptr>=min_disp && *C_ptr>=threshold_min &&
+           ((*C_ptr/scaled_sum) < *map_ptr-4 || *map_ptr >= min_disp+32))  // solo se la disparit  bassa (=> testa piccola => contenuta nel kernel) il centro della 
+                                                                           // finestra deve essere massimo rispetto al vicinato (solo se la disparit  alta ha senso
+                                                                           // avere zone uniformi nel kernel a causa di una testa molto grande); questo controllo evita
+                                                                           // grandi quantit di picchi sullo sfondo che poi causa grosso carico CPU per PCN.
+        {
+          if (*C_ptr == *local_maxima_ptr)
+          {
+            int* const cell = peak_grid+row_cell*grid_cols+col_cell[c];
+            bool no_maxima = true;
+            for (int gr=-1; gr<=1 && no_maxima; ++gr)
+              for (int gc=-1; gc<=1 && no_maxima; ++gc)
+              {
+                const int idx = cell[gr*grid_cols+gc];
+                no_maxima = (idx < 0) || (abs(peaks[idx].x-c) > min_peaks_dist || abs(peaks[idx].y-r) > min_peaks_dist);
+              }
+
+            if (no_maxima)
+            {
+              assert(*cell < 0);
+              *cell = peaks_idx;
+              peaks[peaks_idx].x = c;
+              peaks[peaks_idx].y = r;
+              peaks[peaks_idx].z = *map_ptr;
+              peaks[peaks_idx].a = -1;
+  #ifdef USE_NEW_DETECTION2
+              peaks[peaks_idx].wx = -1;
+              peaks[peaks_idx].wy = -1;
+  #else
+              peaks[peaks_idx].w = -1;
+  #endif
+              peaks_idx++;
+            }
           }
         }
       }
+
+      if (++row_k == cell_sze)
+      {
+        row_k = 0;
+        ++row_cell;
+      }
     }
   }
   num_peaks = peaks_idx;
@@ -939,6 +1550,217 @@ _init_prox_mat(unsigned int* const & prox_mat,
 }
 
 
+/*
+Heap of the pairs of prox_mat for _peaks_clustering(): a key packs distance, row and column so that
+the order of the keys is the order in which the reference scan of prox_mat (_find_min_prox_mat())
+finds the minimum (smaller distance, then smaller row, then smaller column).
+*/
+#define PAIR_KEY(d, i, j) ((((unsigned int)(d)) << 16) | ((i) << 8) | (j))
+#define PAIR_KEY_DIST(key) ((key) >> 16)
+#define PAIR_KEY_ROW(key) (((key) >> 8) & 0xff)
+#define PAIR_KEY_COL(key) ((key) & 0xff)
+const int MAX_PAIRS_HEAP = MAX_NUM_PEAKS*(MAX_NUM_PEAKS-1)/2 + MAX_NUM_PEAKS; // all the pairs plus the updates of one merge
+
+
+static inline void
+_heap_sift_down(unsigned int* const heap, const int heap_sze, int i, const unsigned int key)
+{
+  for (;;)
+  {
+    int child = 2*i+1;
+    if (child >= heap_sze)
+      break;
+    if (child+1 < heap_sze && heap[child+1] < heap[child])
+      ++child;
+    if (key <= heap[child])
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = key;
+}
+
+
+static inline void
+_heap_push(unsigned int* const heap, int & heap_sze, const unsigned int key)
+{
+  int i = heap_sze++;
+  while (i > 0)
+  {
+    const int parent = (i-1)/2;
+    if (heap[parent] <= key)
+      break;
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = key;
+}
+
+
+static inline unsigned int
+_heap_pop(unsigned int* const heap, int & heap_sze)
+{
+  const unsigned int top = heap[0];
+  if (--heap_sze > 0)
+    _heap_sift_down(heap, heap_sze, 0, heap[heap_sze]);
+  return top;
+}
+
+
+// heap of all the pairs of prox_mat closer than cutoff
+static int
+_build_pairs_heap(const unsigned int* const & prox_mat, const int num_peaks, const unsigned int cutoff,
+                  unsigned int* const heap)
+{
+  int heap_sze = 0;
+  for (int i=0; i<num_peaks; ++i)
+  {
+    const unsigned int* ptr_prox_mat = prox_mat+i*num_peaks;
+    for (int j=i+1; j<num_peaks; ++j)
+      if (ptr_prox_mat[j] < cutoff)
+        heap[heap_sze++] = PAIR_KEY(ptr_prox_mat[j], i, j);
+  }
+
+  for (int i=heap_sze/2-1; i>=0; --i)
+    _heap_sift_down(heap, heap_sze, i, heap[i]);
+
+  return heap_sze;
+}
+
+
+/*
+Single linkage clustering of the peaks closer than cutoff (Manhattan distance).
+Same merges, in the same order, of the reference scan of the whole proximity matrix (see
+_peaks_clustering_reference()), but the closest pair is taken from a heap of the pairs closer
+than cutoff: when two clusters are merged the distances of the surviving one that decrease are
+pushed again and the old keys are discarded when popped (lazy invalidation, a key is valid while
+it matches prox_mat). The cost of a merge is linear in the number of peaks instead of quadratic.
+*/
+void
+_peaks_clustering(tPeakProps* const & peaks, int & num_peaks, const unsigned int cutoff)
+{
+  static unsigned int prox_mat[MAX_NUM_PEAKS*MAX_NUM_PEAKS];
+  static unsigned int heap[MAX_PAIRS_HEAP];
+  static int clusters[MAX_NUM_PEAKS];
+  static int clusters_num_elem[MAX_NUM_PEAKS];
+  static unsigned int sum_x[MAX_NUM_PEAKS];
+  static unsigned int sum_y[MAX_NUM_PEAKS];
+  static unsigned int sum_z[MAX_NUM_PEAKS];
+
+  assert(num_peaks <= MAX_NUM_PEAKS && MAX_NUM_PEAKS <= 256);  // see PAIR_KEY()
+  assert(cutoff <= 0xffff);
+
+  _init_prox_mat(prox_mat, peaks, num_peaks);
+
+  int heap_sze = _build_pairs_heap(prox_mat, num_peaks, cutoff, heap);
+
+  const unsigned int max_val = INT_MAX;
+  int num_clusters = 0;
+  memset(clusters, 0, sizeof(int)*num_peaks);
+  while (heap_sze > 0)
+  {
+    const unsigned int key = _heap_pop(heap, heap_sze);
+    const int min_idx = PAIR_KEY_ROW(key);
+    const int max_idx = PAIR_KEY_COL(key);
+    if (prox_mat[min_idx*num_peaks+max_idx] != PAIR_KEY_DIST(key))
+      continue;  // the pair has been merged or its distance has decreased
+
+    if (clusters[min_idx] == 0 && clusters[max_idx] == 0)
+    {
+      num_clusters++;
+      clusters[min_idx] = num_clusters;
+      clusters[max_idx] = num_clusters;
+    }
+    else
+    {
+      if (clusters[min_idx] == 0)
+        clusters[min_idx] = clusters[max_idx];
+      else
+        clusters[max_idx] = clusters[min_idx];
+    }
+
+    // room for the keys of this merge (at most one per peak)
+    if (heap_sze+num_peaks > MAX_PAIRS_HEAP)
+      heap_sze = _build_pairs_heap(prox_mat, num_peaks, cutoff, heap);
+
+    // min_idx represents the merged cluster, max_idx is removed
+    for (int i=0; i<=min_idx-1; ++i)
+    {
+      unsigned int offset = i*num_peaks;
+      unsigned int min_val = prox_mat[offset+max_idx];
+      if (min_val < prox_mat[offset+min_idx])
+      {
+        prox_mat[offset+min_idx] = min_val;
+        if (min_val < cutoff)
+          _heap_push(heap, heap_sze, PAIR_KEY(min_val, i, min_idx));
+      }
+      prox_mat[offset+max_idx] = max_val;
+    }
+    for (int j=min_idx+1; j<=max_idx-1; ++j)
+    {
+      unsigned int offset1 = min_idx*num_peaks+j;
+      unsigned int offset2 = j*num_peaks+max_idx;
+      unsigned int min_val = prox_mat[offset2];
+      if (min_val < prox_mat[offset1])
+      {
+        prox_mat[offset1] = min_val;
+        if (min_val < cutoff)
+          _heap_push(heap, heap_sze, PAIR_KEY(min_val, min_idx, j));
+      }
+      prox_mat[offset2] = max_val;
+    }
+    for (int j=max_idx+1; j<num_peaks; ++j)
+    {
+      unsigned int offset1 = min_idx*num_peaks+j;
+      unsigned int offset2 = max_idx*num_peaks+j;
+      unsigned int min_val = prox_mat[offset2];
+      if (min_val < prox_mat[offset1])
+      {
+        prox_mat[offset1] = min_val;
+        if (min_val < cutoff)
+          _heap_push(heap, heap_sze, PAIR_KEY(min_val, min_idx, j));
+      }
+      prox_mat[offset2] = max_val;
+    }
+    prox_mat[min_idx*num_peaks+max_idx] = max_val;
+  }
+
+  for (int i=0; i<num_peaks; ++i)
+  {
+    if (clusters[i] == 0)
+    {
+      num_clusters++;
+      clusters[i] = num_clusters;
+    }
+  }
+
+  memset(sum_x, 0, sizeof(unsigned int)*num_clusters);
+  memset(sum_y, 0, sizeof(unsigned int)*num_clusters);
+  memset(sum_z, 0, sizeof(unsigned int)*num_clusters);
+  memset(clusters_num_elem, 0, sizeof(int)*num_clusters);
+  for (int i=0; i<num_peaks; ++i)
+  {
+    unsigned int idx = clusters[i]-1;
+    sum_x[idx] += 1024*peaks[i].x;
+    sum_y[idx] += 1024*peaks[i].y;
+    sum_z[idx] += 1024*peaks[i].z;
+    clusters_num_elem[idx]++;
+  }
+
+  num_peaks = num_clusters;
+  for (int i=0; i<num_clusters; ++i)
+  {
+    assert(clusters_num_elem[i] > 0);
+    peaks[i].x = (sum_x[i]/clusters_num_elem[i])/1024;
+    peaks[i].y = (sum_y[i]/clusters_num_elem[i])/1024;
+    peaks[i].z = (int)(sum_z[i]/clusters_num_elem[i])/1024; //no more processing so round can be done
+  }
+}
+
+
+
+#ifdef CLUSTERING_BENCHMARK
+// reference version of _peaks_clustering(): the whole matrix is scanned for each merge
 void
 _find_min_prox_mat(const unsigned int* const & prox_mat, const int num_peaks,
                    unsigned int & min_dist, int & min_dist_i, int & min_dist_j)
@@ -964,7 +1786,7 @@ _find_min_prox_mat(const unsigned int* const & prox_mat, const int num_peaks,
 
 
 void
-_peaks_clustering(tPeakProps* const & peaks, int & num_peaks, const unsigned int cutoff)
+_peaks_clustering_reference(tPeakProps* const & peaks, int & num_peaks, const unsigned int cutoff)
 {
   static unsigned int prox_mat[MAX_NUM_PEAKS*MAX_NUM_PEAKS];
   static int clusters[MAX_NUM_PEAKS];
@@ -1060,30 +1882,225 @@ _peaks_clustering(tPeakProps* const & peaks, int & num_peaks, const unsigned int
     peaks[i].z = (int)(sum_z[i]/clusters_num_elem[i])/1024; //no more processing so round can be done
   }
 }
+#endif
+
+
+const int MAX_REGION_RUNS = (BINNED_DIM+MAX_BINNED_ROWS)/2+1; // runs of non-zero pixels (at most (ncols+1)/2 per row) plus background label
+
+// connected regions of the last map (see _label_regions())
+static unsigned char region_run_first[MAX_REGION_RUNS];   // first column of each run
+static unsigned char region_run_last[MAX_REGION_RUNS];    // last column of each run
+static unsigned short region_run_label[MAX_REGION_RUNS];  // provisional label of each run
+static int region_row_runs[MAX_BINNED_ROWS+1];            // runs of row r are region_row_runs[r]..region_row_runs[r+1]-1
+static unsigned short region_of_label[MAX_REGION_RUNS];   // index in regions of each provisional label
+static tRegionProps regions[MAX_REGION_RUNS];
+static int num_regions = 0;
+static unsigned short region_row_sum[MAX_BINNED_ROWS*(MAX_BINNED_COLS+1)];  // running sum of each row of the map (255*MAX_BINNED_COLS fits)
+
+
+static inline unsigned short
+_find_root(unsigned short* const parent, unsigned short l)
+{
+  while (parent[l] != l)
+  {
+    parent[l] = parent[parent[l]];  // path halving
+    l = parent[l];
+  }
+  return l;
+}
+
+
+/*
+Connected regions (4-connectivity) of the non-zero pixels of the map in a single raster pass with
+union-find on the runs of non-zero pixels: a run takes the label of the first run of the previous row
+that touches it and joins the sets of the others (the smaller label is always the root, so
+parent[l] <= l); the statistics of the run are accumulated on its provisional label. At the end the labels
+are resolved in increasing order, merging their statistics in the region of the root, without reading
+the map again. The pixels are only read and summed (running sum of the rows in region_row_sum, one zero
+before each row, for the window sums of the descriptors): labels and unions cost once per run.
+*/
+static void
+_label_regions(const unsigned char* const & map, const int nrows, const int ncols)
+{
+  static unsigned short parent[MAX_REGION_RUNS];
+  static tRegionProps props[MAX_REGION_RUNS];
+
+  assert(nrows <= MAX_BINNED_ROWS && ncols <= MAX_BINNED_COLS && MAX_BINNED_COLS <= 256);
+
+  int num_labels = 0;
+  int num_runs = 0;
+  int up_first = 0;  // runs of the previous row
+  for (int r=0; r<nrows; ++r)
+  {
+    const unsigned char* map_ptr = map+r*ncols;
+    unsigned short* sum_ptr = region_row_sum+r*(ncols+1);
+    const int up_last = num_runs;
+    int up = up_first;
+    region_row_runs[r] = num_runs;
+
+    unsigned short row_sum = 0;
+    sum_ptr[0] = 0;
+    int c = 0;
+    for (;;)
+    {
+      // background
+      for (; c<ncols && map_ptr[c] == 0; ++c)
+        sum_ptr[c+1] = row_sum;
+      if (c == ncols)
+        break;
+
+      // run of non-zero pixels
+      const int run_first = c;
+      unsigned int run_sum = 0;
+      int run_max_z = 0;
+      for (; c<ncols && map_ptr[c] != 0; ++c)
+      {
+        const int z = map_ptr[c];
+        run_sum += z;
+        if (z > run_max_z)
+          run_max_z = z;
+        sum_ptr[c+1] = row_sum + run_sum;
+      }
+      row_sum += run_sum;
+      const int run_last = c-1;
+
+      // runs of the previous row touching this one
+      while (up < up_last && region_run_last[up] < run_first)
+        ++up;
+      unsigned short label = 0;
+      for (int k=up; k<up_last && region_run_first[k] <= run_last; ++k)
+      {
+        const unsigned short up_label = region_run_label[k];
+        if (label == 0)
+          label = up_label;
+        else if (up_label != label)
+        {
+          const unsigned short root_up = _find_root(parent, up_label);
+          const unsigned short root = _find_root(parent, label);
+          if (root_up < root)
+            parent[root] = root_up;
+          else
+            parent[root_up] = root;
+        }
+      }
+
+      tRegionProps* prop;
+      if (label == 0)
+      {
+        label = ++num_labels;
+        parent[label] = label;
+        prop = &(props[label]);
+        prop->area = 0;
+        prop->sum_z = 0;
+        prop->min_x = run_first;
+        prop->max_x = run_last;
+        prop->min_y = r;
+        prop->max_z = 0;
+      }
+      else
+      {
+        prop = &(props[label]);
+        if (run_first < prop->min_x)
+          prop->min_x = run_first;
+        if (run_last > prop->max_x)
+          prop->max_x = run_last;
+      }
+      prop->area += run_last-run_first+1;
+      prop->sum_z += run_sum;
+      prop->max_y = r;
+      if (run_max_z > prop->max_z)
+        prop->max_z = run_max_z;
+
+      assert(num_runs < MAX_REGION_RUNS-1);
+      region_run_first[num_runs] = (unsigned char) run_first;
+      region_run_last[num_runs] = (unsigned char) run_last;
+      region_run_label[num_runs] = label;
+      ++num_runs;
+    }
+    up_first = up_last;
+  }
+  region_row_runs[nrows] = num_runs;
+
+  // resolution: the root of a label is smaller than the label, so it is already resolved
+  num_regions = 0;
+  for (int l=1; l<=num_labels; ++l)
+  {
+    if (parent[l] == l)
+    {
+      region_of_label[l] = num_regions;
+      regions[num_regions++] = props[l];
+      continue;
+    }
+
+    parent[l] = parent[parent[l]];
+    region_of_label[l] = region_of_label[parent[l]];
+
+    const tRegionProps* prop = &(props[l]);
+    tRegionProps* region = &(regions[region_of_label[l]]);
+    region->area += prop->area;
+    region->sum_z += prop->sum_z;
+    region->min_x = min(region->min_x, prop->min_x);
+    region->min_y = min(region->min_y, prop->min_y);
+    region->max_x = max(region->max_x, prop->max_x);
+    region->max_y = max(region->max_y, prop->max_y);
+    region->max_z = max(region->max_z, prop->max_z);
+  }
+}
+
+
+// sum of the map in rows first_r..last_r and columns first_c..last_c from the running sums of the rows
+static inline unsigned int
+_window_sum(const int ncols, const int first_r, const int last_r, const int first_c, const int last_c)
+{
+  unsigned int sum = 0;
+  const unsigned short* sum_ptr = region_row_sum+first_r*(ncols+1);
+  for (int r=first_r; r<=last_r; ++r, sum_ptr+=ncols+1)
+    sum += sum_ptr[last_c+1] - sum_ptr[first_c];
+  return sum;
+}
+
+
+// index in regions of the region under the pixel (r, c), -1 on the background
+static inline int
+_region_at(const int r, const int c)
+{
+  for (int k=region_row_runs[r]; k<region_row_runs[r+1] && region_run_first[k] <= c; ++k)
+    if (c <= region_run_last[k])
+      return region_of_label[region_run_label[k]];
+  return -1;
+}
+
+
+const tRegionProps*
+peak_regions(int & o_num_regions)
+{
+  o_num_regions = num_regions;
+  return regions;
+}
 
 
 #ifdef USE_NEW_DETECTION2
+/*
+Descriptors of the peaks in the window kernel_x_dim x kernel_y_dim centered on each of them:
+- a: mean of the map in the window times the window size, divided by the peak disparity (window sum from
+  the running sums of the rows of _label_regions(), one subtraction per row);
+- wx, wy: max number of pixels not lower than half of the peak disparity on a row/column of the window.
+  Such pixels are not zero (if z/2 > 0), so they belong to the regions reaching z/2 and the count is done
+  only in the part of the window covered by their bounding boxes.
+_label_regions() must have been called on the same map.
+*/
 void
 _peaks_area_and_width_computation(tPeakProps* const & peaks, const int num_peaks, 
                                   const unsigned char* const & map, const int nrows, const int ncols)
 {
-  int radiusX = KERNEL_X_DIM/2;
-  int radiusY = KERNEL_Y_DIM/2;
+  int radiusX = kernel_x_dim/2;
+  int radiusY = kernel_y_dim/2;
   //const int FACT = 2048;
 
-  unsigned long maximum_base = (KERNEL_X_DIM*KERNEL_Y_DIM); //*FACT);
+  unsigned long maximum_base = (kernel_x_dim*kernel_y_dim); //*FACT);
   for (int i=0; i<num_peaks; ++i)
   {
     tPeakProps* peak = &(peaks[i]);
-    
-    unsigned long sum = 0;
-    unsigned long peak_base = 0;
-    unsigned int peak_w = 0;
-    unsigned int peak_h = 0;
-
-    unsigned int local_peak_h[KERNEL_X_DIM];
-    for (int c=0; c<KERNEL_X_DIM; ++c)
-      local_peak_h[c]=0;
 
     int first_r = max(0,peak->y-radiusY);
     int last_r  = min(nrows-1,peak->y+radiusY);
@@ -1091,30 +2108,64 @@ _peaks_area_and_width_computation(tPeakProps* const & peaks, const int num_peaks
     int first_c = max(0,peak->x-radiusX);
     int last_c  = min(ncols-1,peak->x+radiusX);
 
-    for (int r=first_r; r<=last_r; ++r)
+    unsigned long sum = _window_sum(ncols, first_r, last_r, first_c, last_c);
+    unsigned long peak_base = (last_r-first_r+1)*(last_c-first_c+1);
+
+    assert(peak->z > 0);
+    peak->a = (((maximum_base*sum)/peak_base)/peak->z); ///FACT;
+    peak->region = _region_at(peak->y, peak->x);
+
+    const int peak_thr = peak->z/2;
+    if (peak_thr == 0)  // every pixel of the window is counted
+    {
+      peak->wx = last_c-first_c+1;
+      peak->wy = last_r-first_r+1;
+      continue;
+    }
+
+    // part of the window covered by the regions that can reach peak_thr
+    int box_first_r = last_r+1, box_last_r = first_r-1;
+    int box_first_c = last_c+1, box_last_c = first_c-1;
+    for (int k=0; k<num_regions; ++k)
+    {
+      const tRegionProps* region = &(regions[k]);
+      if (region->max_z < peak_thr ||
+          region->max_x < first_c || region->min_x > last_c ||
+          region->max_y < first_r || region->min_y > last_r)
+        continue;
+      box_first_r = min(box_first_r, max(first_r, region->min_y));
+      box_last_r  = max(box_last_r,  min(last_r,  region->max_y));
+      box_first_c = min(box_first_c, max(first_c, region->min_x));
+      box_last_c  = max(box_last_c,  min(last_c,  region->max_x));
+    }
+
+    unsigned int peak_w = 0;
+    unsigned int peak_h = 0;
+
+    unsigned int local_peak_h[MAX_KERNEL_DIM];
+    for (int c=0; c<=box_last_c-box_first_c; ++c)
+      local_peak_h[c]=0;
+
+    for (int r=box_first_r; r<=box_last_r; ++r)
     {
+      const unsigned char* map_ptr = map+r*ncols;
       unsigned int local_peak_w = 0;
-      for (int c=first_c; c<=last_c; ++c)
+      for (int c=box_first_c; c<=box_last_c; ++c)
       {
-        unsigned char elem = map[r*ncols+c];
-        sum += elem;
-        ++peak_base;
-        if (elem >= peak->z/2)
+        if (map_ptr[c] >= peak_thr)
         {
           local_peak_w++;
-          local_peak_h[c-first_c]++;
+          local_peak_h[c-box_first_c]++;
         }
       }
       if (local_peak_w > peak_w)
         peak_w = local_peak_w;
     }
 
-    for (int c=0; c<KERNEL_X_DIM; ++c)
+    for (int c=0; c<=box_last_c-box_first_c; ++c)
       if (local_peak_h[c] > peak_h)
         peak_h = local_peak_h[c];
 
-    assert(peak->z > 0);
-    peak->a = (((maximum_base*sum)/peak_base)/peak->z); ///FACT;
     peak->wx = peak_w;
     peak->wy = peak_h;
   }
@@ -1125,9 +2176,9 @@ _peaks_pruning(tPeakProps* & peaks, int & num_peaks, const int min_area, const i
 {
   static tPeakProps pruned_peaks[MAX_NUM_PEAKS];
 
-  assert(min_area >= 16);
-  assert(min_w >= 4);
-  assert(min_h >= 4);
+  assert(min_area >= min_area_orig/(MAX_BINNING*MAX_BINNING));
+  assert(min_w >= min_w_orig/MAX_BINNING);
+  assert(min_h >= min_h_orig/MAX_BINNING);
 
   int pruned_peaks_idx = 0;
   for (int i=0; i<num_peaks; ++i)
@@ -1135,7 +2186,7 @@ _peaks_pruning(tPeakProps* & peaks, int & num_peaks, const int min_area, const i
     tPeakProps* peak = &(peaks[i]);
     float dim_ratio = (peak->wx/(float)peak->wy);
     
-    int max_w_from_z = peak->z/FROM_DISP_TO_SHOULDER;    
+    int max_w_from_z = peak->z/from_disp_to_shoulder;    
     if (peak->a >= min_area &&
         peak->wx >= min_w && peak->wy >= min_h &&
         (peak->wx <= max_w_from_z && peak->wy <= max_w_from_z) &&
@@ -1175,24 +2226,21 @@ void
 _peaks_area_and_width_computation(tPeakProps* const & peaks, const int num_peaks, 
                                   const unsigned char* const & map, const int nrows, const int ncols)
 {
-  int radiusX = KERNEL_X_DIM/2;
-  int radiusY = KERNEL_Y_DIM/2;
+  int radiusX = kernel_x_dim/2;
+  int radiusY = kernel_y_dim/2;
 
-  unsigned int maximum_base = (KERNEL_X_DIM*KERNEL_Y_DIM*1024);
+  unsigned int maximum_base = (kernel_x_dim*kernel_y_dim*1024);
   for (int i=0; i<num_peaks; ++i)
   {
     tPeakProps* peak = &(peaks[i]);
-    unsigned int sum = 0;
-    unsigned int peak_base = 0;
-    for (int r=max(0,peak->y-radiusY); r<=min(nrows-1,peak->y+radiusY); ++r)
-    {
-      for (int c=max(0,peak->x-radiusX); c<=min(ncols-1,peak->x+radiusX); ++c)
-      {
-        sum += map[r*ncols+c];
-        ++peak_base;
-      }
-    }
+    int first_r = max(0,peak->y-radiusY);
+    int last_r  = min(nrows-1,peak->y+radiusY);
+    int first_c = max(0,peak->x-radiusX);
+    int last_c  = min(ncols-1,peak->x+radiusX);
+    unsigned int sum = _window_sum(ncols, first_r, last_r, first_c, last_c);
+    unsigned int peak_base = (last_r-first_r+1)*(last_c-first_c+1);
     peak->a = (((maximum_base/peak_base)*sum)/peak->z)/1024;
+    peak->region = _region_at(peak->y, peak->x);
   }
 }
 
@@ -1201,7 +2249,7 @@ _peaks_pruning(tPeakProps* & peaks, int & num_peaks, const int min_area)
 {
   static tPeakProps pruned_peaks[MAX_NUM_PEAKS];
 
-  assert(min_area > 9);
+  assert(min_area >= min_area_orig/(MAX_BINNING*MAX_BINNING));
 
   //int radiusX = KERNEL_X_DIM/2;
   //int radiusY = KERNEL_Y_DIM/2;
@@ -1225,32 +2273,50 @@ _peaks_pruning(tPeakProps* & peaks, int & num_peaks, const int min_area)
 float
 peak_detection_init()
 {
-  static bool first_time = true;
+  static int kernel_binning = 0;  // binning of the current kernel (see set_detection_binning())
   static float sum;
-  if (first_time)
+  if (kernel_binning != binning)
   {
-    printf("peak_detection_init(): inizializzazione dati peak_detection.\n");
+    printf("peak_detection_init(): inizializzazione dati peak_detection (binning %d).\n", binning);
 
-    assert(KERNEL_X_DIM%2 == 1);
-    assert(KERNEL_Y_DIM%2 == 1);
+    assert(kernel_x_dim%2 == 1);
+    assert(kernel_y_dim%2 == 1);
 
-    first_time = false;
-    
-    const float sigma = 4.246f;
-    const float var = sigma*sigma;
-    int offset_x = KERNEL_X_DIM/2;
-    int offset_y = KERNEL_Y_DIM/2;
+    kernel_binning = binning;
 
-    sum = 0;
-    for (int i=-offset_x; i<=offset_x; ++i)
-      for (int j=-offset_y; j<=offset_y; ++j)
-        sum += exp(-(i*i+j*j)/var);
+    // kernels baked for this binning (see kernel_half[])
+    const unsigned int* const half = kernel_half[binning-MIN_BINNING];
+    int offset_x = kernel_x_dim/2;
+    int offset_y = kernel_y_dim/2;
+    assert(offset_x < KERNEL_HALF_DIM && offset_y < KERNEL_HALF_DIM);
+
+    sum = kernel_sum[binning-MIN_BINNING];
 
     for (int i=-offset_x; i<=offset_x; ++i)
-      kernel_x[i+offset_x] = (unsigned int) (1024*exp(-i*i/var));
+      kernel_x[i+offset_x] = half[abs(i)];
 
     for (int i=-offset_y; i<=offset_y; ++i)
-      kernel_y[i+offset_y] = (unsigned int) (1024*exp(-i*i/var));
+      kernel_y[i+offset_y] = half[abs(i)];
+
+#ifndef NDEBUG
+    // the baked kernels must be the gaussian with the current sigma and dimensions
+    {
+      const float sigma = KERNEL_SIGMA*((float)DEFAULT_BINNING/binning);
+      const float var = sigma*sigma;
+
+      float check_sum = 0;
+      for (int i=-offset_x; i<=offset_x; ++i)
+        for (int j=-offset_y; j<=offset_y; ++j)
+          check_sum += exp(-(i*i+j*j)/var);
+      assert(fabs(check_sum-sum) <= 1e-4f*sum);
+
+      for (int i=-offset_x; i<=offset_x; ++i)
+        assert(kernel_x[i+offset_x] == (unsigned int) (1024*exp(-i*i/var)));
+
+      for (int i=-offset_y; i<=offset_y; ++i)
+        assert(kernel_y[i+offset_y] == (unsigned int) (1024*exp(-i*i/var)));
+    }
+#endif
   }
 
   return sum;
@@ -1271,10 +2337,37 @@ peak_detection(unsigned char * const & bmap, const int bnrows, const int bncols,
   }
 #endif
 
+  static unsigned char morph_scratch[MORPH_SCRATCH_DIM];
+  static tRowBand bands[MAX_ROW_BANDS];
+  assert(bnrows*bncols <= BINNED_DIM);
+  assert(max(strel_sze_h, strel_sze_v) <= MAX_STREL_SZE && max(strel_sze2_h, strel_sze2_v) <= MAX_STREL_SZE);
+
+  // kernel and threshold initialization (the kernel dimensions are needed for the bands)
+  float sum = peak_detection_init();
+
+#ifndef FULL_FRAME_DETECTION
+  // rows with foreground: without foreground there are no peaks and the rest of the pipeline is skipped
+  const int num_bands = _foreground_bands(bmap, bnrows, bncols, bands);
+  if (num_bands == 0)
+  {
+    static tPeakProps no_peaks[1];
+    num_peaks = 0;
+    num_regions = 0;
+    return no_peaks;
+  }
+
+  // close and open, band by band
+  _closeopen_bands(bmap, bnrows, bncols, bands, num_bands, morph_scratch);
+#else
+  const int num_bands = 1;
+  _set_row_band(&(bands[0]), 0, bnrows-1, bnrows, true);
+#ifndef SHOW_CLOSE_OPEN
+  _closeopen(bmap, bnrows, bncols, morph_scratch);
+#else
   // close
   if (strel_sze_h > 0)
   {
-    _imdilate(bmap, bnrows, bncols, strel_sze_h, strel_sze_v);
+    _imdilate(bmap, bnrows, bncols, strel_sze_h, strel_sze_v, morph_scratch);
 #ifdef SHOW_DILATED_IMAGE
     {
       IplImage* tmp = cvCreateImageHeader(cvSize(bncols, bnrows), IPL_DEPTH_8U, 1);
@@ -1288,7 +2381,7 @@ peak_detection(unsigned char * const & bmap, const int bnrows, const int bncols,
     }
 #endif
 
-    _imerode(bmap, bnrows, bncols, strel_sze_h, strel_sze_v);
+    _imerode(bmap, bnrows, bncols, strel_sze_h, strel_sze_v, morph_scratch);
 #ifdef SHOW_ERODED_IMAGE
     {
       IplImage* tmp = cvCreateImageHeader(cvSize(bncols, bnrows), IPL_DEPTH_8U, 1);
@@ -1307,7 +2400,7 @@ peak_detection(unsigned char * const & bmap, const int bnrows, const int bncols,
   // open
   if (strel_sze2_h > 0)
   {
-    _imerode(bmap, bnrows, bncols, strel_sze2_h, strel_sze2_v);
+    _imerode(bmap, bnrows, bncols, strel_sze2_h, strel_sze2_v, morph_scratch);
 #ifdef SHOW_ERODED_IMAGE
     {
       IplImage* tmp = cvCreateImageHeader(cvSize(bncols, bnrows), IPL_DEPTH_8U, 1);
@@ -1322,7 +2415,7 @@ peak_detection(unsigned char * const & bmap, const int bnrows, const int bncols,
     }
 #endif
 
-    _imdilate(bmap, bnrows, bncols, strel_sze2_h, strel_sze2_v);
+    _imdilate(bmap, bnrows, bncols, strel_sze2_h, strel_sze2_v, morph_scratch);
 #ifdef SHOW_DILATED_IMAGE
     {
       IplImage* tmp = cvCreateImageHeader(cvSize(bncols, bnrows), IPL_DEPTH_8U, 1);
@@ -1335,20 +2428,22 @@ peak_detection(unsigned char * const & bmap, const int bnrows, const int bncols,
     }
 #endif
   }
-
-  // kernel and threshold initialization
-  float sum = peak_detection_init();
+#endif // SHOW_CLOSE_OPEN
+#endif // FULL_FRAME_DETECTION
 
   // amplification
   unsigned int* C;
-  _peak_amplification(bmap, bnrows, bncols, &C);
+  _peak_amplification(bmap, bnrows, bncols, bands, num_bands, &C);
 
   // detection
-  tPeakProps* peaks = _peak_detection(bmap, C, bnrows, bncols, sum, num_peaks);
+  tPeakProps* peaks = _peak_detection(bmap, C, bnrows, bncols, bands, num_bands, sum, num_peaks);
 
   // clustering
   _peaks_clustering(peaks, num_peaks, person_head_width/binning);
 
+  // connected regions and running sums of the rows of the map
+  _label_regions(bmap, bnrows, bncols);
+
   // compute other decriptor parameters
   _peaks_area_and_width_computation(peaks, num_peaks, bmap, bnrows, bncols);
 
@@ -1402,6 +2497,280 @@ peak_detection(unsigned char * const & bmap, const int bnrows, const int bncols,
 }
 
 
+#ifdef MORPH_BENCHMARK
+/*!
+\brief Confronta la chiusura+apertura fusa (_imcloseopen()) con le quattro operazioni in sequenza.
+
+Per ogni binning supportato elabora iterations mappe casuali delle dimensioni usate da peak_detection()
+con entrambe le versioni, verifica che i risultati coincidano e stampa il tempo medio per mappa.
+Al termine ripristina il binning corrente.
+
+\return il numero di mappe con risultati diversi (0 se le due versioni sono equivalenti)
+*/
+int
+morph_closeopen_benchmark(const int iterations)
+{
+  static unsigned char seq_map[BINNED_DIM];
+  static unsigned char fused_map[BINNED_DIM];
+  static unsigned char seq_scratch[MORPH_SCRATCH_MAX_SIZE((NY-2*BORDER_Y+MIN_BINNING)/MIN_BINNING, MAX_BINNED_COLS, MAX_STREL_SZE)];
+  static unsigned char fused_scratch[MORPH_CLOSEOPEN_SCRATCH_SIZE(MAX_BINNED_COLS, MAX_STREL_SZE)];
+
+  const int old_binning = binning;
+  int mismatches = 0;
+
+  srand(1);
+  for (int b=MIN_BINNING; b<=MAX_BINNING; ++b)
+  {
+    set_detection_binning(b);
+    int bnrows, bncols;
+    compute_binned_nrow_ncols(NY, NX, binning, BORDER_X, BORDER_Y, bnrows, bncols);
+    const int dim = bnrows*bncols;
+
+    clock_t seq_ticks = 0, fused_ticks = 0;
+    for (int it=0; it<iterations; ++it)
+    {
+      // disparita' casuali con zone vuote, come dopo la sottrazione dello sfondo
+      for (int i=0; i<dim; ++i)
+        seq_map[i] = (rand()%3 == 0) ? 0 : (unsigned char) (min_disp + rand()%(256-min_disp));
+      memcpy(fused_map, seq_map, dim);
+
+      clock_t start = clock();
+      if (strel_sze_h > 0)
+      {
+        _imdilate(seq_map, bnrows, bncols, strel_sze_h, strel_sze_v, seq_scratch);
+        _imerode(seq_map, bnrows, bncols, strel_sze_h, strel_sze_v, seq_scratch);
+      }
+      if (strel_sze2_h > 0)
+      {
+        _imerode(seq_map, bnrows, bncols, strel_sze2_h, strel_sze2_v, seq_scratch);
+        _imdilate(seq_map, bnrows, bncols, strel_sze2_h, strel_sze2_v, seq_scratch);
+      }
+      seq_ticks += clock()-start;
+
+      start = clock();
+      _imcloseopen(fused_map, bnrows, bncols, strel_sze_h, strel_sze_v, strel_sze2_h, strel_sze2_v, fused_scratch);
+      fused_ticks += clock()-start;
+
+      if (memcmp(seq_map, fused_map, dim) != 0)
+        ++mismatches;
+    }
+
+    printf("morph_closeopen_benchmark(): binning %d (%dx%d, close %dx%d, open %dx%d): sequenziale %.2f us, fusa %.2f us\n",
+      binning, bncols, bnrows, strel_sze_h, strel_sze_v, strel_sze2_h, strel_sze2_v,
+      1e6*seq_ticks/((double)CLOCKS_PER_SEC*iterations), 1e6*fused_ticks/((double)CLOCKS_PER_SEC*iterations));
+  }
+
+  set_detection_binning(old_binning);
+
+  if (mismatches > 0)
+    printf("morph_closeopen_benchmark(): %d mappe con risultati diversi!\n", mismatches);
+
+  return mismatches;
+}
+#endif
+
+
+#ifdef CLUSTERING_BENCHMARK
+/*!
+Confronta _peaks_clustering() con la versione di riferimento (_peaks_clustering_reference()) su
+MAX_NUM_PEAKS picchi casuali per ogni binning, con la stessa soglia usata in peak_detection().
+Restituisce il numero di insiemi di picchi con risultati diversi.
+*/
+int
+peaks_clustering_benchmark(const int iterations)
+{
+  static tPeakProps peaks_in[MAX_NUM_PEAKS];
+  static tPeakProps heap_peaks[MAX_NUM_PEAKS];
+  static tPeakProps ref_peaks[MAX_NUM_PEAKS];
+  tPeakProps* const heap_ptr = heap_peaks;
+  tPeakProps* const ref_ptr = ref_peaks;
+
+  const int old_binning = binning;
+  int mismatches = 0;
+
+  srand(1);
+  for (int b=MIN_BINNING; b<=MAX_BINNING; ++b)
+  {
+    set_detection_binning(b);
+    int bnrows, bncols;
+    compute_binned_nrow_ncols(NY, NX, binning, BORDER_X, BORDER_Y, bnrows, bncols);
+    const unsigned int cutoff = person_head_width/binning;
+
+    clock_t ref_ticks = 0, heap_ticks = 0;
+    int clusters_out = 0;
+    for (int it=0; it<iterations; ++it)
+    {
+      // caso peggiore: la mappa piena di picchi, molti dei quali entro la soglia
+      memset(peaks_in, 0, sizeof(peaks_in));
+      for (int i=0; i<MAX_NUM_PEAKS; ++i)
+      {
+        peaks_in[i].x = rand()%bncols;
+        peaks_in[i].y = rand()%bnrows;
+        peaks_in[i].z = min_disp + rand()%(256-min_disp);
+      }
+      memcpy(ref_peaks, peaks_in, sizeof(peaks_in));
+      memcpy(heap_peaks, peaks_in, sizeof(peaks_in));
+      int ref_num = MAX_NUM_PEAKS;
+      int heap_num = MAX_NUM_PEAKS;
+
+      clock_t start = clock();
+      _peaks_clustering_reference(ref_ptr, ref_num, cutoff);
+      ref_ticks += clock()-start;
+
+      start = clock();
+      _peaks_clustering(heap_ptr, heap_num, cutoff);
+      heap_ticks += clock()-start;
+
+      clusters_out += heap_num;
+      if (ref_num != heap_num || memcmp(ref_peaks, heap_peaks, sizeof(tPeakProps)*ref_num) != 0)
+        ++mismatches;
+    }
+
+    printf("peaks_clustering_benchmark(): binning %d (%d picchi, soglia %u, %.1f cluster): riferimento %.2f us, heap %.2f us\n",
+      binning, MAX_NUM_PEAKS, cutoff, (double)clusters_out/iterations,
+      1e6*ref_ticks/((double)CLOCKS_PER_SEC*iterations), 1e6*heap_ticks/((double)CLOCKS_PER_SEC*iterations));
+  }
+
+  set_detection_binning(old_binning);
+
+  if (mismatches > 0)
+    printf("peaks_clustering_benchmark(): %d insiemi di picchi con risultati diversi!\n", mismatches);
+
+  return mismatches;
+}
+#endif
+
+
+#ifdef GAUSSIAN_CONV_TEST
+/*!
+\brief Confronta la convoluzione gaussiana in virgola fissa (_gaussH()/_gaussV()) con quella di riferimento (_convH()/_convV()).
+
+Per ogni binning supportato la mappa di disparit&agrave; map (NX x NY, ad esempio un frame registrato) viene
+ridotta e chiusa+aperta come in peak_detection(), poi convoluta con entrambe le versioni sull'intera mappa
+(C1 e C2 devono coincidere) e per bande di righe come in _peak_amplification() (C2 deve coincidere nelle
+righe lette dai massimi locali delle bande attive). Al termine ripristina il binning corrente.
+
+\param ref_ticks [in,out] tempo accumulato dalla versione di riferimento (se non NULL)
+\param fixed_ticks [in,out] tempo accumulato dalla versione in virgola fissa (se non NULL)
+\return il numero di binning con risultati diversi (0 se le due versioni sono equivalenti)
+*/
+int
+gaussian_conv_check(const unsigned char* const map, clock_t* ref_ticks, clock_t* fixed_ticks)
+{
+  static unsigned char bmap[BINNED_DIM];
+  static unsigned char bp_mask[BINNED_DIM];
+  static unsigned char morph_scratch[MORPH_SCRATCH_DIM];
+  static unsigned int ref_C1[BINNED_DIM];
+  static unsigned int ref_C2[BINNED_DIM];
+  static unsigned int C1[BINNED_DIM];
+  static unsigned int C2[BINNED_DIM];
+  static tRowBand bands[MAX_ROW_BANDS];
+
+  const int old_binning = binning;
+  int mismatches = 0;
+
+  for (int b=MIN_BINNING; b<=MAX_BINNING; ++b)
+  {
+    set_detection_binning(b);
+    peak_detection_init();
+
+    int bnrows, bncols;
+    image_binning(map, NY, NX, binning, BORDER_X, BORDER_Y, bmap, bp_mask, bnrows, bncols);
+    _closeopen(bmap, bnrows, bncols, morph_scratch);
+    const int dim = bnrows*bncols;
+
+    clock_t start = clock();
+    _convH(bmap, bnrows, bncols, ref_C1);
+    _convV(ref_C1, bnrows, bncols, ref_C2);
+    if (ref_ticks != NULL)
+      *ref_ticks += clock()-start;
+
+    start = clock();
+    _gaussH(bmap, bnrows, bncols, C1);
+    _gaussV(C1, 0, bnrows-1, bncols, C2, 0, bnrows-1);
+    if (fixed_ticks != NULL)
+      *fixed_ticks += clock()-start;
+
+    bool differ = (memcmp(C1, ref_C1, dim*sizeof(unsigned int)) != 0 ||
+                   memcmp(C2, ref_C2, dim*sizeof(unsigned int)) != 0);
+
+    // the same map band by band, as in peak_detection()
+#ifndef FULL_FRAME_DETECTION
+    const int num_bands = _foreground_bands(bmap, bnrows, bncols, bands);
+#else
+    const int num_bands = 1;
+    _set_row_band(&(bands[0]), 0, bnrows-1, bnrows, true);
+#endif
+    unsigned int* C;
+    _peak_amplification(bmap, bnrows, bncols, bands, num_bands, &C);
+    for (int i=0; i<num_bands && !differ; ++i)
+    {
+      const tRowBand* band = &(bands[i]);
+      if (!band->active)
+        continue;
+      const int offset = band->nms_first_r*bncols;
+      const int sz = (band->nms_last_r-band->nms_first_r+1)*bncols;
+      differ = (memcmp(C+offset, ref_C2+offset, sz*sizeof(unsigned int)) != 0);
+    }
+
+    if (differ)
+    {
+      printf("gaussian_conv_check(): binning %d (%dx%d), la convoluzione in virgola fissa differisce da _convH()/_convV()!\n",
+        binning, bncols, bnrows);
+      ++mismatches;
+    }
+  }
+
+  set_detection_binning(old_binning);  // the kernel is restored by the next peak_detection()
+
+  return mismatches;
+}
+
+
+/*!
+Esegue gaussian_conv_check() su iterations mappe casuali: rettangoli di disparit&agrave; su fondo nullo
+(bande di righe separate da zone vuote) con pixel isolati, e stampa il tempo medio per mappa delle due versioni.
+Restituisce il numero di confronti con risultati diversi.
+*/
+int
+gaussian_conv_test(const int iterations)
+{
+  static unsigned char map[NX*NY];
+
+  clock_t ref_ticks = 0, fixed_ticks = 0;
+  int mismatches = 0;
+
+  srand(1);
+  for (int it=0; it<iterations; ++it)
+  {
+    memset(map, 0, sizeof(map));
+    const int num_blobs = 1+rand()%8;
+    for (int n=0; n<num_blobs; ++n)
+    {
+      const int w = 10+rand()%60, h = 10+rand()%60;
+      const int x0 = rand()%(NX-w), y0 = rand()%(NY-h);
+      for (int y=y0; y<y0+h; ++y)
+        for (int x=x0; x<x0+w; ++x)
+          map[y*NX+x] = (unsigned char) (min_disp + rand()%(256-min_disp));
+    }
+    for (int n=0; n<NX; ++n)
+      map[rand()%(NX*NY)] = (unsigned char) (rand()%256);
+
+    mismatches += gaussian_conv_check(map, &ref_ticks, &fixed_ticks);
+  }
+
+  printf("gaussian_conv_test(): %d mappe, binning %d..%d: riferimento %.2f us, virgola fissa %.2f us (intera mappa, tutti i binning)\n",
+    iterations, MIN_BINNING, MAX_BINNING,
+    1e6*ref_ticks/((double)CLOCKS_PER_SEC*iterations), 1e6*fixed_ticks/((double)CLOCKS_PER_SEC*iterations));
+
+  if (mismatches > 0)
+    printf("gaussian_conv_test(): %d confronti con risultati diversi!\n", mismatches);
+
+  return mismatches;
+}
+#endif
+
+
 //#define NORMALIZE_CONV
 //// convolve horizontally
 //void _convH(unsigned char * const & map, const int nrows, const int ncols, 
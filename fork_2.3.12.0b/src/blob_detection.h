@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 #include "directives.h"
+#ifdef GAUSSIAN_CONV_TEST
+#include <time.h>
+#endif
 
 #ifdef USE_NEW_DETECTION
 
@@ -35,9 +38,25 @@ typedef struct _PeakProps {
 #else
     w; 
 #endif
+  int region; // index in peak_regions() of the region under the peak (-1 if the peak is on the background)
 } tPeakProps;
 
-const int binning = 3; // if changed, the kernel dimension and values should be changed coherently
+/* Connected regions (4-connectivity) of the non-zero pixels of the binned map */
+typedef struct _RegionProps {
+  int area;                        // number of pixels
+  unsigned int sum_z;              // sum of the disparities
+  int min_x, min_y, max_x, max_y;  // bounding box (binned coordinates)
+  int max_z;                       // max disparity
+} tRegionProps;
+
+const int DEFAULT_BINNING = 3; // binning used to tune kernels and thresholds (the other values are rescaled from this one)
+const int MIN_BINNING = 2;     // finest detection resolution (static buffers are sized for this one)
+const int MAX_BINNING = 4;     // coarsest detection resolution
+
+extern int binning; // current detection binning, changed only by set_detection_binning() between two frames
+
+int select_detection_binning(const int i_inst_height);
+bool set_detection_binning(const int i_binning);
 
 void
 compute_binned_nrow_ncols(
@@ -52,6 +71,25 @@ tPeakProps* peak_detection(
   const int bncols,
   int & num_peaks);
 
+/*!
+Regions of the map of the last call to peak_detection(), computed in the same pass of the peak
+descriptors (valid until the next call, coordinates are not unbinned by peak_unbinning()).
+*/
+const tRegionProps* peak_regions(int & num_regions);
+
+#ifdef MORPH_BENCHMARK
+int morph_closeopen_benchmark(const int iterations);
+#endif
+
+#ifdef CLUSTERING_BENCHMARK
+int peaks_clustering_benchmark(const int iterations);
+#endif
+
+#ifdef GAUSSIAN_CONV_TEST
+int gaussian_conv_check(const unsigned char* const map, clock_t* ref_ticks = NULL, clock_t* fixed_ticks = NULL);
+int gaussian_conv_test(const int iterations);
+#endif
+
 void image_binning(
   const unsigned char * const & map, 
   const int nrows, const int ncols, 
@@ -61,6 +99,19 @@ void image_binning(
   unsigned char * const & i_bp_mask,
   int & bnrows, int & bncols);
 
+int image_binning_bg_subtraction(
+  const unsigned char * const & map, 
+  const unsigned char * const & thr,
+  const int nrows, const int ncols, 
+  const int binning,
+  const int border_x, const int border_y,
+  unsigned char * const & o_map,
+  unsigned char * const & bmap, 
+  unsigned char * const & i_bp_mask,
+  int & bnrows, int & bncols);
+
+int count_black_pixels(const unsigned char * const & map);
+
 void
 peak_unbinning(
   tPeakProps* const & peaks,
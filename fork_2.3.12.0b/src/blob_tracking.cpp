@@ -9,11 +9,18 @@
 #include "OutOfRangeManager.h"
 #endif
 
+#ifdef USE_TRACK_EVENTS
+#include "spsc_queue.h"  // SPSC_BARRIER()
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
 #include <limits.h>
+#ifdef CROWD_BENCHMARK
+#include <time.h>
+#endif
 
 //#define VERBOSE
 
@@ -78,6 +85,108 @@ static unsigned long num_frame = 0;
 tPersonTracked ** inhi = NULL;
 tPersonTracked ** inlo = NULL;
 
+// liste inhi/inlo e blob tracciati a dimensione massima: nessuna allocazione durante il tracking
+static tPersonTracked* inhi_slots[MAX_NUM_PERS];
+static tPersonTracked* inlo_slots[MAX_NUM_PERS];
+
+const int TRACK_POOL_DIM = 2*MAX_NUM_PERS;  ///< inhi e inlo insieme
+static tPersonTracked track_pool[TRACK_POOL_DIM];
+static int track_free_list[TRACK_POOL_DIM];  ///< indici liberi in track_pool (pila)
+static int track_free_num = -1;  ///< -1 finche' il pool non e' inizializzato
+static unsigned long track_id_counter = 0;  ///< ultimo tPersonTracked::ID assegnato
+
+
+#ifdef USE_TRACK_EVENTS
+/*
+Ring degli eventi del tracking: un solo produttore (il thread che esegue track()) e un numero
+qualsiasi di lettori, ognuno con il proprio cursore (vedi GetTrackEvents()). Il produttore non
+aspetta mai i lettori: chi resta indietro di piu' di TRACK_EVENTS_LEN-1 eventi perde i piu' vecchi
+e ne viene informato. Come in SpscQueue basta che la scrittura dell'indice (word allineata) venga
+vista dopo quella dei dati.
+*/
+static tTrackEvent track_events[TRACK_EVENTS_LEN];
+static volatile unsigned long track_events_head = 0;  ///< eventi pubblicati (modificato solo dal produttore)
+static volatile unsigned int track_events_mask = ~0u;  ///< TRACK_EV_MASK() degli eventi da pubblicare
+static unsigned long track_events_frame = 0;  ///< frame acquisiti (vedi SetTrackingFrameStep())
+static unsigned long last_counted_id[2] = {0, 0};  ///< ultimo blob contato in uscita [0] e in ingresso [1]
+
+
+static void
+_publish_event(const int type, const unsigned long id, const int x, const int y, const int h)
+{
+  if ((track_events_mask & TRACK_EV_MASK(type)) == 0)
+    return;
+
+  const unsigned long head = track_events_head;
+  tTrackEvent* const ev = &track_events[head & (TRACK_EVENTS_LEN-1)];
+  ev->frame = track_events_frame;
+  ev->track_id = id;
+  ev->type = (unsigned char)type;
+  ev->h = (unsigned char)h;
+  ev->x = (short)x;
+  ev->y = (short)y;
+  SPSC_BARRIER();  // i dati dello slot devono essere visibili prima dell'indice
+  track_events_head = head+1;
+}
+
+inline static void
+_publish_track_event(const int type, const tPersonTracked* const p)
+{
+  _publish_event(type, p->ID, p->x, p->y, p->h);
+}
+#else
+inline static void _publish_track_event(const int, const tPersonTracked* const) {}
+#endif
+
+
+/*!
+\brief Preleva un blob libero dal pool (sostituisce new tPersonTracked).
+*/
+static tPersonTracked*
+_new_track()
+{
+  if (track_free_num < 0)
+  {
+    for (int i=0; i<TRACK_POOL_DIM; ++i)
+      track_free_list[i] = TRACK_POOL_DIM-1-i;
+    track_free_num = TRACK_POOL_DIM;
+  }
+  assert(track_free_num > 0);
+  tPersonTracked* const track = &track_pool[track_free_list[--track_free_num]];
+  track->ID = ++track_id_counter;
+  track->counted = false;
+  return track;
+}
+
+
+/*!
+\brief Restituisce un blob al pool (sostituisce delete).
+*/
+static void
+_delete_track(tPersonTracked* const track)
+{
+  assert(track >= track_pool && track < track_pool+TRACK_POOL_DIM);
+  assert(track_free_num >= 0 && track_free_num < TRACK_POOL_DIM);
+  if (!track->counted)
+    _publish_track_event(TRACK_EV_LOST, track);
+  track_free_list[track_free_num++] = (int)(track-track_pool);
+}
+
+
+/*!
+\brief Incrementa il contatore degli ingressi (is_in) o delle uscite con il blob passato.
+*/
+inline static void
+_count_track(tPersonTracked* const track, const bool is_in, unsigned long & counter)
+{
+  counter++;
+  track->counted = true;
+#ifdef USE_TRACK_EVENTS
+  last_counted_id[is_in] = track->ID;
+  _publish_track_event(is_in ? TRACK_EV_COUNTED_IN : TRACK_EV_COUNTED_OUT, track);
+#endif
+}
+
 
 /*!
 \var people_count_input
@@ -91,6 +200,19 @@ unsigned long people_count_input;
 */
 unsigned long people_count_output;
 
+/*!
+\var tracking_frame_step
+\brief Frame acquisiti tra il frame elaborato precedente e quello corrente (1 se non ne vengono saltati, vedi #PROCESSING_DECIMATION).
+*/
+static int tracking_frame_step = 1;
+
+/*!
+\var tracking_pers_sing
+\brief Persone tracciabili per ogni sensore (#NUM_PERS_SING..#MAX_PERS_SING, vedi SetTrackingCapacity()).
+*/
+static int tracking_pers_sing = NUM_PERS_SING;
+static const int track_step_recip_q8[MAX_TRACKING_FRAME_STEP+1] = {0, 256, 128, 85, 64};  ///< 256/tracking_frame_step
+
 void draw_cross_on_map(tPersonTracked *person_data, unsigned char *map);
 int find_a_free_element_in_repo(tPersonTracked ** repo, const int person, const int num_pers);
 
@@ -288,7 +410,7 @@ _count_people(tPersonTracked** const & repo, const bool is_inhi,
       {
         if(repo[i]->trac==false)
         {
-          repo[i]->life = max(0, repo[i]->life-LIFE_DEC); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
+          repo[i]->life = max(0, repo[i]->life-LIFE_DEC*tracking_frame_step); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
 //          repo[i]->num_failures++;
 
           if(repo[i]->life<=0)
@@ -302,7 +424,7 @@ _count_people(tPersonTracked** const & repo, const bool is_inhi,
             if (_pers_to_be_counted(repo[i], is_inhi, door_threshold, min_y_gap))
             {
               if ((move_det_en == 0 || count_true_false == true) && count_enabled)
-                counter++;
+                _count_track(repo[i], is_inhi, counter);
 #ifdef _DEBUG
               if (!count_enabled)
                 printf("_count_people(): conteggio non fatto perch porte chiuse.\n");
@@ -321,7 +443,7 @@ _count_people(tPersonTracked** const & repo, const bool is_inhi,
 #endif
 
             // if life is zero we have to remove the blob from the repository
-            delete repo[i];
+            _delete_track(repo[i]);
             repo[i]=NULL;
           }
         }
@@ -617,7 +739,7 @@ _clear_repository(
 #ifdef _DEBUG
           //printf("\n Elimino il blob id: %u, perche' troppo vicino a quello virtuale!\n", blob_list[i]->ID);
 #endif
-          delete blob_list[i];
+          _delete_track(blob_list[i]);
           blob_list[i]=NULL;
         }
       }  // fine if blob_list[i]->ID != id_virtual_ray)
@@ -791,20 +913,20 @@ void clearpeople(unsigned long &trackin,unsigned long &trackout,
         {
             if(inhi[i]!=NULL)
             {
-                inhi[i]->life = max(0, inhi[i]->life-LIFE_DEC); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
+                inhi[i]->life = max(0, inhi[i]->life-LIFE_DEC*tracking_frame_step); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
 
                 //la persona viene contata se esce dall'altra parte della scena
                 //se ha fatto almeno PAS_MIN passi e se ha finito le vite
                 if(pers_to_be_counted(inhi[i], true, door_threshold, min_y_gap))
                 {
                     if(move_det_en == 0 || count_true_false == true) 
-                      people_count_input++;
+                      _count_track(inhi[i], true, people_count_input);
 
 #ifdef VERBOSE
                     printf("-> inhi:\n");
                     printf("--> blob_rep[%d]->ID = %ld [counted]\n\n", i, inhi[i]->ID);
 #endif
-                    delete inhi[i];
+                    _delete_track(inhi[i]);
                     inhi[i]=NULL;
                 }
                 //se non ha piu' vite eliminala
@@ -814,7 +936,7 @@ void clearpeople(unsigned long &trackin,unsigned long &trackout,
                     printf("-> inhi:\n");
                     printf("--> blob_rep[%d]->ID = %ld [removed]\n\n", i, inhi[i]->ID);
 #endif
-                    delete inhi[i];
+                    _delete_track(inhi[i]);
                     inhi[i]=NULL;
                 }
             }
@@ -823,7 +945,7 @@ void clearpeople(unsigned long &trackin,unsigned long &trackout,
         {
             if(inlo[i]!=NULL)
             {
-                inlo[i]->life = max(0, inlo[i]->life-LIFE_DEC); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
+                inlo[i]->life = max(0, inlo[i]->life-LIFE_DEC*tracking_frame_step); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
 
                 if(pers_to_be_counted(inlo[i], false, door_threshold, min_y_gap))
                 {
@@ -831,13 +953,13 @@ void clearpeople(unsigned long &trackin,unsigned long &trackout,
                     printf("Clearpeople: contato inlo h=%d x=%d y=%d life=%d\n",inlo[i]->h,inlo[i]->x,inlo[i]->y,inlo[i]->life);
 #endif
                     if(move_det_en == 0 || count_true_false == true) 
-                      people_count_output++;
+                      _count_track(inlo[i], false, people_count_output);
 #ifdef VERBOSE
                     printf("-> inlo:\n");
                     printf("--> blob_rep[%d]->ID = %ld [counted]\n\n", i, inlo[i]->ID);
 #endif
                     //delete [] inlo[i]; 
-                    delete inlo[i]; // 20120221 bugfix
+                    _delete_track(inlo[i]); // 20120221 bugfix
                     inlo[i]=NULL;
                 }
                 else if(inlo[i]->life<=0)
@@ -847,7 +969,7 @@ void clearpeople(unsigned long &trackin,unsigned long &trackout,
                     printf("--> blob_rep[%d]->ID = %ld [removed]\n\n", i, inlo[i]->ID);
 #endif
                     //delete [] inlo[i];
-                    delete inlo[i]; // 20120221 bugfix
+                    _delete_track(inlo[i]); // 20120221 bugfix
                     inlo[i]=NULL;
                 }
             }
@@ -859,10 +981,197 @@ void clearpeople(unsigned long &trackin,unsigned long &trackout,
 }
 
 
+/*!
+\brief Numero di frame acquisiti dall'ultimo frame elaborato: con frames > 1 il confronto tra blob dello storico
+       e persone rilevate viene fatto sulle posizioni predette con la velocita' stimata (vedi compute_cost_mat()).
+*/
+void SetTrackingFrameStep(const int frames)
+{
+    tracking_frame_step = max(1, min(MAX_TRACKING_FRAME_STEP, frames));
+#ifdef USE_TRACK_EVENTS
+    track_events_frame += frames;  // timestamp degli eventi: frame acquisiti, non solo quelli elaborati
+#endif
+}
+
+
+/*!
+\brief Imposta quante persone per sensore possono essere tracciate (parametro crowd_capacity).
+
+Le liste inhi e inlo restano dimensionate per #MAX_NUM_PERS. La nuova capacit&agrave; viene applicata solo 
+a scena vuota (storico senza blob): i blob in corso non vengono persi e i conteggi non hanno buchi. Fino ad 
+allora resta quella precedente e la funzione va richiamata (detectAndTrack() lo fa ad ogni frame elaborato).
+\return true se la capacit&agrave; &egrave; cambiata
+*/
+bool SetTrackingCapacity(const int pers_per_sensor)
+{
+    const int capacity = max(NUM_PERS_SING, min(MAX_PERS_SING, pers_per_sensor));
+    if (capacity == tracking_pers_sing || GetNumTrackedPeople(MAX_NUM_PERS) > 0)
+        return false;
+
+    tracking_pers_sing = capacity;
+    return true;
+}
+
+
+/*!
+\brief Persone tracciabili per ogni sensore con total_sys_number sensori in widegate:
+       la lunghezza delle liste (capacit&agrave; per numero di sensori) non supera #MAX_NUM_PERS.
+*/
+int GetTrackingCapacity(const unsigned char total_sys_number)
+{
+    return (total_sys_number < 2) ? tracking_pers_sing : min(tracking_pers_sing, MAX_NUM_PERS/total_sys_number);
+}
+
+
+/*! 
+\brief Numero di persone presenti nello storico (liste #inhi e #inlo).
+
+Usata dal main_loop() per capire se la scena &egrave; vuota (vedi USE_IDLE_GATING in directives.h).
+
+\param num_pers dimensione delle liste
+*/
+int GetNumTrackedPeople(const int & num_pers)
+{
+    int n = 0;
+    for(int i=0;i<num_pers;++i)
+    {
+        if(inhi!=NULL && inhi[i]!=NULL) n++;
+        if(inlo!=NULL && inlo[i]!=NULL) n++;
+    }
+    return n;
+}
+
+
+#ifdef USE_TRACK_EVENTS
+/*!
+\brief Sceglie quali eventi pubblicare (OR di TRACK_EV_MASK(); di default tutti).
+*/
+void SetTrackEventMask(const unsigned int mask)
+{
+    track_events_mask = mask;
+}
+
+
+/*!
+\brief Cursore dell'evento che verr&agrave; pubblicato per primo: un nuovo lettore parte da qui
+       (oppure da 0 per leggere anche gli eventi ancora presenti nel ring).
+*/
+unsigned long GetTrackEventHead(void)
+{
+    return track_events_head;
+}
+
+
+/*!
+\brief Copia in events fino a max_events eventi a partire da cursor, senza lock e senza rallentare il tracking.
+
+Pu&ograve; essere chiamata da qualsiasi thread e da pi&ugrave; lettori contemporaneamente, ognuno con il
+proprio cursore (inizializzato con GetTrackEventHead()). Gli eventi sovrascritti prima di essere letti
+vengono saltati e sommati in *lost.
+\return numero di eventi copiati (cursor viene avanzato anche degli eventi persi)
+*/
+int GetTrackEvents(unsigned long & cursor, tTrackEvent * const events, const int max_events,
+                   unsigned long * const lost)
+{
+    const unsigned long readable = TRACK_EVENTS_LEN-1;  // lo slot in scrittura non e' mai leggibile
+
+    unsigned long head = track_events_head;
+    SPSC_BARRIER();  // lettura dei dati dopo quella dell'indice
+    unsigned long behind = head - cursor;  // aritmetica modulo 2^32: corretta anche dopo il wrap
+    if (behind > readable)
+    {
+        if (lost) *lost += behind - readable;
+        cursor = head - readable;
+        behind = readable;
+    }
+
+    const int n = (int)min(behind, (unsigned long)max(0, max_events));
+    for (int k=0; k<n; ++k)
+        events[k] = track_events[(cursor+k) & (TRACK_EVENTS_LEN-1)];
+
+    // gli slot che il produttore ha riutilizzato durante la copia non sono validi
+    SPSC_BARRIER();
+    head = track_events_head;
+    behind = head - cursor;
+    int skip = 0;
+    if (behind > readable)
+        skip = (int)min(behind - readable, (unsigned long)n);
+
+    if (skip > 0)
+    {
+        if (lost) *lost += skip;
+        for (int k=skip; k<n; ++k)
+            events[k-skip] = events[k];
+    }
+    cursor += n;
+    return n-skip;
+}
+
+
+/*!
+\brief Segnala che CHECK_FALSE_COUNTS ha annullato l'ultimo conteggio in ingresso (is_in) o in uscita.
+*/
+void TrackEventCountDropped(const bool is_in)
+{
+    _publish_event(TRACK_EV_COUNT_DROPPED, last_counted_id[is_in], 0, 0, 0);
+}
+#endif
+
+
+/*!
+\brief Percentuale di tolleranza sull'altezza di un blob dello storico (vedi compute_cost_mat()) in funzione della 
+distanza orizzontale lrbdist dal bordo sinistro o destro del sensore (meno 12) e di quella verticale tbbdist dal 
+centro: massima al centro dell'immagine, dove la disparit&agrave; della testa &egrave; meno stabile.
+*/
+static int
+_h_diff_perc(const int lrbdist, const int tbbdist)
+{
+  const float lr = (float)lrbdist;
+  const float tb = (float)tbbdist;
+  return (int)(40.0f*exp(-(lr*lr/400.0f+tb*tb/800.0f))) + MIN_H_DIFF_PERC;
+}
+
+
+// oltre queste distanze 40*exp(...) < 1 e _h_diff_perc() vale MIN_H_DIFF_PERC (39^2/400 e 55^2/800 > ln(40))
+#define H_DIFF_LR_DIM 39
+#define H_DIFF_TB_DIM 55
+
+static unsigned char h_diff_perc_lut[H_DIFF_TB_DIM][H_DIFF_LR_DIM];  ///< _h_diff_perc() per le distanze entro le soglie
+static bool h_diff_perc_lut_ready = false;
+
+// tabella di _h_diff_perc(), costruita una sola volta da initpeople()
+static void
+_h_diff_perc_init(void)
+{
+  if (h_diff_perc_lut_ready)
+    return;
+
+  for (int t=0; t<H_DIFF_TB_DIM; ++t)
+    for (int d=0; d<H_DIFF_LR_DIM; ++d)
+      h_diff_perc_lut[t][d] = (unsigned char)_h_diff_perc(d, t);
+  assert(_h_diff_perc(H_DIFF_LR_DIM, 0) == MIN_H_DIFF_PERC && _h_diff_perc(0, H_DIFF_TB_DIM) == MIN_H_DIFF_PERC);
+  h_diff_perc_lut_ready = true;
+}
+
+// _h_diff_perc() del blob in posizione (x,y), anche fuori dal sensore master (widegate) 
+static inline int
+_h_diff_perc_lookup(const int x, const int y)
+{
+  const int lrbdist = abs(((x < NX/2) ? x : NX-x)-12);
+  const int tbbdist = abs(y - NY/2);
+  if (lrbdist >= H_DIFF_LR_DIM || tbbdist >= H_DIFF_TB_DIM)
+    return MIN_H_DIFF_PERC;
+
+  assert(h_diff_perc_lut_ready);
+  return h_diff_perc_lut[tbbdist][lrbdist];
+}
+
+
 /*! 
-\brief Allocazione delle liste di strutture dati di tipo tPersonTracked (inhi e inlo) in base
-       a configurazione (se normale #NUM_PERS_SING, se widegate allora #NUM_PERS_SING*#total_sys_number) e inizializzazione
+\brief Inizializzazione delle liste di strutture dati di tipo tPersonTracked (inhi e inlo) in base
+       a configurazione (capacit&agrave; per sensore, vedi GetTrackingCapacity(), per il numero di sensori) e
        dei contatori usati nel tracking #people_count_input e #people_count_output.
+       Le liste e i blob sono statici (dimensionati per #MAX_NUM_PERS), quindi non ci sono allocazioni.
 \param pi numero di passeggeri entrati
 \param po numero di passeggeri usciti
 \param total_sys_number total number of PCN used (if in widegate this is greater than one otherwise it is one)
@@ -874,45 +1183,24 @@ void initpeople(unsigned long pi,unsigned long po, unsigned char & total_sys_num
     people_count_output=po;
     
     if(total_sys_number==0) total_sys_number=1;
-    
-    if(inhi==NULL)
-    {
-        inhi = new tPersonTracked* [NUM_PERS_SING*total_sys_number];
-        num_pers=NUM_PERS_SING*total_sys_number;
-        for(int i=0;i<num_pers;i++)  inhi[i]=NULL;
-    }
-    if(inlo==NULL)
-    {
-        inlo = new tPersonTracked* [NUM_PERS_SING*total_sys_number];
-        num_pers=NUM_PERS_SING*total_sys_number;
-        for(int i=0;i<num_pers;i++)  inlo[i]=NULL;
-    }
-    if(total_sys_number!=num_pers/NUM_PERS_SING) // 20100623 eVS it was "num_pers/10"
-    {
-        delete [] inhi;
-        delete [] inlo;
-        inhi = new tPersonTracked* [NUM_PERS_SING*total_sys_number];
-        inlo = new tPersonTracked* [NUM_PERS_SING*total_sys_number];
-        num_pers=NUM_PERS_SING*total_sys_number;
-        for(int i=0;i<num_pers;i++)
-        {
-            inhi[i]=NULL;
-            inlo[i]=NULL;
-        }
-    }
-    if(inhi==NULL) inhi = new tPersonTracked* [num_pers];
-    if(inlo==NULL) inlo = new tPersonTracked* [num_pers];
 
-    for(int i=0;i<num_pers;i++)
+    // le liste hanno dimensione massima: basta svuotarle e restituire tutti i blob al pool
+    num_pers=GetTrackingCapacity(total_sys_number)*total_sys_number;
+    assert(num_pers <= MAX_NUM_PERS);
+    inhi = inhi_slots;
+    inlo = inlo_slots;
+    _h_diff_perc_init();
+    for(int i=0;i<MAX_NUM_PERS;i++)
     {
         inhi[i]=NULL;
         inlo[i]=NULL;
     }
+    track_free_num = -1;
 }
 
 
 /*! 
-\brief Deallocazione delle liste di strutture dati di tipo tPersonTracked (inhi e inlo).
+\brief Svuotamento delle liste di strutture dati di tipo tPersonTracked (inhi e inlo): i blob tornano al pool.
 */
 void deinitpeople(const int & num_pers)
 {
@@ -924,20 +1212,19 @@ void deinitpeople(const int & num_pers)
         if(inhi!=NULL)
             if(inhi[i]!=NULL) 
             {
-                delete inhi[i];
+                _delete_track(inhi[i]);
                 inhi[i]=NULL;	
             }
             if(inlo!=NULL)
                 if(inlo[i]!=NULL) 
                 {
-                    delete inlo[i];
+                    _delete_track(inlo[i]);
                     inlo[i]=NULL;
                 }
     }
-    if(inhi!=NULL) delete [] inhi;
     inhi=NULL;
-    if(inlo!=NULL) delete [] inlo;
     inlo=NULL;
+    track_free_num = -1;  // anche gli eventuali blob oltre num_pers (cambio di total_sys_number)
 }
 
 
@@ -969,7 +1256,7 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
                         inhi[i]->num_frames >= MIN_NUM_FRAMES)
                     {
                       if(move_det_en == 0 || count_true_false == true)
-                        people_count_input++;
+                        _count_track(inhi[i], true, people_count_input);
 
                       // move the person from inhi to inlo in this way they will be able to be counted on exit
                       int n = find_a_free_element_in_repo(inlo, 0, num_pers);
@@ -988,7 +1275,7 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
 #endif
                     }
                     else                  
-                      delete inhi[i];
+                      _delete_track(inhi[i]);
 
                     inhi[i]=NULL;
                   }
@@ -1003,7 +1290,7 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
                          inlo[i]->num_frames >= MIN_NUM_FRAMES)
                     {
                       if(move_det_en == 0 || count_true_false == true) 
-                        people_count_output++;
+                        _count_track(inlo[i], false, people_count_output);
                       
                       // move the person from inlo to inhi in this way they will be able to be counted on exit
                       int n = find_a_free_element_in_repo(inhi, 0, num_pers);
@@ -1022,7 +1309,7 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
 #endif
                     }
                     else                  
-                      delete inlo[i];
+                      _delete_track(inlo[i]);
 
                     inlo[i]=NULL;
                   }
@@ -1040,12 +1327,12 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
                        )
                     {
                         // if(move_det_en == 0 || count_true_false == true)  //20130515 eVS. After Heathrow problem remove this condition in order to enable count in door closed event
-                          people_count_input++;
+                          _count_track(inhi[i], true, people_count_input);
 #ifdef VERBOSE
                         printf("-> inhi:\n");
                         printf("--> blob_rep[%d]->ID = %ld [counted]\n\n", i, inhi[i]->ID);
 #endif
-                        delete inhi[i];
+                        _delete_track(inhi[i]);
                         inhi[i]=NULL;
                     }
                 }
@@ -1061,12 +1348,12 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
                       )
                     {
                       //  if(move_det_en == 0 || count_true_false == true)  //20130515 eVS.
-                          people_count_output++;
+                          _count_track(inlo[i], false, people_count_output);
 #ifdef VERBOSE
                         printf("-> inlo:\n");
                         printf("--> blob_rep[%d]->ID = %ld [counted]\n\n", i, inlo[i]->ID);
 #endif
-                        delete inlo[i];
+                        _delete_track(inlo[i]);
                         inlo[i]=NULL;
                     }
                 }
@@ -1083,14 +1370,24 @@ void CloseDoor(unsigned long & trackin,unsigned long & trackout,
 }
 
 
+// griglia grossolana delle persone rilevate: ogni blob dello storico esamina solo le celle entro il suo raggio di gating
+#define GATING_CELL_SHIFT 5
+const int GATING_GRID_COLS = ((NX*(MAX_NUM_PERS/NUM_PERS_SING)-1) >> GATING_CELL_SHIFT) + 1;
+const int GATING_GRID_ROWS = ((NY-1) >> GATING_CELL_SHIFT) + 1;
+
+static inline int
+_gating_cell(const int v, const int num_cells)
+{
+  return (v < 0) ? 0 : min(v >> GATING_CELL_SHIFT, num_cells-1);
+}
+
+
 void
 compute_cost_mat(tPersonTracked** blob_rep, const int blob_rep_len,
                  const int* people, const unsigned char* hpers, const unsigned char* dimpers, const int person,
                  bool *blob_rep_active, int &blob_rep_active_num, bool *person_active, int &person_active_num, const int xt,
                  unsigned int* const & cost_mat)
 {
-  const int fvlen = 5;
-
   // init output data
   for (int i=0; i<blob_rep_len*person; ++i)
     cost_mat[i] = MAX_COST;
@@ -1101,71 +1398,92 @@ compute_cost_mat(tPersonTracked** blob_rep, const int blob_rep_len,
 
   blob_rep_active_num = 0; // number of blobs in blob_rep that have a possible matching with a detected person
 
-  // check for possible correspondeces, i.e., two blobs at distance less than 30 pixels, and
+  // bucket the detected persons in the tracking-zone (counting sort on the grid cells)
+  static int pers_x[MAX_NUM_PERS], pers_y[MAX_NUM_PERS];
+  static int cell_first[GATING_GRID_ROWS*GATING_GRID_COLS+1];
+  static int cell_fill[GATING_GRID_ROWS*GATING_GRID_COLS];
+  static int cell_pers[MAX_NUM_PERS];
+  static int pers_cell[MAX_NUM_PERS];
+
+  const int grid_cols = min(GATING_GRID_COLS, ((xt-1) >> GATING_CELL_SHIFT) + 1);
+  const int grid_dim = GATING_GRID_ROWS*grid_cols;
+  for (int k=0; k<=grid_dim; ++k)
+    cell_first[k] = 0;
+  for (int p=0; p<person; ++p)
+  {
+    pers_cell[p] = -1;
+    if (hpers[p] > 0) // se la persona e' nella tracking-zone
+    {
+      pers_x[p] = people[p]%xt;
+      pers_y[p] = people[p]/xt;
+      pers_cell[p] = _gating_cell(pers_y[p], GATING_GRID_ROWS)*grid_cols + _gating_cell(pers_x[p], grid_cols);
+      cell_first[pers_cell[p]+1]++;
+    }
+  }
+  for (int k=0; k<grid_dim; ++k)
+  {
+    cell_first[k+1] += cell_first[k];
+    cell_fill[k] = cell_first[k];
+  }
+  for (int p=0; p<person; ++p)
+    if (pers_cell[p] >= 0)
+      cell_pers[cell_fill[pers_cell[p]]++] = p;
+
+  // check for possible correspondeces, i.e., two blobs at distance less than the head size, and
   // compute their cost
   for(int i=0;i<blob_rep_len;++i) //per tutte le persone nello storico
   {
     if (blob_rep[i] != NULL)
     {
-      int  feature_vect_in[fvlen]  = {blob_rep[i]->x, blob_rep[i]->y, blob_rep[i]->h, blob_rep[i]->wx, blob_rep[i]->wy};
+      // position predicted over the skipped frames (at full rate the gating radius already covers one frame of motion)
+      const int lookahead = tracking_frame_step-1;
+      const int rep_x = blob_rep[i]->x + (blob_rep[i]->vx*lookahead)/16;
+      const int rep_y = blob_rep[i]->y + (blob_rep[i]->vy*lookahead)/16;
+      const int rep_h = blob_rep[i]->h;
+      const int rep_max_h = blob_rep[i]->max_h;
       int  offset = i*person;
       int  current_num_possible_match = 0; // possible matches between blob_rep[i] and a detected person
 
-      for(int p=0;p<person;++p) //per ogni persona trovata in questo frame
-      {
-        if (hpers[p] > 0) // se la persona e' nella tracking-zone
-        {
-          // compute squared euclidean distance
-          int xy[2] = {people[p]%xt, people[p]/xt};
-          unsigned int eucl_dist2 = 0;
-          for (int j=0; j<2; ++j)
-          {
-            int diff =(xy[j] - feature_vect_in[j]);
-            eucl_dist2 += diff*diff;
-          }
-
-
-          //int max_h_diff = max(MAX_H_DIFF_MIN, (feature_vect_in[2]*MAX_H_DIFF_PERC)/100);
-          //int max_h_diff = 4*blob_rep[i]->std_h+MAX_H_DIFF_MIN;
-          //int diff_x_perc = abs(feature_vect_in[0] - NX/2)/3;
-          float lrbdist = ((feature_vect_in[0] < NX/2) ? feature_vect_in[0] : NX-feature_vect_in[0])-12;
-          float tbbdist = abs(feature_vect_in[1] - NY/2);
-          int diff_x_perc = (int)(40.0f*exp(-(lrbdist*lrbdist/400.0f+tbbdist*tbbdist/800.0f)));
-          //if (diff_x_perc > 25)
-          //  printf("Ops\n");
+      // the tolerances depend only on the blob in the repository
+      const int h_diff_perc = _h_diff_perc_lookup(rep_x, rep_y);
+      const int max_h_diff  = max(MAX_H_DIFF_MIN, (rep_h*h_diff_perc)/100);
+      const int max_mh_diff = max(MAX_H_DIFF_MIN, (rep_max_h*h_diff_perc)/100);
 
-          int max_h_diff  = max(MAX_H_DIFF_MIN, (blob_rep[i]->h*(diff_x_perc+MIN_H_DIFF_PERC))/100);
-          int max_mh_diff = max(MAX_H_DIFF_MIN, (blob_rep[i]->max_h*(diff_x_perc+MIN_H_DIFF_PERC))/100);
+      const int max_dist = (rep_max_h*2+FROM_DISP_TO_HEAD/2) / FROM_DISP_TO_HEAD; // this is a round instead of truncate
+      const int radius = abs(max_dist);
+      const unsigned int max_dist2 = (unsigned int)(max_dist*max_dist);
 
-          int diff_h = abs(hpers[p]-feature_vect_in[2]);
-          int diff_mh = abs(blob_rep[i]->max_h-hpers[p]); 
+      // a person outside the cells covering [x-max_dist,x+max_dist]x[y-max_dist,y+max_dist] is farther than max_dist
+      const int first_cell_c = _gating_cell(rep_x-radius, grid_cols);
+      const int last_cell_c  = _gating_cell(rep_x+radius, grid_cols);
+      const int first_cell_r = _gating_cell(rep_y-radius, GATING_GRID_ROWS);
+      const int last_cell_r  = _gating_cell(rep_y+radius, GATING_GRID_ROWS);
 
-          ////int max_wx_diff = max(MAX_WX_DIFF_MIN, ((2*feature_vect_in[3]+1)*MAX_WX_DIFF_PERC)/100);
-          //int max_wx_diff = (blob_rep[i]->is_bg) ? MAX_WX_DIFF_MIN : max(MAX_WX_DIFF_MIN, ((2*feature_vect_in[3]+1)*(diff_x_perc+MIN_WX_DIFF_PERC))/100);
-          //int diff_wx = 2*abs(dimpers[2*p]-feature_vect_in[3]);
+      for (int cr=first_cell_r; cr<=last_cell_r; ++cr)
+      {
+        const int row_offset = cr*grid_cols;
+        for (int k=cell_first[row_offset+first_cell_c]; k<cell_first[row_offset+last_cell_c+1]; ++k) //per ogni persona vicina trovata in questo frame
+        {
+          const int p = cell_pers[k];
 
-          ////int max_wy_diff = max(MAX_WY_DIFF_MIN, ((2*feature_vect_in[4]+1)*MAX_WY_DIFF_PERC)/100);
-          //int max_wy_diff = (blob_rep[i]->is_bg) ? MAX_WY_DIFF_MIN : max(MAX_WY_DIFF_MIN, ((2*feature_vect_in[4]+1)*(diff_x_perc+MIN_WY_DIFF_PERC))/100);
-          //int diff_wy = 2*abs(dimpers[2*p+1]-feature_vect_in[4]);
+          // compute squared euclidean distance
+          const int diff_x = pers_x[p] - rep_x;
+          const int diff_y = pers_y[p] - rep_y;
+          const unsigned int eucl_dist2 = diff_x*diff_x + diff_y*diff_y;
 
-          unsigned int max_dist2 = ((blob_rep[i]->max_h*2+FROM_DISP_TO_HEAD/2) / FROM_DISP_TO_HEAD); // this is a round instead of truncate
-          max_dist2 *= max_dist2;
+          const int diff_h = abs(hpers[p]-rep_h);
+          const int diff_mh = abs(rep_max_h-hpers[p]); 
 
           // check if correspondence is possible
-          if(//eucl_dist2 <= MAX_BLOB_DIST_SQUARED &&  // se e' vicina a quella nello storico
-             eucl_dist2 <= max_dist2 &&  // se e' vicina a quella nello storico
+          if(eucl_dist2 <= max_dist2 &&  // se e' vicina a quella nello storico
              diff_h <= max_h_diff && // se e' alta in modo simile a quella nello storico
-             //(blob_rep[i]->max_h-hpers[p]) <= (blob_rep[i]->max_h*MAX_H_DIFF_PERC/100) && // voglio evitare di traccare i piedi
-             diff_mh <= max_mh_diff) // && // voglio evitare di traccare i piedi
-             //diff_wx <= max_wx_diff && // se la sua testa e' larga in modo simile a quella nello storico
-             //diff_wy <= max_wy_diff) // se la sua testa e' alta in modo simile a quella nello storico
+             diff_mh <= max_mh_diff) // voglio evitare di traccare i piedi
           {
             person_active[p] = true;
             current_num_possible_match++;
 
             // compute final cost
-            //int dist = eucl_dist2 + diff_h*diff_h + diff_wx*diff_wx + diff_wy*diff_wy + (blob_rep[i]->is_bg ? eucl_dist2/10 : 0);
-            unsigned int dist = eucl_dist2 + diff_h*diff_h; // + (blob_rep[i]->is_bg ? eucl_dist2/20 : 0);
+            unsigned int dist = eucl_dist2 + diff_h*diff_h;
 
 #ifdef _DEBUG
             assert(dist <= INT_MAX); //aggiunti check per evitare overflow nel calcolo del costo
@@ -1206,81 +1524,31 @@ find_best_match(const unsigned int* const & cost_mat, const int rows, const int
 
   if (num_pers_active > 0 && num_rep_active > 0)
   {
-
-    static unsigned int cost_mat_sub[NUM_PERS_SING*(MAX_NUM_SLAVES+1)*NUM_PERS_SING*(MAX_NUM_SLAVES+1)];
-    static unsigned int cost_mat_r[NUM_PERS_SING*(MAX_NUM_SLAVES+1)*NUM_PERS_SING*(MAX_NUM_SLAVES+1)];
-    static unsigned int cost_mat_c[NUM_PERS_SING*(MAX_NUM_SLAVES+1)*NUM_PERS_SING*(MAX_NUM_SLAVES+1)];
-    
-    int subnrow = 0; 
-    int subncol = 0;
-
-    // hungarian implementation wants a square matrix
-    // if the matrix is not square we can just pad it with a
-    // added row or column filled with 0
-    int nelem = max(num_rep_active, num_pers_active);
-    for (int i=0; i<nelem*nelem; ++i)
-      cost_mat_sub[i] = MAX_COST;
-    if (num_rep_active != num_pers_active)
-    {
-      // if not square, pad with zeros where needed
-      if (num_rep_active > num_pers_active) // subrows > subcols
-      {
-        // pad columns
-        for (int r=0; r<nelem; ++r)
-          for (int c=num_pers_active; c<nelem; ++c)
-            cost_mat_sub[r*nelem+c] = 0;
-      }
-      else // subrows < subcols
-      {
-        // pad rows
-        for (int r=num_rep_active; r<nelem; ++r)
-          for (int c=0; c<nelem; ++c)
-            cost_mat_sub[r*nelem+c] = 0;
-      }
-    }
+    // only the pairs gated-in by compute_cost_mat() are passed to the solver: no padding to a
+    // square matrix, so the cost does not depend on num_pers (10 * total_sys_number in widegate)
+    static tAssignEdge edges[MAX_NUM_PERS*MAX_NUM_PERS];
+    int num_edges = 0;
 
     for (int r=0; r<rows; ++r) // iterate on the blobs in the repository
     {
       if (rep_active[r])
       {
         int offset = r*cols;
-        int suboffset = subnrow*nelem;
-
-        subncol = 0;
         for (int c=0; c<cols; ++c)
         {
-          if (pers_active[c])
+          if (pers_active[c] && cost_mat[offset+c] != MAX_COST)
           {
-            cost_mat_sub[suboffset+subncol] = cost_mat[offset+c];
-            cost_mat_r[suboffset+subncol] = r;
-            cost_mat_c[suboffset+subncol] = c;
-            subncol++;
+            edges[num_edges].row = r;
+            edges[num_edges].col = c;
+            edges[num_edges].cost = cost_mat[offset+c];
+            num_edges++;
           }
         }
-        subnrow++;
       }
     }
 
-    assert(subncol == num_pers_active);
-    assert(subnrow == num_rep_active);
-
-    static int M[NUM_PERS_SING*(MAX_NUM_SLAVES+1)*NUM_PERS_SING*(MAX_NUM_SLAVES+1)];
-    matching(cost_mat_sub, nelem, nelem, MAX_COST, M);
-
-    // fill with the matching results
-    for (int r=0; r<num_rep_active; ++r)
-    {
-      int offset = r*nelem;
-      for (int c=0; c<num_pers_active; ++c)
-      {
-        int idx_orig = cost_mat_r[offset+c]*cols + cost_mat_c[offset+c];
-
-        if ( (M[offset+c] == 1) && (cost_mat[idx_orig] != MAX_COST) )
-        {
-          best_match[cost_mat_r[offset+c]] = cost_mat_c[offset+c];
-        }
-      }
-    }
+    assert(num_edges > 0);
+    sparse_matching(edges, num_edges, rows, cols, best_match);
   }
 }
 
@@ -1299,7 +1567,7 @@ update_rep_data(tPersonTracked** blob_rep, int* best_match, const int num_pers,
       non_trovate[p] = false;
       blob_rep[i]->trac=true;
 
-      blob_rep[i]->life=min(blob_rep[i]->life+1, LIFE);
+      blob_rep[i]->life=min(blob_rep[i]->life+tracking_frame_step, LIFE);
 
       int px = (people[p]%xt);
       int py = (people[p]/xt);
@@ -1337,7 +1605,14 @@ update_rep_data(tPersonTracked** blob_rep, int* best_match, const int num_pers,
 
       blob_rep[i]->delta_y += (blob_rep[i]->y-prev_py); //blob_rep[i]->first_y);
 
-      blob_rep[i]->num_frames++;
+      // velocity per acquired frame (1/16 pixel), exponential mean of the displacements
+      const int step_recip = track_step_recip_q8[tracking_frame_step];
+      blob_rep[i]->vx = (blob_rep[i]->vx + ((blob_rep[i]->x-prev_px)*step_recip)/16)/2;
+      blob_rep[i]->vy = (blob_rep[i]->vy + ((blob_rep[i]->y-prev_py)*step_recip)/16)/2;
+
+      blob_rep[i]->num_frames += tracking_frame_step; // in frame acquisiti, anche con elaborazione decimata
+
+      _publish_track_event(TRACK_EV_MATCHED, blob_rep[i]);
     }
   }
 }
@@ -1520,23 +1795,25 @@ void track(const int *people,
     if(total_sys_number<2) 
     { 
         xt=160;
-        num_pers=NUM_PERS_SING;
+        num_pers=GetTrackingCapacity(total_sys_number);
     }
     else 
     {
         xt=160*total_sys_number;
-        num_pers=NUM_PERS_SING*total_sys_number;
+        num_pers=GetTrackingCapacity(total_sys_number)*total_sys_number;
     }
 
+    assert(num_pers <= MAX_NUM_PERS);
     if(inhi==NULL)
     {
-        inhi = new tPersonTracked* [num_pers];
-        for(int i=0;i<num_pers;++i)  inhi[i]=NULL;
+        inhi = inhi_slots;
+        for(int i=0;i<MAX_NUM_PERS;++i)  inhi[i]=NULL;
+        _h_diff_perc_init();  // se initpeople() non e' stata chiamata (es. main_batch)
     }
     if(inlo==NULL)
     {
-        inlo = new tPersonTracked* [num_pers];
-        for(int i=0;i<num_pers;++i)  inlo[i]=NULL;
+        inlo = inlo_slots;
+        for(int i=0;i<MAX_NUM_PERS;++i)  inlo[i]=NULL;
     }
 
 #ifdef debug_
@@ -1561,7 +1838,7 @@ void track(const int *people,
         if(inlo[i]!=NULL) inlo[i]->trac=false;
     }
 
-    bool * non_trovate = new bool [person];
+    static bool non_trovate[MAX_NUM_PERS];
     for (int r=0;r<person; r++) 
       non_trovate[r]=true;
 
@@ -1590,10 +1867,10 @@ void track(const int *people,
 #endif
 
     // static allocation at maximum size
-    static unsigned int  cost_mat_hi[NUM_PERS_SING*(MAX_NUM_SLAVES+1) * NUM_PERS_SING*(MAX_NUM_SLAVES+1)]; 
-    static int  best_match_hi[NUM_PERS_SING*(MAX_NUM_SLAVES+1)]; // 0..person<=NUM_PERS_SING*(MAX_NUM_SLAVES+1)
-    static bool inhi_active[NUM_PERS_SING*(MAX_NUM_SLAVES+1)];   // 0..num_pers<=NUM_PERS_SING*(MAX_NUM_SLAVES+1)
-    static bool pers_active_hi[NUM_PERS_SING*(MAX_NUM_SLAVES+1)];
+    static unsigned int  cost_mat_hi[MAX_NUM_PERS*MAX_NUM_PERS]; 
+    static int  best_match_hi[MAX_NUM_PERS]; // 0..person<=MAX_NUM_PERS
+    static bool inhi_active[MAX_NUM_PERS];   // 0..num_pers<=MAX_NUM_PERS
+    static bool pers_active_hi[MAX_NUM_PERS];
     int inhi_active_num, pers_active_hi_num;
 
     compute_cost_mat(inhi, num_pers,
@@ -1612,10 +1889,10 @@ void track(const int *people,
       best_match_hi);
 
     // static allocation at maximum size
-    static unsigned int  cost_mat_lo[NUM_PERS_SING*(MAX_NUM_SLAVES+1) * NUM_PERS_SING*(MAX_NUM_SLAVES+1)]; 
-    static int  best_match_lo[NUM_PERS_SING*(MAX_NUM_SLAVES+1)]; // 0..person<=NUM_PERS_SING*(MAX_NUM_SLAVES+1)
-    static bool inlo_active[NUM_PERS_SING*(MAX_NUM_SLAVES+1)]; // 0..num_pers<=NUM_PERS_SING*(MAX_NUM_SLAVES+1)
-    static bool pers_active_lo[NUM_PERS_SING*(MAX_NUM_SLAVES+1)];
+    static unsigned int  cost_mat_lo[MAX_NUM_PERS*MAX_NUM_PERS]; 
+    static int  best_match_lo[MAX_NUM_PERS]; // 0..person<=MAX_NUM_PERS
+    static bool inlo_active[MAX_NUM_PERS]; // 0..num_pers<=MAX_NUM_PERS
+    static bool pers_active_lo[MAX_NUM_PERS];
     int inlo_active_num, pers_active_lo_num;
 
     compute_cost_mat(inlo, num_pers,
@@ -1705,16 +1982,10 @@ void track(const int *people,
           if(n>=0 && n<num_pers)//controllo di puntare ad una zona corretta
           {
 
-            inhi[n]=new tPersonTracked;
+            inhi[n]=_new_track();
             inhi[n]->cont=false;
             inhi[n]->trac=true;
 
-#if defined(VERBOSE) || defined(_DEBUG)
-            static unsigned long blob_counter = 0;
-            inhi[n]->ID = blob_counter;
-            blob_counter++;
-#endif
-
 #ifdef VERBOSE
             inhi[n]->first_frame=num_frame;
 #endif
@@ -1730,6 +2001,8 @@ void track(const int *people,
 
             inhi[n]->x=px;
             inhi[n]->y=py;
+            inhi[n]->vx=0;
+            inhi[n]->vy=0;
 
             inhi[n]->first_x=px;
             if (door_threshold < NY) // se NON sono in fase di apertura o chiusura porta
@@ -1737,6 +2010,8 @@ void track(const int *people,
             else
               inhi[n]->first_y=0;
 
+            _publish_track_event(TRACK_EV_CREATED_HIGH, inhi[n]);
+
             //    printf("Inserita nuova inhi, y nascita %d\n",inhi[n]->first_y);
 #ifdef debug
             if(inhi[n]->x>xt) printf("Nuove pers: x=%d n=%d \n",inhi[n]->x,n);
@@ -1755,16 +2030,10 @@ void track(const int *people,
           if(n>=0 && n<num_pers)
           {
 
-            inlo[n]=new tPersonTracked;
+            inlo[n]=_new_track();
             inlo[n]->cont=false;
             inlo[n]->trac=true;
 
-#if defined(VERBOSE) || defined(_DEBUG)
-            static unsigned long blob_counter = 0;
-            inlo[n]->ID = blob_counter;
-            blob_counter++;
-#endif
-
 #ifdef VERBOSE
             inlo[n]->first_frame=num_frame;
 #endif
@@ -1780,12 +2049,16 @@ void track(const int *people,
             inlo[n]->wy=dimpers[2*t+1];
             inlo[n]->x=px;
             inlo[n]->y=py;
+            inlo[n]->vx=0;
+            inlo[n]->vy=0;
 
             inlo[n]->first_x=px;
             if (door_threshold > 0) // se NON sono in fase di apertura o chiusura porta
               inlo[n]->first_y=py;
             else
               inlo[n]->first_y=NY;
+
+            _publish_track_event(TRACK_EV_CREATED_LOW, inlo[n]);
             //      printf("Inserita nuova inlo, y nascita %d\n",inlo[n]->first_y);
 #ifdef debug
             if(inlo[n]->x>xt) printf("Nuove pers: x=%d n=%d \n",inlo[n]->x,n);
@@ -1833,7 +2106,10 @@ void track(const int *people,
       if(inhi[l]!=NULL)
       {
         if(inhi[l]->cont==false && inhi[l]->trac==true && inhi[l]->y > door_threshold+DELTA_DOOR_TH)
+        {
           inhi[l]->cont=true;
+          _publish_track_event(TRACK_EV_CROSSED, inhi[l]);
+        }
       }
     }
 
@@ -1842,7 +2118,10 @@ void track(const int *people,
       if(inlo[l]!=NULL)
       {
         if(inlo[l]->cont==false && inlo[l]->trac==true && inlo[l]->y < door_threshold-DELTA_DOOR_TH)
+        {
           inlo[l]->cont=true;
+          _publish_track_event(TRACK_EV_CROSSED, inlo[l]);
+        }
       }
     }
 
@@ -1854,7 +2133,7 @@ void track(const int *people,
       {
         if(inhi[i]->trac==false)
         {
-          inhi[i]->life = max(0, inhi[i]->life-LIFE_DEC); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
+          inhi[i]->life = max(0, inhi[i]->life-LIFE_DEC*tracking_frame_step); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
 
           if(inhi[i]->life<=0)
           {
@@ -1867,7 +2146,7 @@ void track(const int *people,
             if (pers_to_be_counted(inhi[i], true, door_threshold, min_y_gap))
             {
               if(move_det_en == 0 || count_true_false == true)
-                people_count_input++;
+                _count_track(inhi[i], true, people_count_input);
 #ifndef VERBOSE
             }
 #else
@@ -1882,7 +2161,7 @@ void track(const int *people,
 #endif
 
             // if life is zero we have to remove the blob from the repository
-            delete inhi[i];
+            _delete_track(inhi[i]);
             inhi[i]=NULL;
           }
         }
@@ -1895,7 +2174,7 @@ void track(const int *people,
       {
         if(inlo[i]->trac==false)
         {
-          inlo[i]->life = max(0, inlo[i]->life-LIFE_DEC); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
+          inlo[i]->life = max(0, inlo[i]->life-LIFE_DEC*tracking_frame_step); //se la persona nello storico non e' stata traccata diminuisci di due le sue vite
 
           if(inlo[i]->life<=0)
           {
@@ -1905,7 +2184,7 @@ void track(const int *people,
             if(pers_to_be_counted(inlo[i], false, door_threshold, min_y_gap))
             {
               if(move_det_en == 0 || count_true_false == true) 
-                people_count_output++;
+                _count_track(inlo[i], false, people_count_output);
 #ifndef VERBOSE
             }
 #else
@@ -1919,7 +2198,7 @@ void track(const int *people,
             }
 #endif
 
-            delete inlo[i];
+            _delete_track(inlo[i]);
             inlo[i]=NULL;
           }
         }
@@ -1952,7 +2231,6 @@ void track(const int *people,
     trackin = people_count_input;
     trackout = people_count_output;
 
-    delete [] non_trovate;
 
     return;
 
@@ -2213,4 +2491,110 @@ void draw_cross_on_map(tPersonTracked *person_data, unsigned char *map)
       }
     }
 }
+
+
+#ifdef CROWD_BENCHMARK
+/*!
+\brief Tempo di track() per frame con scene affollate (vedi #crowd_capacity).
+
+Per ogni configurazione (capacit&agrave; per sensore e numero di sensori) simula frames frame con corsie
+di persone che attraversano la soglia porta in entrambi i versi, fino a riempire la capacit&agrave;,
+e stampa il tempo medio e massimo per frame e i conteggi ottenuti rispetto agli attraversamenti simulati.
+
+Finora misurata solo sull'host (x86, -O2; track() medio per frame): 10 persone 8 us, 20 persone 25 us, 
+40 persone 88 us, 40+40 persone 310 us; con 40 persone si contano circa la met&agrave; degli attraversamenti 
+simulati. Non esistono misure sul target, quindi il requisito di 40 persone per sensore entro i 18 ms del 
+frame non &egrave; verificato: va eseguita sul target prima di usare #crowd_capacity sopra #NUM_PERS_SING.
+\return 0
+*/
+int crowd_benchmark(const int frames)
+{
+  static unsigned char disparity_map[NN];
+  static int people[MAX_NUM_PERS];
+  static unsigned char hpers[MAX_NUM_PERS];
+  static unsigned char dimpers[2*MAX_NUM_PERS];
+  static int lane_y[MAX_NUM_PERS][2];   // righe delle (al piu') due persone in ogni corsia, -1 se libere
+  static unsigned char lane_h[MAX_NUM_PERS][2];
+  const int configs[4][2] = {{NUM_PERS_SING, 1}, {2*NUM_PERS_SING, 1}, {MAX_PERS_SING, 1}, {MAX_PERS_SING, 2}};
+  const unsigned short door = NY/2;
+
+  srand(1);
+  for (int k=0; k<4; ++k)
+  {
+    unsigned char total_sys_number = (unsigned char)configs[k][1];
+    int num_pers;
+    int xt;
+    SetTrackingCapacity(configs[k][0]);
+    initpeople(0, 0, total_sys_number, num_pers);
+
+    const int width = NX*total_sys_number;
+    const int num_lanes = num_pers/2;
+    const int lane_w = width/num_lanes;
+    for (int l=0; l<num_lanes; ++l)
+      lane_y[l][0] = lane_y[l][1] = -1;
+
+    unsigned long trackin = 0, trackout = 0;
+    unsigned long expected = 0;
+    clock_t tot_ticks = 0, max_ticks = 0;
+    int max_people = 0;
+    for (int f=0; f<frames; ++f)
+    {
+      int person = 0;
+      for (int l=0; l<num_lanes; ++l)
+      {
+        const int dy = (l & 1) ? -2 : 2;  // corsie alternate in entrata e in uscita
+        for (int j=0; j<2; ++j)
+        {
+          int & y = lane_y[l][j];
+          if (y < 0)
+          {
+            // nuova persona se l'altra della corsia e' gia' lontana dal bordo
+            const int other = lane_y[l][1-j];
+            const bool lane_free = (other < 0) || ((dy > 0) ? (other > NY/2) : (other < NY/2));
+            if (lane_free && (rand() & 7) == 0)
+            {
+              y = (dy > 0) ? 0 : NY-1;
+              lane_h[l][j] = (unsigned char)(80 + rand()%60);
+            }
+            continue;
+          }
+          const int prev_y = y;
+          y += dy;
+          if ((prev_y < door) != (y < door))
+            ++expected;
+          if (y < 0 || y >= NY)
+          {
+            y = -1;
+            continue;
+          }
+          if ((rand() & 15) == 0)
+            continue;  // detection mancata
+          const int x = l*lane_w + lane_w/2 + (rand()%3) - 1;
+          people[person] = y*width + x;
+          hpers[person] = (unsigned char)(lane_h[l][j] + (rand()%5) - 2);
+          dimpers[2*person] = dimpers[2*person+1] = (unsigned char)min(10, lane_w/2);
+          ++person;
+        }
+      }
+      max_people = max(max_people, person);
+
+      const clock_t start = clock();
+      track(people, person, disparity_map, dimpers, hpers, trackin, trackout,
+        0, 0, door, total_sys_number, total_sys_number, 0, 0, true, num_pers, xt, 0);
+      const clock_t ticks = clock()-start;
+      tot_ticks += ticks;
+      max_ticks = max(max_ticks, ticks);
+    }
+
+    printf("crowd_benchmark(): %d sensori x %d persone (max %d in scena): track() medio %.1f us, max %.1f us; "
+      "contati %lu su %lu attraversamenti\n",
+      (int)total_sys_number, num_pers/total_sys_number, max_people,
+      1e6*tot_ticks/((double)CLOCKS_PER_SEC*frames), 1e6*max_ticks/(double)CLOCKS_PER_SEC,
+      trackin+trackout, expected);
+    deinitpeople(MAX_NUM_PERS);
+  }
+  SetTrackingCapacity(NUM_PERS_SING);
+  return 0;
+}
+#endif
 #endif
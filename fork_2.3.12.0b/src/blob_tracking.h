@@ -4,6 +4,7 @@
 #include "directives.h"
 #ifdef USE_NEW_TRACKING
 
+#include <stddef.h>
 #include "peopledetection.h"
 
 #define DELTA_DOOR_TH 9  // > 3 since the detection has an error of 3 pixels because of binning
@@ -25,10 +26,11 @@ typedef struct
   int y;                  //!< riga del centroide
   unsigned char first_y;  //!< memorizza la riga in cui compare la persona per la prima volta
   unsigned char first_x;  //!< memorizza la colonna in cui compare la persona per la prima volta
+  int vx;                 //!< velocita' stimata lungo x (1/16 di pixel per frame acquisito)
+  int vy;                 //!< velocita' stimata lungo y (1/16 di pixel per frame acquisito)
 
-#if defined(_DEBUG) || defined(VERBOSE)
-  unsigned long ID;
-#endif
+  unsigned long ID;       //!< identificativo univoco del blob (assegnato alla creazione)
+  bool counted;           //!< true se il blob ha gia' incrementato uno dei contatori
 
 #ifdef VERBOSE
   unsigned long first_frame;
@@ -55,6 +57,60 @@ void track(const int *people,
            int &xt,
            const int &min_y_gap);
 
+#define MAX_TRACKING_FRAME_STEP 4  //!< massimo numero di frame acquisiti tra due frame elaborati compensato dalla predizione
+
+void SetTrackingFrameStep(const int frames);
+
+bool SetTrackingCapacity(const int pers_per_sensor);
+int GetTrackingCapacity(const unsigned char total_sys_number);
+int GetNumTrackedPeople(const int & num_pers);
+
+#ifdef CROWD_BENCHMARK
+int crowd_benchmark(const int frames);
+#endif
+
+#ifdef USE_TRACK_EVENTS
+/*!
+\enum tTrackEventType
+\brief Eventi del ciclo di vita di un blob tracciato (vedi GetTrackEvents()).
+*/
+enum tTrackEventType
+{
+  TRACK_EV_CREATED_HIGH = 0,  ///< nuovo blob sopra la soglia porta (lista inhi)
+  TRACK_EV_CREATED_LOW,       ///< nuovo blob sotto la soglia porta (lista inlo)
+  TRACK_EV_MATCHED,           ///< blob associato a una persona rilevata nel frame
+  TRACK_EV_CROSSED,           ///< il blob ha superato la soglia porta (diventa contabile)
+  TRACK_EV_COUNTED_IN,        ///< il blob ha incrementato il contatore degli ingressi
+  TRACK_EV_COUNTED_OUT,       ///< il blob ha incrementato il contatore delle uscite
+  TRACK_EV_LOST,              ///< blob rimosso dallo storico senza essere contato
+  TRACK_EV_COUNT_DROPPED,     ///< conteggio annullato da CHECK_FALSE_COUNTS (ID dell'ultimo blob contato in quella direzione)
+  TRACK_EV_NUM_TYPES
+};
+
+/*!
+\struct tTrackEvent
+\brief Evento pubblicato dal tracking.
+*/
+typedef struct
+{
+  unsigned long frame;     ///< frame acquisito in cui e' avvenuto l'evento (contatore monotono)
+  unsigned long track_id;  ///< tPersonTracked::ID del blob
+  unsigned char type;      ///< tTrackEventType
+  unsigned char h;         ///< altezza (disparita') del blob
+  short x;                 ///< colonna del centroide
+  short y;                 ///< riga del centroide
+} tTrackEvent;
+
+#define TRACK_EVENTS_LEN 512  //!< slot del ring degli eventi (potenza di 2): ne restano leggibili TRACK_EVENTS_LEN-1
+
+#define TRACK_EV_MASK(type) (1u << (type))
+void SetTrackEventMask(const unsigned int mask);
+unsigned long GetTrackEventHead(void);
+int GetTrackEvents(unsigned long & cursor, tTrackEvent * const events, const int max_events,
+                   unsigned long * const lost = NULL);
+void TrackEventCountDropped(const bool is_in);
+#endif
+
 void initpeople(unsigned long pi,unsigned long po,
                 unsigned char & total_sys_number, int & num_pers);
 
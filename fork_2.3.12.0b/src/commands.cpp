@@ -35,6 +35,26 @@ extern unsigned char Frame_SX[NN];   //!< Immagine sinistra a 256 livelli di gri
 extern unsigned char Frame_DSP[NN];  //!< Mappa di disparit&agrave; #NX*#NY=160*120 (16 livelli di disparit&agrave; distribuiti su 256 livelli di grigio).
 
 
+/*!
+\brief Lettura di un blocco dati #NX*#NY*4=160*120*4=320*240 dall'FPGA da parte di un comando.
+
+La lettura avviene sotto #acq_dev_lock, cos&igrave; non si sovrappone a quelle di acquisition_loop() 
+(i comandi che non fermano il main_loop() girano in parallelo al thread di acquisizione).
+\param dest buffer di #imagesize bytes
+*/
+static void read_frame(unsigned char *dest)
+{
+    pthread_mutex_lock(&acq_dev_lock);
+    read(pxa_qcp,dest,imagesize);
+    pthread_mutex_unlock(&acq_dev_lock);
+}
+
+/*!
+\brief Frame decodificato dai comandi che girano mentre il main_loop() elabora ("saveimg" e "recimg"): 
+non tocca #Frame_DSP, #Frame_SX e #Frame_DX, che restano del main_loop().
+*/
+static tDecodedFrame cmd_frame;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 void _enable_out_of_range_handle( bool state)
 {
@@ -56,14 +76,14 @@ _is_background_reliable_for_out_of_range_handle()
   i2cstruct.reg_value = MUX_MODE_8_FPN_ODC_MEDIAN_DISP;
   ioctl(pxa_qcp, VIDIOCSI2C, &i2cstruct);
   for (int i=0; i<5; ++i)
-    read(pxa_qcp, Frame, imagesize);	// the first image is dirty (just read more than once to be sure)
+    read_frame(Frame);	// the first image is dirty (just read more than once to be sure)
 
   // verify background  
   bool is_backgroung_reliable;
   int num_unrealiable_pixels = 0; 
   int num_processed_frames = 0;
   do {
-    read(pxa_qcp, Frame, imagesize); 
+    read_frame(Frame); 
     get_images(Frame,0);    
     num_unrealiable_pixels = OutOfRangeManager::getInstance().CountBlackPixels(Frame_DSP);
     num_processed_frames++;
@@ -447,7 +467,7 @@ int Communication(int fd,char *buffer)
             i2cstruct.reg_value = MUX_MODE_8_FPN_ODC_MEDIAN_DISP;
             ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
-            read(pxa_qcp,Frame,imagesize);	// the first image is dirty
+            read_frame(Frame);	// the first image is dirty
             
             //memset(svec,0,sizeof(int)*NN); // eVS 20100419 meglio aumentare il valore iniziale
             for(int h=NN-1;h>=0;h--) 
@@ -498,7 +518,7 @@ int Communication(int fd,char *buffer)
             }
             a = 15;
             b = 16;
-            read(pxa_qcp,Frame,imagesize); 
+            read_frame(Frame); 
 
             get_images(Frame,0);    
             for(y=0;y<NY;y++)for(x=0;x<NX;x++)
@@ -563,13 +583,10 @@ int Communication(int fd,char *buffer)
                 flag_serial=0;
                 SNP_Send(slave_id,buffer,NULL,0,ttyS1);   
             }	  
-            FILE *out = fopen(bg_filename,"wb");
-            fwrite(Bkgvec,sizeof(Bkgvec),1,out);
-            fwrite(svec,sizeof(svec),1,out);
-            fwrite(&vm_img,sizeof(vm_img),1,out); //save the mean value of image in background file
-            vm_bkg=vm_img; 
-            fclose(out);    		
+            vm_bkg=vm_img; //save the mean value of image in background file
+            WriteBkg();
             memcpy(Bkgvectmp,Bkgvec,NN);
+            UpdateBkgThreshold();
 
             i2cstruct.reg_addr =  MUX_MODE;
             i2cstruct.reg_value = acq_mode & 0x00FF;
@@ -634,7 +651,7 @@ int Communication(int fd,char *buffer)
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
         for(i=0;i<10;i++)  
-            read(pxa_qcp,Frame,imagesize);
+            read_frame(Frame);
 
         get_images(Frame,0);
         int tmp=0;
@@ -650,7 +667,7 @@ int Communication(int fd,char *buffer)
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
         for(i=0;i<10;i++)  
-            read(pxa_qcp,Frame,imagesize);
+            read_frame(Frame);
 
 
         get_images(Frame,0);
@@ -695,7 +712,7 @@ int Communication(int fd,char *buffer)
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
         for(i=0;i<20;i++)  
-            read(pxa_qcp,Frame,imagesize); 
+            read_frame(Frame); 
 
         //   get_10bit_image(Frame10_SX,Frame); 
         get_images(Frame,0);
@@ -710,7 +727,7 @@ int Communication(int fd,char *buffer)
         i2cstruct.reg_value = MUX_MODE_10_NOFPN_DX;
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct); 
         for(i=0;i<10;i++)  
-            read(pxa_qcp,Frame,imagesize);
+            read_frame(Frame);
 
         get_images(Frame,0);
         tmp=0;
@@ -782,7 +799,9 @@ int Communication(int fd,char *buffer)
         acq_mode = loc_acq_mode; // 20120711 eVS, added instead of Recv which was moved before lock
         i2cstruct.reg_addr =  MUX_MODE;
         i2cstruct.reg_value = acq_mode & 0x00FF;
+        pthread_mutex_lock(&acq_dev_lock); // non durante una lettura di acquisition_loop()
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
+        pthread_mutex_unlock(&acq_dev_lock);
         pthread_mutex_unlock(&acq_mode_lock); // 20100517 eVS
 
         return 0;
@@ -1616,8 +1635,8 @@ int Communication(int fd,char *buffer)
         i2cstruct.reg_value = MUX_MODE_8_FPN;
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
-        read(pxa_qcp,Frame,imagesize);	// the first image is dirty
-        read(pxa_qcp,Frame,imagesize);
+        read_frame(Frame);	// the first image is dirty
+        read_frame(Frame);
         get_images(Frame,0);
         Send(fd,(char *)Frame_DX,NN*sizeof(char));
         Send(fd,(char *)Frame_SX,NN*sizeof(char));
@@ -1790,7 +1809,7 @@ int Communication(int fd,char *buffer)
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
         for(int i=0; i<10;i++)
-            read(pxa_qcp,Frame,imagesize);
+            read_frame(Frame);
 
         get_10bit_image(Frame10_SX,Frame); 
 
@@ -1799,7 +1818,7 @@ int Communication(int fd,char *buffer)
         ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct); 
 
         for(int i=0; i<10;i++)
-            read(pxa_qcp,Frame,imagesize);
+            read_frame(Frame);
 
         get_10bit_image(Frame10_DX,Frame);
 
@@ -1946,13 +1965,13 @@ int Communication(int fd,char *buffer)
     if(strcmp(buffer,"saveimg")==0)
     {
         pthread_mutex_lock(&rdlock);
-        read(pxa_qcp,Frame,imagesize);
-        get_images(Frame,0); 
+        read_frame(Frame);
+        decode_frame(Frame,false,&cmd_frame); // piani privati: il main_loop() puo' star elaborando i suoi
         int door_th=get_parms("threshold");
-        for(int i=0;i<NX;i++) Frame_SX[NX*door_th+i]=255;
-        Send(fd,(char *)Frame_DX,NN*sizeof(char));
-        Send(fd,(char *)Frame_SX,NN*sizeof(char));
-        Send(fd,(char *)Frame_DSP,NN*sizeof(char));
+        for(int i=0;i<NX;i++) cmd_frame.sx[NX*door_th+i]=255;
+        Send(fd,(char *)cmd_frame.dx,NN*sizeof(char));
+        Send(fd,(char *)cmd_frame.sx,NN*sizeof(char));
+        Send(fd,(char *)cmd_frame.dsp,NN*sizeof(char));
         Send(fd,(char *)Bkgvec,NN*sizeof(char));
 
         pthread_mutex_unlock(&rdlock);
@@ -2263,7 +2282,7 @@ int Communication(int fd,char *buffer)
       i2cstruct.reg_value = MUX_MODE_8_FPN_ODC_MEDIAN_DISP;
       ioctl(pxa_qcp, VIDIOCSI2C, &i2cstruct);
       for (int i=0; i<5; ++i)
-        read(pxa_qcp, Frame, imagesize);	// the first image is dirty (just read more than once to be sure)
+        read_frame(Frame);	// the first image is dirty (just read more than once to be sure)
       
       int num_grab_per_packet = ru_start_record(pxa_qcp, fd, strcmp(buffer,"start_rec_dsp")==0);
       
@@ -2320,8 +2339,8 @@ int Communication(int fd,char *buffer)
         {
           printf("recimg: read and send data.\n"); 
           
-          read(pxa_qcp,Frame,imagesize);
-          get_images(Frame,0); 
+          read_frame(Frame);
+          decode_frame(Frame,false,&cmd_frame); // piani privati: il main_loop() puo' star elaborando i suoi
         
           /*if(acq_mode & 0x0100)	//tracking
           {
@@ -2346,9 +2365,9 @@ int Communication(int fd,char *buffer)
         
           
           {
-            Send(fd,(char *)Frame_DX,NN*sizeof(char));
-            Send(fd,(char *)Frame_SX,NN*sizeof(char));
-            Send(fd,(char *)Frame_DSP,NN*sizeof(char));    
+            Send(fd,(char *)cmd_frame.dx,NN*sizeof(char));
+            Send(fd,(char *)cmd_frame.sx,NN*sizeof(char));
+            Send(fd,(char *)cmd_frame.dsp,NN*sizeof(char));    
             Send(fd,(unsigned long*)&people_rec[0], sizeof(people_rec[0]));
             Send(fd,(unsigned long*)&people_rec[1], sizeof(people_rec[1]));
             unsigned char testin_val = input_test0;
@@ -2465,18 +2484,12 @@ int Communication(int fd,char *buffer)
         }
         else
         {
-          FILE *in;
-          if((in = fopen(bg_filename,"rb")))
-          {
-              fread(Bkgvec,sizeof(Bkgvec),1,in);
-              fread(svec,sizeof(svec),1,in);
-              fread(&vm_bkg,sizeof(vm_bkg),1,in);
-              fclose(in);
-          }
+          LoadBkg();
         }
         
         // copio il background caricato nella variabile usata per l'auto background
         memcpy(Bkgvectmp,Bkgvec,NN);
+        UpdateBkgThreshold();
         pthread_mutex_unlock(&acq_mode_lock); 
         
         return 0;
@@ -2487,27 +2500,18 @@ int Communication(int fd,char *buffer)
       memset(Bkgvec,0,sizeof(Bkgvec));
       memset(svec,0,sizeof(svec));
       //vm_bkg = 0;    
+      UpdateBkgThreshold();
       pthread_mutex_unlock(&acq_mode_lock); 
        
       // copio il background azzerato nella variabile usata per l'auto background
       //memcpy(Bkgvectmp,Bkgvec,NN);
 
       pthread_mutex_lock(&rdlock); 
-      char command[255];       
-      sprintf(command,"rm -rf %s",bg_filename);
-      system(command); // deleting background file to avoid to load it at next boot
-      
       // 20130122 eVS, instead of only remove background file we save an empty 
       // background in order to be compatible with the recording procedure 
       // which uses ftp to save the background
-      FILE *out;
-      if((out = fopen(bg_filename,"wb")))
-      {
-        fwrite(Bkgvec,sizeof(Bkgvec),1,out);
-        fwrite(svec,sizeof(svec),1,out);
-        fwrite(&vm_bkg,sizeof(vm_bkg),1,out);
-        fclose(out);
-      }
+      // (the empty background atomically replaces the old file, see WriteBkg())
+      WriteBkg();
       pthread_mutex_unlock(&rdlock);
       return 0;      
     }
@@ -2572,7 +2576,7 @@ int Communication(int fd,char *buffer)
       ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
 
       for(i=0;i<20;i++)  
-        read(pxa_qcp,Frame,imagesize); 
+        read_frame(Frame); 
       get_images(Frame,0);
       int tmp=0;
       for(int ind=0;ind<NX*NY;ind++)
@@ -2585,7 +2589,7 @@ int Communication(int fd,char *buffer)
       i2cstruct.reg_value = MUX_MODE_10_NOFPN_DX;
       ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct); 
       for(i=0;i<10;i++)  
-        read(pxa_qcp,Frame,imagesize);
+        read_frame(Frame);
 
       get_images(Frame,0);
       tmp=0;
@@ -2899,6 +2903,47 @@ int Communication(int fd,char *buffer)
         save_parms("handle_oor",(unsigned short)value);
         return 0;    
     }
+
+    /*!
+    \code
+    // Command to change the number of people tracked by each sensor
+    // (from NUM_PERS_SING to MAX_PERS_SING, values out of range are clamped)
+    if(strcmp(buffer,"crowd_capacity")==0)
+    {
+        //...
+    \endcode
+    */
+    if(strcmp(buffer,"crowd_capacity")==0)
+    {
+        unsigned char value;
+        Recv(fd,(char *)&value,sizeof(value));
+        
+        // permesso anche in widegate: solo il master (che fa il tracking) usa il valore, 
+        // gli slave trasmettono comunque al piu' NUM_PERS_SING persone (il range e' forzato da SetTrackingCapacity())
+        write_parms("crowd_capacity",(unsigned short)value);
+        save_parms("crowd_capacity",(unsigned short)value);
+        return 0;    
+    }
+
+    /*!
+    \code
+    // Command to process one frame every value (from 1 to MAX_PROCESSING_DECIMATION, 
+    // values out of range are clamped): halves the load of busy sensors with value 2
+    if(strcmp(buffer,"processing_decimation")==0)
+    {
+        //...
+    \endcode
+    */
+    if(strcmp(buffer,"processing_decimation")==0)
+    {
+        unsigned char value;
+        Recv(fd,(char *)&value,sizeof(value));
+        
+        // permesso anche in widegate: gli slave elaborano comunque tutti i frame (vedi detectAndTrack())
+        write_parms("processing_decimation",(unsigned short)value);
+        save_parms("processing_decimation",(unsigned short)value);
+        return 0;    
+    }
     
     return -1;
 }
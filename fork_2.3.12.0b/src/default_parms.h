@@ -507,6 +507,11 @@ const unsigned char STEPS_240[16]={0,0,1,2,3,4,5,6,7,8,9,10,12,14,17,20};
 //eVS 20130715
 #define HANDLE_OOR 0 // To handle the OOR situation after reboot
 
+#define CROWD_CAPACITY NUM_PERS_SING // Persons detected and tracked by each sensor (NUM_PERS_SING..MAX_PERS_SING)
+
+#define PROCESSING_DECIMATION 1 // detectAndTrack() processes one frame every PROCESSING_DECIMATION (1..MAX_PROCESSING_DECIMATION)
+#define MAX_PROCESSING_DECIMATION 3 // skipped frames compensated by the tracking with the estimated velocity of the blobs
+
 // eVS 20100419
 #define INITIAL_STD_BKG 10 //!< Serve per inizializzare la deviazione standard del background al posto dello zero
 
@@ -523,10 +528,13 @@ const float FROM_DISP_TO_SHOULDER = 1.33f; // shoulder_px = (disp/16)*(60cm/5cm)
 const float FROM_DISP_TO_SHOULDER_RAY = FROM_DISP_TO_SHOULDER*2.0f; 
 
 // 20130220 eVS, moved here both NUM_PERS_SING and MAX_NUM_SLAVES
-#define NUM_PERS_SING 10  //!< maximum number of person detectable for each sensor
+#define NUM_PERS_SING 10  //!< maximum number of person detectable for each sensor (default of crowd_capacity and persons in a widegate packet)
 const int MAX_NUM_SLAVES = 5;  //!< Maximum number of slaves connected to a master in widegate
 
+const int MAX_PERS_SING = 40;  //!< Maximum value of crowd_capacity, i.e., of the persons detected and tracked by each sensor (timing not verified on the target, see crowd_benchmark())
+
 // 20130220 eVS, added
-const int MAX_NUM_PERS = NUM_PERS_SING*(MAX_NUM_SLAVES+1);  //!< Maximum number of slaves connected to a master in widegate
+//! Maximum number of persons tracked by the master: all the sensors at NUM_PERS_SING or a widegate pair at MAX_PERS_SING
+const int MAX_NUM_PERS = (NUM_PERS_SING*(MAX_NUM_SLAVES+1) > 2*MAX_PERS_SING) ? NUM_PERS_SING*(MAX_NUM_SLAVES+1) : 2*MAX_PERS_SING;
 
 #endif
@@ -19,6 +19,7 @@
 #define USE_SOLVE_CONFLICTS  // gestisci il conflitto tra inhi e inlo su uno stesso blob (vince costo minimo o piu' vicino)
 #define USE_CONSISTENCY_CHECK  // gestisce conflitti tra blob nello storico (che possono esserci a causa delle vite)
 #define USE_HANDLE_OUT_OF_RANGE  // abilita la gestione dell'out-of-range
+#define USE_TRACK_EVENTS  // il tracking pubblica gli eventi dei blob (creazione, conteggio, perdita...) in un ring lock-free (vedi GetTrackEvents())
 #  ifdef USE_HANDLE_OUT_OF_RANGE
 #  define USE_BINNING_IN_BLACK_PIXEL_COUNTING  // il conteggio dei pixel neri non viene fatto scandendo tutti i pixel ma a salti di 2 o 3 a seconda della dimensione del blob virtuale
 #  define CHECK_FALSE_COUNTS  // evita pi di TOT conteggi in TOT secondi (per tenere sotto controllo eventuale rumore non gestito)
@@ -39,6 +40,7 @@
 #define USE_NEW_DETECTION2
 //#define COMPUTE_FEET_COORDS  // to use feet coordinates in the cost computation and in other parts
 #define USE_BINNING_WITH_CHECK  // in order to try filtering out stereo failures during binning
+#define DETECTION_BINNING 3  // binning of the detection: 2, 3 (DEFAULT_BINNING) or 4, 0 to choose it from inst_height (see select_detection_binning(), binning 4 for low installations is not validated yet)
 #endif
 
 // follows define that are specific for emulator
@@ -48,6 +50,14 @@
 #define READ_INPUT  // this flag is automatically undefined in those experiments where digital input are embedded in RAW_DATA
 //#define SUBTRACT_BG
 //#define PERFORMANCE_TEST
+//#define FUSED_CLOSE_OPEN  // chiusura+apertura in un solo passaggio (_imcloseopen()) invece delle quattro operazioni in sequenza: stesso risultato, ma sull'host non e' piu' veloce e sul target non e' ancora misurata (vedi MORPH_BENCHMARK)
+//#define MORPH_BENCHMARK  // main_batch esegue solo il confronto tra chiusura+apertura fusa e sequenziale (morph_closeopen_benchmark())
+//#define CLUSTERING_BENCHMARK  // main_batch esegue solo il confronto tra clustering dei picchi con heap e di riferimento (peaks_clustering_benchmark())
+//#define ASSIGNMENT_BENCHMARK  // main_batch esegue solo il confronto tra assegnamento sparso e metodo ungherese (sparse_matching_benchmark())
+//#define STATIC_OBJ_TEST  // main_batch esegue solo la replica di una sequenza con oggetto statico confrontando lo sfondo statico a blocchi con quello originale (static_obj_test())
+//#define CROWD_BENCHMARK  // main_batch esegue solo la misura del tempo di tracking con scene affollate (crowd_benchmark())
+//#define GAUSSIAN_CONV_TEST  // main_batch confronta la convoluzione gaussiana in virgola fissa con quella di riferimento su mappe casuali e su ogni frame delle sequenze, per ogni binning (gaussian_conv_test())
+//#define CHECK_GAUSSIAN_CONV  // confronta ad ogni frame la convoluzione gaussiana in virgola fissa con quella di riferimento (_convH()/_convV())
 #  ifndef PERFORMANCE_TEST
 //#  define LOAD_PARAMS
 //#  define SAVE_RESULT
@@ -64,6 +74,19 @@
 #ifdef PCN_VERSION
 //#define eVS_TIME_EVAL // to have an estimate of the processing time in /tmp/time_file.txt
 //#define FRAME_RATE_COMPUTATION // to compute in the fps.txt file the processed frame rate
+#define USE_FRAME_QUEUE // acquisizione e decodifica in un thread separato (acquisition_loop()) che passa i frame al main_loop() con una coda lock-free
+#  ifdef USE_FRAME_QUEUE
+#  define FRAME_QUEUE_LEN 4  // numero massimo di frame decodificati in attesa di elaborazione
+#  endif
+//#define FRAME_RING_TEST  // imgserver esegue solo la replica di una sequenza registrata (primo argomento) attraverso il ring di frame_ring.h (frame_ring_replay_test())
+#define USE_IDLE_GATING // a scena vuota (nessuna persona nello storico e motion detection FPGA sotto move_det_thr) detectAndTrack() viene chiamata solo ogni IDLE_FRAME_DECIMATION frame
+#  ifdef USE_IDLE_GATING
+#  define IDLE_FRAME_DECIMATION 4  // a scena vuota viene elaborato un frame ogni IDLE_FRAME_DECIMATION
+#  define IDLE_ENTER_FRAMES 54     // numero di frame consecutivi a scena vuota prima di ridurre l'elaborazione (circa 1 secondo)
+#    ifndef USE_NEW_TRACKING
+#    undef USE_IDLE_GATING  // usa GetNumTrackedPeople() di blob_tracking.cpp
+#    endif
+#  endif
 #endif
 
 #if (defined(PCN_VERSION) || defined(READ_INPUT)) && defined(USE_NEW_DETECTION2)
@@ -0,0 +1,489 @@
+#include <pthread.h> // must be the first include (the added -D_THREAD_SAFE flag in the makefile should be enough but just to be sure...)
+
+#include "frame_ring.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/videodev.h>
+
+//#define _DEBUG_
+
+
+////////////////////////////////////////////////////////////////////////////////
+// consts
+const int FR_MAX_SLOTS = 16;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// types declaration
+typedef enum _FrameSource
+{
+  FR_SRC_NONE = 0,
+  FR_SRC_DEVICE_MMAP,   // V4L mmap buffers (VIDIOCMCAPTURE/VIDIOCSYNC), zero-copy
+  FR_SRC_DEVICE_READ,   // V4L device without mmap support, read() into ring buffers
+  FR_SRC_FILE           // regular file with consecutive frames mapped in memory
+} tFrameSource;
+
+
+typedef struct _FrameRing
+{
+  tFrameSource src;
+  int fd;
+  int frame_size;
+  int num_slots;
+
+  // mapped area (device or file)
+  unsigned char* base;
+  size_t base_size;
+
+  // device mmap
+  struct video_mmap vm;
+
+  // file
+  int num_frames;
+  int next_frame;
+
+  // slots (shared data)
+  unsigned char* slot_ptr[FR_MAX_SLOTS];
+  bool slot_busy[FR_MAX_SLOTS];
+
+  // owned resources
+  bool owns_fd;        // fd opened by fr_open_file()
+  bool owns_slots;     // slot buffers allocated by fr_open_device() (read fallback)
+} tFrameRing;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// global variables
+static tFrameRing fr;
+static pthread_mutex_t g_mtx_frame_ring = PTHREAD_MUTEX_INITIALIZER;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// local routines declaration
+static void _reset(tFrameRing & ring);
+static int _take_free_slot(tFrameRing & ring);
+static void _give_back_slot(tFrameRing & ring, const int i_slot);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// routines definitions
+static void
+_reset(tFrameRing & ring)
+{
+  memset(&ring, 0, sizeof(ring));
+  ring.src = FR_SRC_NONE;
+  ring.fd = -1;
+  ring.base = NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+static int
+_take_free_slot(tFrameRing & ring)
+{
+  int slot = -1;
+
+  pthread_mutex_lock(&g_mtx_frame_ring);
+  for (int s=0; s<ring.num_slots && slot<0; ++s)
+  {
+    if (!ring.slot_busy[s])
+    {
+      ring.slot_busy[s] = true;
+      slot = s;
+    }
+  }
+  pthread_mutex_unlock(&g_mtx_frame_ring);
+
+  return slot;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+_give_back_slot(tFrameRing & ring, const int i_slot)
+{
+  pthread_mutex_lock(&g_mtx_frame_ring);
+  if (i_slot >= 0 && i_slot < ring.num_slots)
+    ring.slot_busy[i_slot] = false;
+  pthread_mutex_unlock(&g_mtx_frame_ring);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+\brief Apertura del ring sul device di acquisizione (gia' aperto e configurato).
+
+Se il driver supporta VIDIOCGMBUF i buffer del driver vengono mappati in memoria e i frame
+vengono acquisiti direttamente nel buffer restituito da fr_acquire(); altrimenti si usa read()
+in buffer allocati dal ring.
+
+\param i_fd file descriptor del device (pxa_qcp).
+\param i_width larghezza della finestra di acquisizione (vid_win.width).
+\param i_height altezza della finestra di acquisizione (vid_win.height).
+\param i_format formato dei pixel (vid_pict.palette).
+\param i_num_slots numero di buffer del ring.
+\return true se il ring e' stato aperto.
+*/
+bool
+fr_open_device(const int i_fd, const int i_width, const int i_height,
+               const int i_format, const int i_num_slots)
+{
+  struct video_mbuf mbuf;
+
+  fr_close();
+
+  if (i_fd < 0 || i_width <= 0 || i_height <= 0 || i_num_slots <= 0)
+    return false;
+
+  fr.fd = i_fd;
+  fr.frame_size = i_width*i_height;
+  fr.num_slots = (i_num_slots < FR_MAX_SLOTS) ? i_num_slots : FR_MAX_SLOTS;
+
+  memset(&mbuf, 0, sizeof(mbuf));
+  if (ioctl(i_fd, VIDIOCGMBUF, &mbuf) == 0 && mbuf.frames > 0 && mbuf.size > 0)
+  {
+    void* base = mmap(0, mbuf.size, PROT_READ|PROT_WRITE, MAP_SHARED, i_fd, 0);
+    if (base != MAP_FAILED)
+    {
+      fr.base = (unsigned char*) base;
+      fr.base_size = mbuf.size;
+      if (fr.num_slots > mbuf.frames)
+        fr.num_slots = mbuf.frames;
+      for (int s=0; s<fr.num_slots; ++s)
+      {
+        fr.slot_ptr[s] = fr.base + mbuf.offsets[s];
+      }
+      fr.vm.width = i_width;
+      fr.vm.height = i_height;
+      fr.vm.format = i_format;
+      fr.src = FR_SRC_DEVICE_MMAP;
+    }
+  }
+
+  if (fr.src == FR_SRC_NONE)
+  {
+    // the driver does not support mmap: fall back to read() into the ring buffers
+    fr.owns_slots = true;
+    for (int s=0; s<fr.num_slots; ++s)
+    {
+      fr.slot_ptr[s] = (unsigned char*) malloc(fr.frame_size);
+      if (fr.slot_ptr[s] == NULL)
+      {
+        fr_close();
+        return false;
+      }
+    }
+    fr.src = FR_SRC_DEVICE_READ;
+  }
+
+#ifdef _DEBUG_
+  printf("fr_open_device: %d slots, %s\n", fr.num_slots,
+         (fr.src == FR_SRC_DEVICE_MMAP) ? "mmap" : "read");
+#endif
+
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+\brief Apertura del ring su un file regolare contenente frame consecutivi di i_frame_size byte.
+
+Il file viene mappato in memoria e fr_acquire() restituisce i frame in sequenza ricominciando
+dal primo una volta raggiunta la fine. Permette di sostituire il device con una sequenza registrata.
+
+\return true se il ring e' stato aperto (il file deve contenere almeno un frame).
+*/
+bool
+fr_open_file(const char* const i_path, const int i_frame_size, const int i_num_slots)
+{
+  struct stat st;
+
+  fr_close();
+
+  if (i_path == NULL || i_frame_size <= 0 || i_num_slots <= 0)
+    return false;
+
+  fr.fd = open(i_path, O_RDONLY);
+  if (fr.fd < 0)
+    return false;
+  fr.owns_fd = true;
+
+  if (fstat(fr.fd, &st) != 0 || st.st_size < i_frame_size)
+  {
+    fr_close();
+    return false;
+  }
+
+  fr.frame_size = i_frame_size;
+  fr.num_frames = st.st_size / i_frame_size;
+  fr.base_size = fr.num_frames * i_frame_size;
+  void* base = mmap(0, fr.base_size, PROT_READ, MAP_SHARED, fr.fd, 0);
+  if (base == MAP_FAILED)
+  {
+    fr_close();
+    return false;
+  }
+  fr.base = (unsigned char*) base;
+
+  fr.num_slots = (i_num_slots < FR_MAX_SLOTS) ? i_num_slots : FR_MAX_SLOTS;
+  fr.next_frame = 0;
+  fr.src = FR_SRC_FILE;
+
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+\brief Chiusura del ring e rilascio delle risorse (il file descriptor del device non viene chiuso).
+*/
+void
+fr_close(void)
+{
+  if (fr.owns_slots)
+  {
+    for (int s=0; s<fr.num_slots; ++s)
+      free(fr.slot_ptr[s]);  // free(NULL) is fine for partially allocated rings
+  }
+
+  if (fr.base != NULL)
+    munmap(fr.base, fr.base_size);
+
+  if (fr.owns_fd)
+    close(fr.fd);
+
+  _reset(fr);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+\brief Acquisizione di un frame.
+
+Restituisce il puntatore al blocco dati di #NX*#NY*4 byte; il buffer resta valido (e non viene
+riusato) finche' non viene chiamata fr_release() con lo slot restituito in o_slot.
+
+\return NULL se il ring non e' aperto, se tutti gli slot sono occupati o se l'acquisizione fallisce.
+*/
+const unsigned char*
+fr_acquire(int & o_slot)
+{
+  o_slot = -1;
+
+  if (fr.src == FR_SRC_NONE)
+    return NULL;
+
+  const int slot = _take_free_slot(fr);
+  if (slot < 0)
+    return NULL;
+
+  const unsigned char* frame = NULL;
+
+  switch (fr.src)
+  {
+    case FR_SRC_DEVICE_MMAP:
+    {
+      // the capture is queued and synchronized here so that no capture is pending
+      // when the caller returns (read() can still be used by the commands)
+      struct video_mmap vm = fr.vm;
+      int frame_idx = slot;
+      vm.frame = slot;
+      if (ioctl(fr.fd, VIDIOCMCAPTURE, &vm) == 0 &&
+          ioctl(fr.fd, VIDIOCSYNC, &frame_idx) == 0)
+        frame = fr.slot_ptr[slot];
+      break;
+    }
+
+    case FR_SRC_DEVICE_READ:
+      if (read(fr.fd, fr.slot_ptr[slot], fr.frame_size) == fr.frame_size)
+        frame = fr.slot_ptr[slot];
+      break;
+
+    case FR_SRC_FILE:
+      pthread_mutex_lock(&g_mtx_frame_ring);
+      frame = fr.base + fr.next_frame*fr.frame_size;
+      fr.next_frame = (fr.next_frame+1) % fr.num_frames;
+      pthread_mutex_unlock(&g_mtx_frame_ring);
+      break;
+
+    default:
+      break;
+  }
+
+  if (frame == NULL)
+    _give_back_slot(fr, slot);
+  else
+    o_slot = slot;
+
+  return frame;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+\brief Rilascio dello slot ottenuto con fr_acquire().
+*/
+void
+fr_release(const int i_slot)
+{
+  _give_back_slot(fr, i_slot);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+bool
+fr_is_open(void)
+{
+  return (fr.src != FR_SRC_NONE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+bool
+fr_is_zero_copy(void)
+{
+  return (fr.src == FR_SRC_DEVICE_MMAP || fr.src == FR_SRC_FILE);
+}
+
+
+#ifdef FRAME_RING_TEST
+////////////////////////////////////////////////////////////////////////////////
+/*!
+\brief Replica di una sequenza registrata attraverso il ring (sorgente file).
+
+Apre il ring con fr_open_file() e acquisisce i frame per i_loops passate dell'intera sequenza,
+confrontando ognuno con il frame letto con fread() dallo stesso file. Verifica inoltre che con
+tutti gli slot occupati fr_acquire() restituisca NULL finch&eacute; uno slot non viene rilasciato,
+che un frame trattenuto non cambi mentre se ne acquisiscono altri, che dopo fr_close() il ring
+risulti chiuso e che un file pi&ugrave; corto di un frame venga rifiutato.
+
+Se i_path &egrave; NULL la sequenza &egrave; sintetica (ogni frame riempito con il proprio indice)
+e viene scritta in un file temporaneo rimosso al termine.
+
+\param i_path file con frame consecutivi di i_frame_size byte (ad esempio il blocco #NX*#NY*4 per frame).
+\param i_frame_size dimensione di un frame in byte.
+\param i_loops numero di passate della sequenza.
+\return il numero di verifiche fallite (0 se il ring si comporta come atteso).
+*/
+int
+frame_ring_replay_test(const char* const i_path, const int i_frame_size, const int i_loops)
+{
+  const int SYNTH_FRAMES = 7;  // non multiplo di FR_NUM_SLOTS per verificare il riavvolgimento
+  char synth_path[] = "/tmp/frame_ring_XXXXXX";
+  const char* path = i_path;
+  int failures = 0;
+
+  unsigned char* ref = (unsigned char*) malloc(i_frame_size);
+  unsigned char* held = (unsigned char*) malloc(i_frame_size);
+  if (ref == NULL || held == NULL)
+  {
+    free(ref);
+    free(held);
+    return 1;
+  }
+
+  if (path == NULL)
+  {
+    int fd = mkstemp(synth_path);
+    if (fd < 0)
+    {
+      free(ref);
+      free(held);
+      return 1;
+    }
+    for (int f=0; f<SYNTH_FRAMES; ++f)
+    {
+      memset(ref, f+1, i_frame_size);
+      if (write(fd, ref, i_frame_size) != i_frame_size)
+        ++failures;
+    }
+    close(fd);
+    path = synth_path;
+  }
+
+  // replay: same frames, in the same order, of a plain read of the file
+  FILE* seq = fopen(path, "rb");
+  if (seq == NULL || !fr_open_file(path, i_frame_size) || !fr_is_open() || !fr_is_zero_copy())
+  {
+    printf("frame_ring_replay_test(): impossibile aprire %s\n", path);
+    ++failures;
+  }
+  else
+  {
+    const int frames = fr.num_frames;
+    for (int n=0; n<frames*i_loops; ++n)
+    {
+      if (fread(ref, 1, i_frame_size, seq) != (size_t) i_frame_size)
+      {
+        rewind(seq);
+        fread(ref, 1, i_frame_size, seq);
+      }
+
+      int slot;
+      const unsigned char* frame = fr_acquire(slot);
+      if (frame == NULL || slot < 0 || memcmp(frame, ref, i_frame_size) != 0)
+        ++failures;
+      fr_release(slot);
+    }
+
+    // all the slots busy: no frame until one is released, the held frames do not change
+    int slots[FR_NUM_SLOTS];
+    const unsigned char* frames_held[FR_NUM_SLOTS];
+    for (int s=0; s<FR_NUM_SLOTS; ++s)
+    {
+      frames_held[s] = fr_acquire(slots[s]);
+      if (frames_held[s] == NULL || slots[s] < 0)
+        ++failures;
+      for (int p=0; p<s; ++p)
+        if (slots[p] == slots[s])
+          ++failures;
+    }
+    if (frames_held[0] != NULL)
+      memcpy(held, frames_held[0], i_frame_size);
+
+    int slot;
+    if (fr_acquire(slot) != NULL || slot != -1)
+      ++failures;
+
+    fr_release(slots[FR_NUM_SLOTS-1]);
+    if (fr_acquire(slots[FR_NUM_SLOTS-1]) == NULL || slots[FR_NUM_SLOTS-1] < 0)
+      ++failures;
+    if (frames_held[0] != NULL && memcmp(held, frames_held[0], i_frame_size) != 0)
+      ++failures;
+
+    for (int s=0; s<FR_NUM_SLOTS; ++s)
+      fr_release(slots[s]);
+
+    printf("frame_ring_replay_test(): %d frame x %d passate da %s\n", frames, i_loops, path);
+  }
+  if (seq != NULL)
+    fclose(seq);
+
+  fr_close();
+  int slot;
+  if (fr_is_open() || fr_acquire(slot) != NULL)
+    ++failures;
+
+  // a file shorter than a frame is refused
+  struct stat st;
+  if (stat(path, &st) != 0 || fr_open_file(path, (int) st.st_size+1))
+    ++failures;
+  fr_close();
+
+  if (path == synth_path)
+    unlink(synth_path);
+  free(ref);
+  free(held);
+
+  printf("frame_ring_replay_test(): %d verifiche fallite\n", failures);
+  return failures;
+}
+#endif
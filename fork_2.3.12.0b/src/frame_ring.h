@@ -0,0 +1,39 @@
+/*!
+\file frame_ring.h
+\brief Ring di buffer di acquisizione condivisi tra main_loop() e acq_loop() (record_utils.cpp).
+
+I frame vengono acquisiti direttamente in buffer mappati in memoria (mmap) e consumati
+per puntatore: chi chiama fr_acquire() ottiene il puntatore al blocco #NX*#NY*4 e lo
+restituisce con fr_release() quando non gli serve piu'.
+
+Sono disponibili tre sorgenti:
+- device V4L con supporto VIDIOCGMBUF: il frame viene scritto dal driver nel buffer mappato (zero-copy);
+- device senza mmap: fallback su read() in buffer del ring (stesso costo della read() originale);
+- file regolare contenente frame consecutivi: il file viene mappato e i frame vengono restituiti
+  ciclicamente (utile per riprodurre sequenze registrate al posto del device).
+*/
+
+#ifndef __FRAME_RING__
+#define __FRAME_RING__
+
+#include "directives.h"
+
+const int FR_NUM_SLOTS = 4; //!< Numero di default di buffer del ring.
+
+bool fr_open_device(const int i_fd, const int i_width, const int i_height,
+                    const int i_format, const int i_num_slots = FR_NUM_SLOTS);
+bool fr_open_file(const char* const i_path, const int i_frame_size,
+                  const int i_num_slots = FR_NUM_SLOTS);
+void fr_close(void);
+
+const unsigned char* fr_acquire(int & o_slot);
+void fr_release(const int i_slot);
+
+bool fr_is_open(void);
+bool fr_is_zero_copy(void);
+
+#ifdef FRAME_RING_TEST
+int frame_ring_replay_test(const char* const i_path, const int i_frame_size, const int i_loops);
+#endif
+
+#endif
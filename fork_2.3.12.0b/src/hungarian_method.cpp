@@ -1,5 +1,244 @@
 #include "hungarian_method.h"
+#include "default_parms.h"
 #include <assert.h>
+#ifdef ASSIGNMENT_BENCHMARK
+#include <time.h>
+#endif
+
+/*
+Assegnamento sparso (sparse_matching()): cammini aumentanti minimi con potenziali (Dijkstra sui
+costi ridotti, come nella fase di aumento di Jonker-Volgenant) partendo contemporaneamente da tutte
+le righe libere, su ciascuna componente connessa del grafo di gating separatamente. Ogni aumento
+da' l'assegnamento di costo minimo con una riga assegnata in piu', quindi alla fine si ottiene
+il massimo numero di assegnamenti a costo minimo, come matching() sulla matrice quadrata
+riempita con max_cost fuori dal gating.
+Nodi: righe 0..nrow-1, colonne nrow..nrow+ncol-1.
+*/
+const int MAX_ASSIGN_NODES = 2*MAX_NUM_PERS;
+const int MAX_ASSIGN_EDGES = MAX_NUM_PERS*MAX_NUM_PERS;
+const int MAX_ASSIGN_COST = INT_MAX/(4*MAX_NUM_PERS);  ///< saturazione dei costi, cosi' distanze e potenziali restano negli int
+const int ASSIGN_INF = INT_MAX;
+
+static int adj_first[MAX_NUM_PERS+1];  ///< archi della riga r: adj_first[r]..adj_first[r+1]-1
+static int adj_fill[MAX_NUM_PERS];
+static int adj_col[MAX_ASSIGN_EDGES];
+static int adj_cost[MAX_ASSIGN_EDGES];
+static int comp_parent[MAX_ASSIGN_NODES];  ///< union-find delle componenti connesse
+static int comp_first[MAX_ASSIGN_NODES+1];  ///< nodi della componente con radice n: comp_nodes[comp_first[n]..comp_first[n+1]-1]
+static int comp_fill[MAX_ASSIGN_NODES];
+static int comp_nodes[MAX_ASSIGN_NODES];
+static bool node_used[MAX_ASSIGN_NODES];  ///< il nodo ha almeno un arco
+static int col_match[MAX_NUM_PERS];  ///< riga assegnata alla colonna c (-1 se libera)
+static int col_match_cost[MAX_NUM_PERS];
+static int pot[MAX_ASSIGN_NODES];  ///< potenziali: i costi ridotti degli archi restano non negativi
+static int dist[MAX_ASSIGN_NODES];
+static int pred[MAX_ASSIGN_NODES];  ///< per le colonne: riga da cui sono state raggiunte
+static int pred_cost[MAX_ASSIGN_NODES];
+static bool visited[MAX_ASSIGN_NODES];
+
+
+static inline int
+_comp_root(int n)
+{
+  while (comp_parent[n] != n)
+  {
+    comp_parent[n] = comp_parent[comp_parent[n]];  // path halving
+    n = comp_parent[n];
+  }
+  return n;
+}
+
+
+/*!
+Cammini aumentanti minimi sulla componente connessa formata dai nodi nodes[0..num_nodes-1]
+(prima le righe, poi le colonne). Restituisce il numero di aumenti fatti.
+*/
+static int
+_solve_component(const int * const nodes, const int num_nodes, const int nrow, int * const & row_match)
+{
+  for (int i=0; i<num_nodes; ++i)
+    pot[nodes[i]] = 0;
+
+  int matched = 0;
+  for (;;)
+  {
+    // sorgenti: tutte le righe libere della componente
+    for (int i=0; i<num_nodes; ++i)
+    {
+      const int n = nodes[i];
+      visited[n] = false;
+      dist[n] = (n < nrow && row_match[n] < 0) ? 0 : ASSIGN_INF;
+    }
+
+    int target = -1;
+    for (;;)
+    {
+      int best = -1;
+      int best_d = ASSIGN_INF;
+      for (int i=0; i<num_nodes; ++i)
+      {
+        const int n = nodes[i];
+        if (!visited[n] && dist[n] < best_d)
+        {
+          best = n;
+          best_d = dist[n];
+        }
+      }
+      if (best < 0)
+        break;  // nessuna colonna libera raggiungibile
+      visited[best] = true;
+
+      if (best < nrow)
+      {
+        // riga: archi verso le colonne diverse da quella assegnata
+        const int r = best;
+        for (int e=adj_first[r]; e<adj_first[r+1]; ++e)
+        {
+          const int c = adj_col[e];
+          const int n = nrow+c;
+          if (c == row_match[r] || visited[n])
+            continue;
+#ifdef _DEBUG
+          assert(adj_cost[e] + pot[r] - pot[n] >= 0);
+#endif
+          const int d = best_d + adj_cost[e] + pot[r] - pot[n];
+          if (d < dist[n])
+          {
+            dist[n] = d;
+            pred[n] = r;
+            pred_cost[n] = adj_cost[e];
+          }
+        }
+      }
+      else
+      {
+        // colonna: se libera il cammino e' trovato, altrimenti si prosegue sulla sua riga
+        const int c = best-nrow;
+        const int r = col_match[c];
+        if (r < 0)
+        {
+          target = c;
+          break;
+        }
+        const int d = best_d - col_match_cost[c] + pot[best] - pot[r];
+        if (d < dist[r])
+          dist[r] = d;
+      }
+    }
+
+    if (target < 0)
+      return matched;
+
+    // aggiornamento dei potenziali con le distanze (saturate alla lunghezza del cammino trovato)
+    const int target_d = dist[nrow+target];
+    for (int i=0; i<num_nodes; ++i)
+    {
+      const int n = nodes[i];
+      pot[n] += visited[n] ? dist[n] : target_d;
+    }
+
+    // aumento lungo il cammino, dalla colonna libera alla riga libera
+    int c = target;
+    for (;;)
+    {
+      const int r = pred[nrow+c];
+      const int prev_c = row_match[r];
+      row_match[r] = c;
+      col_match[c] = r;
+      col_match_cost[c] = pred_cost[nrow+c];
+      if (prev_c < 0)
+        break;
+      c = prev_c;
+    }
+    ++matched;
+  }
+}
+
+
+int
+sparse_matching(const tAssignEdge * const & edges, const int num_edges,
+                const int nrow, const int ncol, int * const & row_match)
+{
+  assert(nrow >= 0 && nrow <= MAX_NUM_PERS);
+  assert(ncol >= 0 && ncol <= MAX_NUM_PERS);
+  assert(num_edges >= 0 && num_edges <= MAX_ASSIGN_EDGES);
+
+  const int num_nodes = nrow+ncol;
+  for (int r=0; r<nrow; ++r)
+    row_match[r] = -1;
+  for (int c=0; c<ncol; ++c)
+    col_match[c] = -1;
+  if (num_edges == 0)
+    return 0;
+
+  // liste di adiacenza delle righe (nell'ordine degli archi in ingresso) e componenti connesse
+  for (int r=0; r<=nrow; ++r)
+    adj_first[r] = 0;
+  for (int n=0; n<num_nodes; ++n)
+  {
+    comp_parent[n] = n;
+    node_used[n] = false;
+  }
+  for (int e=0; e<num_edges; ++e)
+  {
+    const int r = edges[e].row;
+    const int n = nrow+edges[e].col;
+    assert(r >= 0 && r < nrow);
+    assert(edges[e].col >= 0 && edges[e].col < ncol);
+
+    adj_first[r+1]++;
+    node_used[r] = node_used[n] = true;
+    const int root_r = _comp_root(r);
+    const int root_c = _comp_root(n);
+    if (root_r < root_c)
+      comp_parent[root_c] = root_r;
+    else if (root_c < root_r)
+      comp_parent[root_r] = root_c;
+  }
+  for (int r=0; r<nrow; ++r)
+  {
+    adj_first[r+1] += adj_first[r];
+    adj_fill[r] = adj_first[r];
+  }
+  for (int e=0; e<num_edges; ++e)
+  {
+    const int i = adj_fill[edges[e].row]++;
+    adj_col[i] = edges[e].col;
+    adj_cost[i] = (edges[e].cost > (unsigned int)MAX_ASSIGN_COST) ? MAX_ASSIGN_COST : (int)edges[e].cost;
+  }
+
+  // nodi raggruppati per componente (la radice e' il nodo di indice minimo, quindi una riga)
+  for (int n=0; n<=num_nodes; ++n)
+    comp_first[n] = 0;
+  for (int n=0; n<num_nodes; ++n)
+    if (node_used[n])
+    {
+      comp_parent[n] = _comp_root(n);
+      comp_first[comp_parent[n]+1]++;
+    }
+  for (int n=0; n<num_nodes; ++n)
+  {
+    comp_first[n+1] += comp_first[n];
+    comp_fill[n] = comp_first[n];
+  }
+  for (int n=0; n<num_nodes; ++n)
+    if (node_used[n])
+      comp_nodes[comp_fill[comp_parent[n]]++] = n;
+
+  int matched = 0;
+  for (int n=0; n<nrow; ++n)
+  {
+    const int num = comp_first[n+1]-comp_first[n];
+    if (num > 0)
+      matched += _solve_component(&comp_nodes[comp_first[n]], num, nrow, row_match);
+  }
+
+  return matched;
+}
+
+
+#ifdef ASSIGNMENT_BENCHMARK
+// Implementazione di riferimento: metodo ungherese (Munkres) sulla matrice quadrata completa
 
 //For each row of the cost matrix, find the smallest element and subtract
 //it from every element in its row.  When finished, Go to Step 2.
@@ -476,3 +715,111 @@ int* matching(const unsigned int * const & i_C, const int nrow, const int ncol,
 
   return M;
 }
+
+
+/*!
+Confronta sparse_matching() con matching() sulla matrice quadrata riempita come faceva find_best_match()
+(max_cost fuori dal gating, 0 nelle righe/colonne aggiunte), su grafi di gating casuali fino a #MAX_NUM_PERS x #MAX_NUM_PERS.
+Gli assegnamenti a pari costo possono differire: si confrontano numero di assegnamenti e costo totale.
+Restituisce il numero di casi con risultati diversi.
+*/
+int
+sparse_matching_benchmark(const int iterations)
+{
+  static unsigned int C[MAX_NUM_PERS*MAX_NUM_PERS];
+  static unsigned int C_sq[MAX_NUM_PERS*MAX_NUM_PERS];
+  static int M[MAX_NUM_PERS*MAX_NUM_PERS];
+  static tAssignEdge edges[MAX_ASSIGN_EDGES];
+  static int row_match[MAX_NUM_PERS];
+  const unsigned int max_cost = INT_MAX-1;
+  const int sizes[3] = {NUM_PERS_SING, 3*NUM_PERS_SING, MAX_NUM_PERS};
+
+  int mismatches = 0;
+
+  srand(1);
+  for (int s=0; s<3; ++s)
+  {
+    const int nrow = sizes[s];
+    clock_t ref_ticks = 0, sparse_ticks = 0;
+    int edges_tot = 0;
+    for (int it=0; it<iterations; ++it)
+    {
+      // detection e blob raggruppati come le persone in scena: pochi candidati per riga
+      const int ncol = 1 + rand()%nrow;
+      int num_edges = 0;
+      for (int r=0; r<nrow; ++r)
+        for (int c=0; c<ncol; ++c)
+        {
+          const bool gated = abs((r*ncol)/nrow - c) <= 1 && (rand()%4) != 0;
+          C[r*ncol+c] = gated ? (unsigned int)(rand()%2000) : max_cost;
+          if (gated)
+          {
+            edges[num_edges].row = r;
+            edges[num_edges].col = c;
+            edges[num_edges].cost = C[r*ncol+c];
+            ++num_edges;
+          }
+        }
+      edges_tot += num_edges;
+
+      clock_t start = clock();
+      const int sparse_num = sparse_matching(edges, num_edges, nrow, ncol, row_match);
+      unsigned int sparse_cost = 0;
+      for (int r=0; r<nrow; ++r)
+        if (row_match[r] >= 0)
+          sparse_cost += C[r*ncol+row_match[r]];
+      sparse_ticks += clock()-start;
+
+      // riferimento: solo righe e colonne con almeno un arco, matrice quadrata con padding a 0
+      start = clock();
+      int ref_num = 0;
+      unsigned int ref_cost = 0;
+      int rows_act[MAX_NUM_PERS], cols_act[MAX_NUM_PERS];
+      int nr = 0, nc = 0;
+      for (int r=0; r<nrow; ++r)
+      {
+        int c = 0;
+        while (c<ncol && C[r*ncol+c] == max_cost) ++c;
+        if (c < ncol) rows_act[nr++] = r;
+      }
+      for (int c=0; c<ncol; ++c)
+      {
+        int r = 0;
+        while (r<nrow && C[r*ncol+c] == max_cost) ++r;
+        if (r < nrow) cols_act[nc++] = c;
+      }
+      if (nr > 0)
+      {
+        const int nelem = (nr > nc) ? nr : nc;
+        for (int r=0; r<nelem; ++r)
+          for (int c=0; c<nelem; ++c)
+            C_sq[r*nelem+c] = (r < nr && c < nc) ? C[rows_act[r]*ncol+cols_act[c]] : 0;
+        matching(C_sq, nelem, nelem, max_cost, M);
+        for (int r=0; r<nr; ++r)
+          for (int c=0; c<nc; ++c)
+          {
+            const unsigned int cost = C[rows_act[r]*ncol+cols_act[c]];
+            if (M[r*nelem+c] == 1 && cost != max_cost)
+            {
+              ++ref_num;
+              ref_cost += cost;
+            }
+          }
+      }
+      ref_ticks += clock()-start;
+
+      if (ref_num != sparse_num || ref_cost != sparse_cost)
+        ++mismatches;
+    }
+
+    printf("sparse_matching_benchmark(): %d righe (%.1f archi): ungherese %.2f us, sparso %.2f us\n",
+      nrow, (double)edges_tot/iterations,
+      1e6*ref_ticks/((double)CLOCKS_PER_SEC*iterations), 1e6*sparse_ticks/((double)CLOCKS_PER_SEC*iterations));
+  }
+
+  if (mismatches > 0)
+    printf("sparse_matching_benchmark(): %d casi con risultati diversi!\n", mismatches);
+
+  return mismatches;
+}
+#endif
@@ -6,6 +6,31 @@
 #include <string.h>
 #include <limits.h>
 
+#include "directives.h"
+
+/*!
+\struct tAssignEdge
+\brief Coppia (riga, colonna) ammessa dal gating, con il relativo costo.
+*/
+typedef struct
+{
+  int row;  ///< riga (es. blob nello storico)
+  int col;  ///< colonna (es. persona rilevata nel frame corrente)
+  unsigned int cost;  ///< costo dell'associazione
+} tAssignEdge;
+
+/*!
+Assegnamento a costo minimo sulle sole coppie ammesse dal gating (matrice nrow x ncol anche
+rettangolare): massimizza il numero di righe assegnate e, a parita' di numero, minimizza il costo totale.
+row_match[r] riceve la colonna assegnata alla riga r (-1 se non assegnata).
+Restituisce il numero di righe assegnate.
+*/
+int sparse_matching(const tAssignEdge * const & edges, const int num_edges,
+                    const int nrow, const int ncol, int * const & row_match);
+
+#ifdef ASSIGNMENT_BENCHMARK
 int* matching(const unsigned int * const & C, const int nrow, const int ncol, const int max_cost, int * p_result);
+int sparse_matching_benchmark(const int iterations);
+#endif
 
 #endif
@@ -14,6 +14,173 @@ e reset della memoria flash (erase_flash()).
 extern unsigned char Frame_DX[NN];   //!< Immagine destra a 256 livelli di grigio (#NX*#NY=160*120).
 extern unsigned char Frame_SX[NN];   //!< Immagine sinistra a 256 livelli di grigio (#NX*#NY=160*120).
 extern unsigned char Frame_DSP[NN];  //!< Mappa di disparit&agrave; #NX*#NY=160*120 (16 livelli di disparit&agrave; distribuiti su 256 livelli di grigio).
+extern unsigned long decode_skipped_words; //!< Word a 32 bit del blocco FPGA non lette nell'ultimo frame (vedi get_disparity_roi()).
+
+static unsigned long dsp_col_mask[NX >> 2]; //!< Maschere di bordo della disparita' per coppia di word (4 pixel).
+static bool dsp_col_mask_ready = false;
+
+/*!
+\brief Calcolo (una volta sola) delle maschere di bordo per colonna della mappa di disparit&agrave;.
+
+La word i-esima (pixel 2i e 2i+1) &egrave; di bordo se (i<<1) < #BORDER_X || (i<<1) >= #NX-#BORDER_X, 
+quindi il test viene fatto sulla colonna pari per entrambi i pixel della word.
+*/
+static void init_dsp_col_mask()
+{
+    int i;
+
+    if (dsp_col_mask_ready)
+        return;
+
+    for(i=0;i<(NX >> 2);i++)
+    {
+        const int w = i << 1;
+        unsigned long m = 0;
+        if (!((w<<1) < BORDER_X || (w<<1) >= NX-BORDER_X)) m |= 0x0000FFFF;
+        if (!(((w+1)<<1) < BORDER_X || ((w+1)<<1) >= NX-BORDER_X)) m |= 0xFFFF0000;
+        dsp_col_mask[i] = m;
+    }
+    dsp_col_mask_ready = true;
+}
+
+/*!
+\brief Valor medio e parametri di motion detection: sono nella prima finestra della riga dispari del blocco.
+
+\param ptr blocco dati letto dall'FPGA.
+\param motion [out] nell'ordine #vm_img, #mov_dect_15_23l, #mov_dect_8_15l, #mov_dect_0_7l, 
+#mov_dect_15_23r, #mov_dect_8_15r e #mov_dect_0_7r.
+*/
+static inline void decode_motion_detection(const unsigned long *ptr, unsigned char motion[7])
+{
+    const unsigned long *dsp = ptr + (NX >> 1);
+
+    motion[0] = (dsp[0] & 0x0000FF00) >> 8;
+    motion[1] = (dsp[0] & 0xFF000000) >> 24;
+    motion[2] = (dsp[1] & 0x0000FF00) >> 8;
+    motion[3] = (dsp[1] & 0xFF000000) >> 24;
+    motion[4] = (dsp[2] & 0x0000FF00) >> 8;
+    motion[5] = (dsp[2] & 0xFF000000) >> 24;
+    motion[6] = (dsp[3] & 0x0000FF00) >> 8;
+}
+
+/*!
+\brief Aggiorna le variabili globali di valor medio e motion detection (vedi decode_motion_detection()).
+*/
+static inline void set_motion_detection(const unsigned char motion[7])
+{
+    vm_img = motion[0];
+    mov_dect_15_23l = motion[1];
+    mov_dect_8_15l = motion[2];
+    mov_dect_0_7l = motion[3];
+    mov_dect_15_23r = motion[4];
+    mov_dect_8_15r = motion[5];
+    mov_dect_0_7r = motion[6];
+}
+
+/*!
+\brief Disparit&agrave; (nibble bassi dei byte 0 e 2 di due word consecutive) di 4 pixel in una word.
+*/
+static inline unsigned long decode_dsp_pair(const unsigned long d0, const unsigned long d1)
+{
+    return ((d0 << 4) & 0x000000F0) | ((d0 >> 4) & 0x0000F000) | 
+           ((d1 << 20) & 0x00F00000) | ((d1 << 12) & 0xF0000000);
+}
+
+/*!
+\brief Deinterlacciamento completo del blocco dati nei tre piani passati (vedi get_images()).
+*/
+static void decode_images(const unsigned char *orig, unsigned char *frame_dx, 
+                          unsigned char *frame_sx, unsigned char *frame_dsp)
+{
+    const unsigned long *ptr = (const unsigned long *) orig; // puntatore ad una zona di memoria a 32bits
+    const unsigned long *dsp;
+    unsigned long *dx = (unsigned long *) frame_dx;
+    unsigned long *sx = (unsigned long *) frame_sx;
+    unsigned long *dm = (unsigned long *) frame_dsp;
+    unsigned long w0, w1;
+    int i,j;
+
+    init_dsp_col_mask();
+
+    for(j=0;j<NY;j++)
+    {
+        dsp = ptr + (NX >> 1);
+
+        for(i=0;i<(NX >> 2);i++)
+        {
+            w0 = ptr[i<<1];
+            w1 = ptr[(i<<1)+1];
+            dx[i] = (w0 & 0x000000FF) | ((w0 >> 8) & 0x0000FF00) | ((w1 << 16) & 0x00FF0000) | ((w1 << 8) & 0xFF000000);
+            sx[i] = ((w0 >> 8) & 0x000000FF) | ((w0 >> 16) & 0x0000FF00) | ((w1 << 8) & 0x00FF0000) | (w1 & 0xFF000000);
+        }
+
+        // se non sono sulle righe di bordo allora vengono prelevati i nibble della disparity map
+        if (j < BORDER_Y || j >= NY-BORDER_Y)
+        {
+            for(i=0;i<(NX >> 2);i++)
+                dm[i] = 0;
+        }
+        else
+        {
+            for(i=0;i<(NX >> 2);i++)
+                dm[i] = decode_dsp_pair(dsp[i<<1], dsp[(i<<1)+1]) & dsp_col_mask[i];
+        }
+
+        dx += (NX >> 2);
+        sx += (NX >> 2);
+        dm += (NX >> 2);
+
+        // salta due righe corrispondenti a due blocchi di 320 bytes ovvero NX/2*4
+        ptr += NX;		// 2-rows step
+    }
+}
+
+/*!
+\brief Decodifica della sola regione di interesse della mappa di disparit&agrave; (vedi get_disparity_roi()).
+\return numero di word a 32 bit del blocco non lette rispetto alla decodifica completa.
+*/
+static unsigned long decode_disparity_roi(const unsigned char *orig, unsigned char *frame_dsp)
+{
+    const unsigned long *ptr = (const unsigned long *) orig; // puntatore ad una zona di memoria a 32bits
+    const unsigned long *dsp;
+    unsigned long *dm = (unsigned long *) frame_dsp;
+    // coppie di word (4 pixel) che contengono almeno un pixel interno
+    const int p_lo = ((BORDER_X+1) >> 1) >> 1;
+    const int p_hi = (((NX-BORDER_X+1) >> 1) + 1) >> 1;
+    const unsigned long full_words = NY*(NX >> 1); // word di disparita' lette dalla decodifica completa
+    unsigned long read_words = 4; // valor medio e motion detection
+    int i,j;
+
+    init_dsp_col_mask();
+
+    // righe di bordo superiori
+    for(i=0;i<BORDER_Y*(NX >> 2);i++)
+        dm[i] = 0;
+    dm += BORDER_Y*(NX >> 2);
+    ptr += BORDER_Y*NX;
+
+    for(j=BORDER_Y;j<NY-BORDER_Y;j++)
+    {
+        dsp = ptr + (NX >> 1);
+
+        for(i=0;i<p_lo;i++)
+            dm[i] = 0;
+        for(i=p_lo;i<p_hi;i++)
+            dm[i] = decode_dsp_pair(dsp[i<<1], dsp[(i<<1)+1]) & dsp_col_mask[i];
+        for(i=p_hi;i<(NX >> 2);i++)
+            dm[i] = 0;
+
+        dm += (NX >> 2);
+        ptr += NX;		// 2-rows step
+    }
+    read_words += (NY-2*BORDER_Y)*((p_hi-p_lo) << 1);
+
+    // righe di bordo inferiori
+    for(i=0;i<BORDER_Y*(NX >> 2);i++)
+        dm[i] = 0;
+
+    return full_words - read_words;
+}
 
 /*!
 \brief Estrazione e deinterlacciamento del blocco dati #NX*#NY*4=160*120*4=320*240 bytes.
@@ -24,101 +191,120 @@ i parametri di motion detection (#mov_dect_15_23l, #mov_dect_8_15l, #mov_dect_0_
 #mov_dect_8_15r e #mov_dect_0_7r), 
 il valor medio di una delle due immagini (#vm_img).
 
+\code
+// Il blocco dati 160*120*4=320*240 si suddivide 160*120 finestre piu' piccole da 2x2 pixels:
+// il primo pixel (posizione top-left) si riferisce all'immagine sinistra
+// il secondo pixel (posizione top-right) si riferisce all'immagine sinistra
+// e il terzo pixel (posizione bottom-left) si riferisce alla mappa di disparita'.
+// Nella prima finestra il terzo pixel contiene anche il valor medio
+// ed i parametri di motion detection.
+//
+// Ogni word a 32 bit della riga pari contiene i pixel "step" e "step+1":
+//   byte0 -> Frame_DX[step], byte1 -> Frame_SX[step], byte2 -> Frame_DX[step+1], byte3 -> Frame_SX[step+1]
+// e la word corrispondente della riga dispari contiene la disparita' nei nibble bassi dei byte 0 e 2.
+\endcode
+
+Il deinterlacciamento viene fatto a coppie di word (4 pixel per piano) scrivendo una word a 32 bit 
+per ciascun piano; i bordi della mappa di disparit&agrave; sono gestiti con maschere di colonna 
+calcolate una volta sola e con l'azzeramento delle righe di bordo, senza test per pixel. 
+Il risultato &egrave; identico bit a bit alla versione pixel per pixel (compreso il test di bordo 
+fatto sulla colonna pari per entrambi i pixel di una word).
+
+In modalit&agrave; tracking (acq_mode & 0x0100) le immagini sinistra e destra non servono e 
+viene usata get_disparity_roi().
+
 \param orig buffer #NX*#NY*4=160*120*4=320*240 letto dall'FPGA.
 \param img NON USATO (???)
+
+\note Richiede che #Frame_DX, #Frame_SX e #Frame_DSP siano allineati a 4 byte (vedi imgserver.cpp) 
+e che l'architettura sia little endian (come l'XScale del PCN-1001).
 */
-void get_images(unsigned char *orig,int img)
+void get_images(const unsigned char *orig,int img)
 {
-    unsigned long *ptr;
-    int i,j,step;
+    unsigned char motion[7];
 
-    ptr = (unsigned long *) orig; // puntatore ad una zona di memoria a 32bits
-
-    for(j=0;j<NY;j++)
+    if (acq_mode & 0x0100) // tracking mode: solo la mappa di disparita'
     {
-        step = j*NX;
-        for(i=0;i<(NX >> 1);i++)
-        { 
-            // vengono prelevati i 32 bits appartenenti alla finestra 2x2 del blocco 160*120*4=320*240
-            // che contiene il primo pixel di ciascuna immagine (left and right) piu' mappa di disparita'
-            // piu' le informazioni relative al valor medio e al motion detection
-
-    /*!
-    \code
-    // Il blocco dati 160*120*4=320*240 si suddivide 160*120 finestre piu' piccole da 2x2 pixels:
-    // il primo pixel (posizione top-left) si riferisce all'immagine sinistra
-    // il secondo pixel (posizione top-right) si riferisce all'immagine sinistra
-    // e il terzo pixel (posizione bottom-left) si riferisce alla mappa di disparita'.
-    // Se la modalita' tracking e' attiva allora il terzo pixel si riferisce al valor medio
-    // ed ai parametri di motion detection.
-
-    vm_img = (*(ptr+(NX>>1)) & 0x0000FF00)>>8;	
-    mov_dect_15_23l = (*(ptr+(NX>>1)) & 0xFF000000) >> 24;
-    mov_dect_8_15l = (*(ptr+1+(NX>>1)) & 0x0000FF00)>>8;
-    mov_dect_0_7l = (*(ptr+1+(NX>>1)) & 0xFF000000) >> 24;
-    mov_dect_15_23r = (*(ptr+2+(NX>>1)) & 0x0000FF00)>>8;
-    mov_dect_8_15r = (*(ptr+2+(NX>>1)) & 0xFF000000) >> 24;
-    mov_dect_0_7r = (*(ptr+3+(NX>>1)) & 0x0000FF00)>>8;
-
-    if(!(acq_mode & 0x0100)) //no tracking mode
-    {
-        Frame_DX[step] = *ptr & 0x000000FF;
-        Frame_SX[step] = (*ptr & 0x0000FF00) >> 8;
+        get_disparity_roi(orig);
+        return;
     }
-    
-    if((i<<1) < BORDER_X || (i<<1) >= NX-BORDER_X || j < BORDER_Y || j >= NY-BORDER_Y) 
-        Frame_DSP[step]=0;
-    else
-        Frame_DSP[step] = (*(ptr+(NX>>1)) & 0x0000000F) << 4;            
-    \endcode
-    */
-            
-            // mean value: viene prelevato il byte relativo al pixel della 2riga 1colonna del buffer 160*120*4=320*240
-            if(i==0&&j==0) vm_img = (*(ptr+(NX>>1)) & 0x0000FF00)>>8;	
-            if(i==0&&j==0) mov_dect_15_23l = (*(ptr+(NX>>1)) & 0xFF000000) >> 24;
-            if(i==0&&j==0) mov_dect_8_15l = (*(ptr+1+(NX>>1)) & 0x0000FF00)>>8;
-            if(i==0&&j==0) mov_dect_0_7l = (*(ptr+1+(NX>>1)) & 0xFF000000) >> 24;
-            if(i==0&&j==0) mov_dect_15_23r = (*(ptr+2+(NX>>1)) & 0x0000FF00)>>8;
-            if(i==0&&j==0) mov_dect_8_15r = (*(ptr+2+(NX>>1)) & 0xFF000000) >> 24;
-            if(i==0&&j==0) mov_dect_0_7r = (*(ptr+3+(NX>>1)) & 0x0000FF00)>>8;
-
-            //  average_img_val
-            if(!(acq_mode & 0x0100))	//no tracking
-            {
-                // viene prelevato il pixel "step" (sia left che right)
-                Frame_DX[step]  = *ptr & 0x000000FF; // The byte is taken on the pixels of the first row second column buffer 160*120*4=320*240. //viene prelevato il byte relativo al pixel della 1riga 2colonna del buffer 160*120*4=320*240
-                Frame_SX[step]  = (*ptr & 0x0000FF00) >> 8; // The byte is taken on the pixels of the first row first column of the buffer 160*120*4=320*240. //viene prelevato il byte relativo al pixel della 1riga 1colonna del buffer 160*120*4=320*240
-            }
 
-            // se non sono sui bordi allora viene prelevato il pixel "step" della disparity map
-            if((i<<1) < BORDER_X || (i<<1) >= NX-BORDER_X || j < BORDER_Y || j >= NY-BORDER_Y) 
-                Frame_DSP[step]=0;
-            else
-                Frame_DSP[step] = (*(ptr+(NX>>1)) & 0x0000000F) << 4;
+    decode_motion_detection((const unsigned long *) orig, motion);
+    set_motion_detection(motion);
+    decode_images(orig, Frame_DX, Frame_SX, Frame_DSP);
+    decode_skipped_words = 0;
+}
 
-            step++;
 
-            if(!(acq_mode & 0x0100))	//no tracking
-            {
-                // viene prelevato il pixel "step+1" (sia left che right)
-                Frame_DX[step]  = (*ptr & 0x00FF0000) >> 16; 
-                Frame_SX[step]  = (*ptr & 0xFF000000) >> 24;
-            }
+/*!
+\brief Decodifica della sola mappa di disparit&agrave; nella regione di interesse (modalit&agrave; tracking).
 
-            // se non sono sui bordi allora viene prelevato il pixel "step+1" della disparity map
-            if((i<<1) < BORDER_X || (i<<1) >= NX-BORDER_X || j < BORDER_Y || j >= NY-BORDER_Y) 
-                Frame_DSP[step]=0;
-            else
-                Frame_DSP[step] = (*(ptr+(NX>>1)) & 0x000F0000) >> 12;
+In modalit&agrave; tracking detectAndTrack() usa solo la zona interna a #BORDER_X / #BORDER_Y di #Frame_DSP, 
+quindi vengono lette solo le word del blocco FPGA che contengono la disparit&agrave; di tale zona 
+(piu' le prime word della riga dispari per valor medio e motion detection); 
+le righe e le colonne di bordo vengono azzerate con scritture a 32 bit senza leggere il blocco 
+(devono comunque essere riscritte perch&eacute; il tracking ci disegna sopra le croci).
+Le immagini #Frame_SX e #Frame_DX non vengono toccate.
 
-            step++; 
+Il risultato in #Frame_DSP &egrave; identico a quello di get_images() in modalit&agrave; tracking. 
+Il numero di word non lette rispetto alla decodifica completa viene riportato in #decode_skipped_words.
 
-            ptr++;
-        } 
+\param orig buffer #NX*#NY*4=160*120*4=320*240 letto dall'FPGA.
+*/
+void get_disparity_roi(const unsigned char *orig)
+{
+    unsigned char motion[7];
+
+    decode_motion_detection((const unsigned long *) orig, motion);
+    set_motion_detection(motion);
+    decode_skipped_words = decode_disparity_roi(orig, Frame_DSP);
+}
+
+
+/*!
+\brief Decodifica del blocco dati in un frame della coda tra thread di acquisizione e main_loop().
+
+Fa lo stesso lavoro di get_images() (o di get_disparity_roi() se i_tracking &egrave; vero) ma scrive 
+nel frame passato invece che nelle variabili globali, che restano di proprieta' del main_loop(); 
+i dati vengono poi resi correnti con set_current_frame().
+
+\param orig buffer #NX*#NY*4=160*120*4=320*240 letto dall'FPGA.
+\param i_tracking vero se il frame e' acquisito in modalita' tracking (acq_mode & 0x0100).
+\param df [out] frame decodificato.
+*/
+void decode_frame(const unsigned char *orig, const bool i_tracking, tDecodedFrame *df)
+{
+    decode_motion_detection((const unsigned long *) orig, df->motion);
+    df->tracking = i_tracking;
+    if (i_tracking)
+    {
+        df->skipped_words = decode_disparity_roi(orig, df->dsp);
+    }
+    else
+    {
+        decode_images(orig, df->dx, df->sx, df->dsp);
+        df->skipped_words = 0;
+    }
+}
 
-        // salta una riga corrispondente ad un blocco di 320 bytes ovvero NX/2*4
-        ptr += (NX >> 1);		// 2-rows step
+
+/*!
+\brief Rende corrente il frame decodificato da decode_frame() (#Frame_DSP, #Frame_SX, #Frame_DX, 
+valor medio e motion detection), come se fosse stato letto con get_images().
+
+I piani vengono copiati nelle variabili globali: lo slot torna subito al thread di acquisizione e 
+i comandi che leggono #Frame_DSP, #Frame_SX e #Frame_DX non vedono mai uno slot che viene riscritto.
+*/
+void set_current_frame(const tDecodedFrame *df)
+{
+    set_motion_detection(df->motion);
+    memcpy(Frame_DSP, df->dsp, NN);
+    if (!df->tracking)
+    {
+        memcpy(Frame_DX, df->dx, NN);
+        memcpy(Frame_SX, df->sx, NN);
     }
+    decode_skipped_words = df->skipped_words;
 }
 
 
@@ -147,9 +147,10 @@ Per ulteriori dettagli vedere la funzione main().
 extern int num_pers;
 
 unsigned char Frame[NN << 2]; //!< Blocco dati trasferito mediante quick capture technology (#NN*4=#NX*#NY*4=160*120*4=320*240 bytes).
-unsigned char Frame_DX[NN];   //!< Immagine destra a 256 livelli di grigio (#NX*#NY=160*120).
-unsigned char Frame_SX[NN];   //!< Immagine sinistra a 256 livelli di grigio (#NX*#NY=160*120).
-unsigned char Frame_DSP[NN];  //!< Mappa di disparit&agrave; #NX*#NY=160*120 (16 livelli di disparit&agrave; distribuiti su 256 livelli di grigio).
+unsigned char Frame_DX[NN] __attribute__ ((aligned (4)));   //!< Immagine destra a 256 livelli di grigio (#NX*#NY=160*120).
+unsigned char Frame_SX[NN] __attribute__ ((aligned (4)));   //!< Immagine sinistra a 256 livelli di grigio (#NX*#NY=160*120).
+unsigned char Frame_DSP[NN] __attribute__ ((aligned (4)));  //!< Mappa di disparit&agrave; #NX*#NY=160*120 (16 livelli di disparit&agrave; distribuiti su 256 livelli di grigio).
+unsigned long decode_skipped_words = 0; //!< Word a 32 bit del blocco FPGA non lette da get_images() nell'ultimo frame (decodifica della sola ROI in modalit&agrave; tracking).
 
 //unsigned char minuti_log=0; //!< ???
 
@@ -383,12 +384,17 @@ pthread_t serloopttyS1;   //!< Posix thread associato alla funzione ser_loopttyS
 pthread_mutex_t rdlock;   //!< Semaforo di tipo posix utilizzato per poter accedere in modo esclusivo alla risorsa #records[].
 pthread_mutex_t mainlock; //!< Semaforo di tipo posix utilizzato per poter accedere in modo esclusivo ad una variabile globale da thread concorrenti.
 pthread_mutex_t acq_mode_lock; // 20100517 eVS
+pthread_mutex_t acq_dev_lock;  //!< Accesso esclusivo al device di acquisizione (#pxa_qcp) tra acquisition_loop() e gli ioctl del main_loop() e dei comandi.
 
 // (reset_counters function and "serial" command)
 pthread_t ploop;
 pthread_t mloop; //!< Posix thread associato alla funzione main_loop() che contiene il ciclo principale di esecuzione.
+#ifdef USE_FRAME_QUEUE
+pthread_t aqloop; //!< Posix thread associato alla funzione acquisition_loop() che acquisisce e decodifica i frame per il main_loop().
+#endif
 pthread_t tloop;
 pthread_t rdloop;
+pthread_t bkgloop; //!< Posix thread associato a bkg_writer_loop() che salva lo sfondo su flash.
 
 pthread_t inloop0;
 pthread_t inloop1;
@@ -483,7 +489,9 @@ char parm_names[256][PARM_STR_LEN] = {
     "dis_autobkg",     // 20090506 Lisbona
     "door_size",       // 20130411 eVS, door_size instead of door_kind (for 2.3.10.7)
     "handle_oor",       // 20130715 eVS added to manage OOR situation after reboot
-    "auto_gain"         // 20130927 eVS added to manage gain Vref
+    "auto_gain",        // 20130927 eVS added to manage gain Vref
+    "crowd_capacity",   // persone tracciate per sensore (porte larghe affollate)
+    "processing_decimation"  // un frame elaborato ogni processing_decimation (sensori molto carichi)
 };
 
 /*!
@@ -594,7 +602,9 @@ unsigned short default_values[256] = {
     DIS_AUTOBKG,   //20090506 Lisbona
     DOOR_SIZE,      //20130411 eVS, DOOR_SIZE instead of DOOR_KIND (for 2.3.10.7)
     HANDLE_OOR, // 20130715 eVS, in order to manage OOR correctly after reboot
-    AUTO_GAIN   // 20130927 eVS added to manage gain Vref
+    AUTO_GAIN,  // 20130927 eVS added to manage gain Vref
+    CROWD_CAPACITY,
+    PROCESSING_DECIMATION
     };
 
 
@@ -844,6 +854,11 @@ int main(int argc, char ** argv)
 
     int option_index = 0;
 
+#ifdef FRAME_RING_TEST
+    // replica della sequenza registrata passata come primo argomento (sintetica se manca) attraverso il ring
+    return frame_ring_replay_test((argc > 1) ? argv[1] : NULL, NN << 2, 3);
+#endif
+
     /*! \code
     // Esegue il parsing della stringa di comando (per esempio: imgserver --version oppure imgserver -v)
     c = getopt_long(argc, argv, "v:d",long_options, &option_index);
@@ -937,32 +952,21 @@ int main(int argc, char ** argv)
     current_vref_right = default_vref_right;
 
     /*!
-    <b>Caricamento dello sfondo della scena da file ascii</b>
+    <b>Caricamento dello sfondo della scena da file binario</b>
     \code
-    if((in = fopen(bg_filename,"rb")))
-    {
-        // Bkgvec contiene lo sfondo (o meglio una media di n immagini di sfondo)
-        fread(Bkgvec,sizeof(Bkgvec),1,in);
-        // svec contiene la deviazione standard di ciascun pixel dal valor medio dello sfondo
-        fread(svec,sizeof(svec),1,in);
-        // vm_bkg rappresenta il valor medio dello sfondo
-        fread(&vm_bkg,sizeof(vm_bkg),1,in);
-        ...
+    // Bkgvec contiene lo sfondo (o meglio una media di n immagini di sfondo)
+    // svec contiene la deviazione standard di ciascun pixel dal valor medio dello sfondo
+    // vm_bkg rappresenta il valor medio dello sfondo
+    LoadBkg();
     \endcode 
     */
 
-    // loading scene background image
-    FILE *in;
-    if((in = fopen(bg_filename,"rb")))
-    {
-        fread(Bkgvec,sizeof(Bkgvec),1,in);
-        fread(svec,sizeof(svec),1,in);
-        fread(&vm_bkg,sizeof(vm_bkg),1,in);
-        fclose(in);
-    }
+    // loading scene background image (mapped in memory and validated, see LoadBkg())
+    LoadBkg();
 
     // copio il background caricato nella variabile usata per l'auto background
     memcpy(Bkgvectmp,Bkgvec,NN);
+    UpdateBkgThreshold();
 
     //---------------people tracking init------------------//
     unsigned long people[2];
@@ -1172,6 +1176,7 @@ int main(int argc, char ** argv)
     \endcode */
 
     pthread_mutex_init(&acq_mode_lock,NULL); // 20100518 eVS
+    pthread_mutex_init(&acq_dev_lock,NULL);
     pthread_mutex_init(&mainlock,NULL);
     pthread_mutex_init(&rdlock,NULL);
       
@@ -1337,6 +1342,7 @@ int main(int argc, char ** argv)
        
     pthread_create (&wdloop, NULL, watchdog_loop, NULL); //watchdog loop   
     pthread_create (&rdloop, NULL, record_loop, NULL);    
+    pthread_create (&bkgloop, NULL, bkg_writer_loop, NULL); // background saving (see SaveBkg())
     pthread_create (&inloop0, NULL, input_loop0, NULL);
     pthread_create (&inloop1, NULL, input_loop1, NULL);
     
@@ -1532,6 +1538,7 @@ Communication(i,buf)
     //pthread_mutex_destroy(&mainlock);
     pthread_cancel(ploop);
     pthread_cancel(rdloop);
+    pthread_cancel(bkgloop);
     pthread_cancel(inloop0);
     pthread_cancel(inloop1); // 20100518 eVS added
     pthread_cancel(mloop);
@@ -1541,6 +1548,7 @@ Communication(i,buf)
     pthread_mutex_destroy(&rdlock);
     pthread_mutex_destroy(&mainlock);
     pthread_mutex_destroy(&acq_mode_lock);
+    pthread_mutex_destroy(&acq_dev_lock);
     
     return 0;
 }
@@ -1692,6 +1700,14 @@ int init_io()
     arg = VIDEO_START;
     ioctl(pxa_qcp, VIDIOCCAPTURE, arg);
 
+    /*! \code
+    // ring di buffer mappati in memoria usato da main_loop() e dalla registrazione (record_utils.cpp)
+    fr_open_device(pxa_qcp,vid_win.width,vid_win.height,vid_pict.palette);
+    \endcode */
+
+    if (!fr_open_device(pxa_qcp,vid_win.width,vid_win.height,vid_pict.palette))
+        printf("Warning: cannot open the frame ring, frames will be read into Frame.\n");
+
     // -------------- fpga i2c address --------------------------
     i2cstruct.adapter_nr = 0;
     i2cstruct.slave_addr = 0x20;
@@ -1811,6 +1827,8 @@ void deinit_io()
     // stop video capture
     ioctl(pxa_qcp, VIDIOCCAPTURE, arg);
 
+    fr_close();
+
     /*! \code
     ioctl(pxa_qcp, VIDIOCCAPTURE, arg);
     \endcode */
@@ -30,6 +30,8 @@
 
 #include "default_parms.h"
 #include "peopledetection.h"
+#include "frame_ring.h"
+#include "spsc_queue.h"
 
 #ifdef PCN_VERSION
 #include "pcn1001.h"
@@ -48,7 +50,23 @@ int file_exists(char *path);
 int Communication(int fd,char *buffer);
 
 /****************  images_fpga  functions ********************************/
-void get_images(unsigned char *orig,int img);
+/*!
+\brief Frame decodificato da decode_frame(), passato dal thread di acquisizione al main_loop().
+*/
+typedef struct
+{
+    unsigned char dx[NN] __attribute__ ((aligned (4)));  //!< Immagine destra (non valida in modalit&agrave; tracking).
+    unsigned char sx[NN] __attribute__ ((aligned (4)));  //!< Immagine sinistra (non valida in modalit&agrave; tracking).
+    unsigned char dsp[NN] __attribute__ ((aligned (4))); //!< Mappa di disparit&agrave;.
+    unsigned char motion[7];     //!< #vm_img e parametri di motion detection (vedi decode_frame()).
+    bool tracking;               //!< Frame acquisito in modalit&agrave; tracking (acq_mode & 0x0100).
+    unsigned long skipped_words; //!< Vedi #decode_skipped_words.
+} tDecodedFrame;
+
+void get_images(const unsigned char *orig,int img);
+void get_disparity_roi(const unsigned char *orig);
+void decode_frame(const unsigned char *orig, const bool i_tracking, tDecodedFrame *df);
+void set_current_frame(const tDecodedFrame *df);
 void get_10bit_image(unsigned short *dest,unsigned char *src);
 int background(char *dest,unsigned short *src);
 int get_8bit_image(unsigned char *dest,unsigned short *src);
@@ -66,7 +84,9 @@ void Disconnect(int *sockfd);
 /****************  loops functions ***************************************/
 void *ping_loop(void *arg);
 void *main_loop(void *fd);
+void *acquisition_loop(void *arg);
 void *record_loop(void *arg);
+void *bkg_writer_loop(void *arg);
 void *input_loop0(void *arg);
 void *input_loop1(void *arg);
 void *ser_loopttyS0(void *arg);
@@ -98,6 +118,9 @@ unsigned short get_parms(char *name);
 int set_parms(char *name,unsigned short value);
 int write_parms(char *name,unsigned short value);
 void record_counters(const unsigned long i_people_in, const unsigned long i_people_out);
+void SaveBkg();
+bool WriteBkg();
+bool LoadBkg();
 void write_output(void);
 void do_nothing(unsigned long value);
 void reset_counters(unsigned long value);
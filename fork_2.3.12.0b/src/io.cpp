@@ -14,6 +14,14 @@
 #include "directives.h"
 #include "peopledetection.h"
 
+#ifdef PCN_VERSION
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 
 // 20100702 eVS door_in e door_out are used only here in this file, so they were moved here
 unsigned long door_in;  //!< Used to locally store the number of incoming people.
@@ -46,6 +54,8 @@ extern int count_enabled;
 extern int inst_height;
 extern int inst_dist;
 extern unsigned char handle_oor;
+extern unsigned char crowd_capacity;
+extern unsigned char processing_decimation;
 extern unsigned char people_dir;
 extern unsigned char limitSx; 
 extern unsigned char limitDx;
@@ -782,7 +792,24 @@ int write_parms(char *name,unsigned short value)
         pthread_mutex_unlock(&mainlock);
         return 0;
     }
+    if(strcmp(name,"crowd_capacity")==0)
+    {    
+        pthread_mutex_lock(&mainlock);
+        crowd_capacity=(unsigned char)value; // applicato da detectAndTrack() appena la scena e' vuota
+        pthread_mutex_unlock(&mainlock);
+        return 0;
+    }
 #endif
+    // anche in main_batch (LOAD_PARAMS), per replicare le sequenze registrate con l'elaborazione decimata
+    if(strcmp(name,"processing_decimation")==0)
+    {
+        if(value<1) value=1;
+        if(value>MAX_PROCESSING_DECIMATION) value=MAX_PROCESSING_DECIMATION;
+        pthread_mutex_lock(&mainlock);
+        processing_decimation=(unsigned char)value;
+        pthread_mutex_unlock(&mainlock);
+        return 0;
+    }
 
     return -1;
 }
@@ -1110,19 +1137,225 @@ void enable_counting(unsigned long value)
 
 
 
+#ifdef PCN_VERSION
+/*! 
+    \brief Coda del file dello sfondo (#bg_filename).
+
+    Il file contiene lo sfondo (#Bkgvec), la deviazione standard (#svec), il valor medio 
+    dello sfondo acquisito (#vm_bkg) e, in fondo, questa struttura. Chi legge il file con il 
+    vecchio formato (fread() dei tre campi, ad esempio main_batch) ignora la coda.
+*/
+typedef struct
+{
+    unsigned long magic;    //!< #BKG_FILE_MAGIC
+    unsigned long version;  //!< #BKG_FILE_VERSION
+    unsigned long checksum; //!< Adler-32 dei dati che precedono la coda
+} tBkgFileTrailer;
+
+#define BKG_FILE_MAGIC   0x474B4250UL  //!< "PBKG"
+#define BKG_FILE_VERSION 1
+
+const int BKG_PAYLOAD_SIZE = sizeof(Bkgvec)+sizeof(svec)+sizeof(vm_bkg); //!< Dimensione dei dati dello sfondo (file nel vecchio formato).
+
+static unsigned char bkg_pending[BKG_PAYLOAD_SIZE];  //!< Ultimo sfondo passato a SaveBkg() e non ancora scritto.
+static unsigned char bkg_writing[BKG_PAYLOAD_SIZE];  //!< Sfondo in scrittura da parte di bkg_writer_loop().
+static bool bkg_pending_valid = false;
+static unsigned long bkg_seq = 0;          //!< Numero progressivo degli sfondi da salvare.
+static unsigned long bkg_written_seq = 0;  //!< Numero progressivo dell'ultimo sfondo scritto su file.
+static pthread_mutex_t bkg_lock = PTHREAD_MUTEX_INITIALIZER;       //!< Protegge #bkg_pending.
+static pthread_cond_t bkg_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t bkg_file_lock = PTHREAD_MUTEX_INITIALIZER;  //!< Serializza le scritture su #bg_filename.
+
+
+static unsigned long _bkg_checksum(const unsigned char* data, int len)
+{
+    unsigned long a = 1, b = 0;
+    while (len > 0)
+    {
+        int n = (len < 5552) ? len : 5552;  // massimo numero di somme senza overflow prima del modulo
+        len -= n;
+        while (n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+
+static void _bkg_pack(unsigned char* o_data)
+{
+    memcpy(o_data, Bkgvec, sizeof(Bkgvec));
+    memcpy(o_data+sizeof(Bkgvec), svec, sizeof(svec));
+    memcpy(o_data+sizeof(Bkgvec)+sizeof(svec), &vm_bkg, sizeof(vm_bkg));
+}
+
+
 /*!
-    \brief Salvataggio sfondo su file binario (#bg_filename).
+    \brief Scrittura atomica del file dello sfondo: i dati vengono scritti in un file temporaneo 
+    che poi sostituisce #bg_filename con rename(), quindi un'interruzione dell'alimentazione 
+    durante la scrittura lascia sempre il file precedente o quello nuovo completo.
     
-    Viene salvato lo sfondo (#Bkgvec), la deviazione standard (#svec) e il valor medio dello sfondo acquisito (#vm_bkg).
+    Va chiamata con #bkg_file_lock acquisito.
+*/
+static bool _bkg_write_file(const unsigned char* i_data)
+{
+    char tmp_filename[sizeof(bg_filename)+8];
+    sprintf(tmp_filename,"%s.tmp",bg_filename);
+
+    tBkgFileTrailer trailer;
+    trailer.magic = BKG_FILE_MAGIC;
+    trailer.version = BKG_FILE_VERSION;
+    trailer.checksum = _bkg_checksum(i_data, BKG_PAYLOAD_SIZE);
+
+    int fd = open(tmp_filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    bool ok = (write(fd, i_data, BKG_PAYLOAD_SIZE) == BKG_PAYLOAD_SIZE) &&
+              (write(fd, &trailer, sizeof(trailer)) == (int)sizeof(trailer)) &&
+              (fsync(fd) == 0);
+    ok = (close(fd) == 0) && ok;
+
+    if (ok)
+        ok = (rename(tmp_filename, bg_filename) == 0);
+    if (!ok)
+        unlink(tmp_filename);
+
+    return ok;
+}
+
+
+/*!
+    \brief Salvataggio sfondo su file binario (#bg_filename) senza attendere la scrittura.
+    
+    Viene fatta una copia dello sfondo (#Bkgvec), della deviazione standard (#svec) e del 
+    valor medio dello sfondo acquisito (#vm_bkg) che viene scritta su flash da bkg_writer_loop(). 
+    Se arrivano pi&ugrave; richieste prima della scrittura viene salvata solo l'ultima.
+    Viene chiamata dal main_loop() (vedi CheckStatic()) che quindi non aspetta mai la scrittura su flash.
 */
-#ifdef PCN_VERSION
 void SaveBkg()
 {
-    FILE *out = fopen(bg_filename,"wb");
-    fwrite(Bkgvec,sizeof(Bkgvec),1,out);
-    fwrite(svec,sizeof(svec),1,out);
-    fwrite(&vm_bkg,sizeof(vm_bkg),1,out);
-    fclose(out);  
+    pthread_mutex_lock(&bkg_lock);
+    _bkg_pack(bkg_pending);
+    bkg_pending_valid = true;
+    ++bkg_seq;
+    pthread_cond_signal(&bkg_cond);
+    pthread_mutex_unlock(&bkg_lock);
+}
+
+
+/*!
+    \brief Salvataggio sfondo su file binario (#bg_filename) attendendo la fine della scrittura.
+    
+    Usata dai comandi che devono trovare il file aggiornato al termine (acquisizione e 
+    cancellazione dello sfondo); un eventuale salvataggio asincrono precedente viene scartato.
+    \return true se il file &egrave; stato scritto.
+*/
+bool WriteBkg()
+{
+    static unsigned char data[BKG_PAYLOAD_SIZE];
+    unsigned long seq;
+
+    pthread_mutex_lock(&bkg_file_lock);
+    pthread_mutex_lock(&bkg_lock);
+    _bkg_pack(data);
+    bkg_pending_valid = false;
+    seq = ++bkg_seq;
+    pthread_mutex_unlock(&bkg_lock);
+
+    bool ok = _bkg_write_file(data);
+    if (ok)
+        bkg_written_seq = seq;
+    pthread_mutex_unlock(&bkg_file_lock);
+
+    return ok;
+}
+
+
+/*!
+    \brief Thread che scrive su flash gli sfondi passati a SaveBkg().
+*/
+void *bkg_writer_loop(void *arg)
+{
+    for (;;)
+    {
+        unsigned long seq;
+
+        pthread_mutex_lock(&bkg_lock);
+        while (!bkg_pending_valid)
+            pthread_cond_wait(&bkg_cond, &bkg_lock);
+        memcpy(bkg_writing, bkg_pending, BKG_PAYLOAD_SIZE);
+        bkg_pending_valid = false;
+        seq = bkg_seq;
+        pthread_mutex_unlock(&bkg_lock);
+
+        pthread_mutex_lock(&bkg_file_lock);
+        if (seq > bkg_written_seq)  // nel frattempo WriteBkg() potrebbe aver scritto uno sfondo piu' recente
+        {
+            if (_bkg_write_file(bkg_writing))
+                bkg_written_seq = seq;
+            else
+                print_log("Error saving background (%s)\n", bg_filename);
+        }
+        pthread_mutex_unlock(&bkg_file_lock);
+    }
+    return NULL;
+}
+
+
+/*!
+    \brief Caricamento dello sfondo da file binario (#bg_filename).
+    
+    Il file viene mappato in memoria e copiato in #Bkgvec, #svec e #vm_bkg. Se il file 
+    contiene la coda (tBkgFileTrailer) vengono controllati versione e checksum, altrimenti 
+    viene accettato solo se ha esattamente la dimensione del vecchio formato.
+    Se il file non &egrave; valido lo sfondo in memoria non viene modificato.
+    \return true se lo sfondo &egrave; stato caricato.
+*/
+bool LoadBkg()
+{
+    struct stat st;
+    bool ok = false;
+
+    int fd = open(bg_filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) == 0 && 
+        (st.st_size == BKG_PAYLOAD_SIZE || st.st_size == BKG_PAYLOAD_SIZE + (int)sizeof(tBkgFileTrailer)))
+    {
+        void* base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED)
+        {
+            const unsigned char* data = (const unsigned char*) base;
+            ok = true;
+            if (st.st_size > BKG_PAYLOAD_SIZE)
+            {
+                tBkgFileTrailer trailer;
+                memcpy(&trailer, data+BKG_PAYLOAD_SIZE, sizeof(trailer));
+                ok = (trailer.magic == BKG_FILE_MAGIC &&
+                      trailer.version == BKG_FILE_VERSION &&
+                      trailer.checksum == _bkg_checksum(data, BKG_PAYLOAD_SIZE));
+            }
+            if (ok)
+            {
+                memcpy(Bkgvec, data, sizeof(Bkgvec));
+                memcpy(svec, data+sizeof(Bkgvec), sizeof(svec));
+                memcpy(&vm_bkg, data+sizeof(Bkgvec)+sizeof(svec), sizeof(vm_bkg));
+            }
+            munmap(base, st.st_size);
+        }
+    }
+    close(fd);
+
+    if (!ok)
+        print_log("Invalid background file (%s)\n", bg_filename);
+
+    return ok;
 }
 
 
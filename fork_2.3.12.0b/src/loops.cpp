@@ -18,6 +18,9 @@ e la chiamata agli algoritmi di detection e tracking delle persone (detectAndTra
 //extern pthread_mutex_t acq_mode_lock; // 20100517 eVS
 
 #include "directives.h"
+#ifdef USE_IDLE_GATING
+#include "blob_tracking.h"  // GetNumTrackedPeople()
+#endif
 
 //////////////////////
 // 20091123 eVS
@@ -64,9 +67,13 @@ e la chiamata agli algoritmi di detection e tracking delle persone (detectAndTra
 extern unsigned char Frame_DX[NN];   //!< Immagine destra a 256 livelli di grigio (#NX*#NY=160*120).
 extern unsigned char Frame_SX[NN];   //!< Immagine sinistra a 256 livelli di grigio (#NX*#NY=160*120).
 extern unsigned char Frame_DSP[NN];  //!< Mappa di disparit&agrave; #NX*#NY=160*120 (16 livelli di disparit&agrave; distribuiti su 256 livelli di grigio).
+extern unsigned long decode_skipped_words; //!< Word del blocco FPGA non lette da get_images() nell'ultimo frame.
 
 inline void autoled_management(const unsigned int i_sx_vm_img, const unsigned int i_dx_vm_img);
 inline bool check_pcn_status(const unsigned int i_sx_vm_img, const unsigned int i_dx_vm_img, const bool i_autoled, unsigned char& o_error_code);
+#ifdef USE_IDLE_GATING
+inline bool idle_gating_skip_frame(const bool i_fpga_boot_done, const int i_count_enabled);
+#endif
 extern unsigned char auto_gain;
 
 void diagnostic_log(void)
@@ -101,6 +108,55 @@ void diagnostic_log(void)
     }
 }
 
+#ifdef USE_FRAME_QUEUE
+/*!
+\brief Coda lock-free dei frame decodificati tra acquisition_loop() (produttore) e main_loop() (consumatore).
+*/
+static SpscQueue<tDecodedFrame, FRAME_QUEUE_LEN> frame_queue;
+static volatile bool acquisition_stop = false; //!< Richiesta di terminazione di acquisition_loop() (scritta dal main_loop()).
+
+/*!
+\brief Thread di acquisizione.
+
+Legge il blocco dati #NX*#NY*4=160*120*4=320*240 dall'FPGA (tramite il ring di frame_ring.h) e lo 
+decodifica direttamente nel prossimo slot della coda #frame_queue con decode_frame(), 
+cosi' un frame elaborato lentamente dal main_loop() non blocca l'acquisizione. 
+Se la coda &egrave; piena il frame appena acquisito viene scartato e contato.
+Viene avviato e fermato dal main_loop().
+*/
+void *acquisition_loop(void *arg)
+{
+    static unsigned char acq_frame[NN << 2]; // usato solo se il ring non e' disponibile
+    const unsigned char *frame;
+    int frame_slot;
+
+    while(!acquisition_stop)
+    {
+        tDecodedFrame *df = frame_queue.write_slot();
+
+        // la lettura dal device non deve sovrapporsi agli ioctl del main_loop() e del comando "smode";
+        // acq_mode_lock non si puo' usare perche' il main_loop() lo tiene per tutta l'elaborazione
+        pthread_mutex_lock(&acq_dev_lock);
+        frame = fr_acquire(frame_slot);
+        if (frame == NULL)
+        {
+            read(pxa_qcp,acq_frame,imagesize);
+            frame = acq_frame;
+        }
+        pthread_mutex_unlock(&acq_dev_lock);
+
+        // acq_mode viene letto senza acq_mode_lock: la lettura di una word e' atomica 
+        // e un frame decodificato col modo precedente e' innocuo
+        decode_frame(frame, (acq_mode & 0x0100) != 0, df);
+        fr_release(frame_slot);
+
+        frame_queue.push();
+    }
+
+    return NULL;
+}
+#endif
+
 /*!
 \brief Ciclo principale di elaborazione.
 
@@ -138,6 +194,10 @@ void*main_loop(void*)
     static unsigned char dx_vm_img = 128; //512; // 20101014 eVS bugfix
     socklen_t addr_len;
     int imgfd;
+#ifndef USE_FRAME_QUEUE
+    const unsigned char *frame; // blocco dati corrente (buffer del ring o #Frame)
+    int frame_slot;             // slot del ring da rilasciare dopo get_images()
+#endif
 
     imgfd = socket(AF_INET,SOCK_DGRAM,0);
     
@@ -223,13 +283,44 @@ void*main_loop(void*)
 #endif    
     
     framecounter = 0; // 20101028 eVS added
+
+#ifdef USE_FRAME_QUEUE
+    frame_queue.reset();
+    acquisition_stop = false;
+    pthread_create(&aqloop, NULL, acquisition_loop, NULL);
+#endif
+
     while(thread_status != MAINLOOP_STOP)
     { 
+#ifdef USE_FRAME_QUEUE
+        // attesa del prossimo frame decodificato da acquisition_loop() (senza tenere acq_mode_lock)
+        tDecodedFrame *df = frame_queue.front();
+        if (df == NULL)
+        {
+            usleep(1000);
+            continue;
+        }
+#endif
+
         pthread_mutex_lock(&acq_mode_lock); // 20100517 eVS
 
-        read(pxa_qcp,Frame,imagesize); // read buffer (160*120*4=320*240) from FPGA
+#ifdef USE_FRAME_QUEUE
+        set_current_frame(df); // Frame_SX, Frame_DX, Frame_DSP, valor medio e motion detection come dopo get_images()
+        frame_queue.pop();
+#else
+        // read buffer (160*120*4=320*240) from FPGA: il ring restituisce il buffer acquisito per puntatore
+        pthread_mutex_lock(&acq_dev_lock); // non durante la lettura di un comando (vedi read_frame() in commands.cpp)
+        frame = fr_acquire(frame_slot);
+        if (frame == NULL)  // ring non disponibile: lettura nel buffer Frame
+        {
+            read(pxa_qcp,Frame,imagesize);
+            frame = Frame;
+        }
+        pthread_mutex_unlock(&acq_dev_lock);
 
-        get_images(Frame,0); // decomposizione del buffer 160*120*4=320*240 precedentemente letto (left img, right img, disparity map, left or right mean value and motion detection output)
+        get_images(frame,0); // decomposizione del buffer 160*120*4=320*240 precedentemente letto (left img, right img, disparity map, left or right mean value and motion detection output)
+        fr_release(frame_slot); // i piani decodificati sono in Frame_SX, Frame_DX e Frame_DSP: lo slot puo' essere riusato
+#endif
 
         // ************ for moving detection **************************************
         mov_det_left = ((((mov_dect_15_23l & 0xff) << 16) | ((mov_dect_8_15l & 0xff) << 8) | (mov_dect_0_7l & 0xff))/100); 
@@ -291,6 +382,7 @@ void*main_loop(void*)
         {
           if(framecounter%2 ==0 && framecounter%40 !=0 && framecounter%38 !=0  && framecounter%42 !=0) // per essere lontani da cambio sensore per vm
           {
+            pthread_mutex_lock(&acq_dev_lock); // calib_write_parms() scrive sul device
             // in base al valor medio della mappa viene aggiornato il valore corrente 
             // della VREF per migliorare la luminosita' dell'immagine
             if((vm_img*4)<512-DELTA_VM)
@@ -341,6 +433,7 @@ void*main_loop(void*)
                     } 
                 }
             }
+            pthread_mutex_unlock(&acq_dev_lock);
           }
         }
         unsigned long counter_in_to_be_sent; // 20111011 eVS, added in order to avoid usage of counter_in in Send
@@ -380,18 +473,31 @@ void*main_loop(void*)
         {
             pthread_mutex_lock(&mainlock); 
 
-            //detectAndTrack(Frame_DSP,people[0],people[1],count_enabled,get_parms("threshold"),get_parms("dir"));
-            detectAndTrack(
-              Frame_DSP,
-              people[0], people[1],
-              count_enabled,
-              get_parms("threshold"),
-              get_parms("dir"),
-              move_det_en
+#ifdef USE_IDLE_GATING
+            const bool skip_detection = idle_gating_skip_frame(FPGA_boot_done, count_enabled);
+#else
+            const bool skip_detection = false;
+#endif
+
+            if (!skip_detection)
+            {
+              //detectAndTrack(Frame_DSP,people[0],people[1],count_enabled,get_parms("threshold"),get_parms("dir"));
+              detectAndTrack(
+                Frame_DSP,
+                people[0], people[1],
+                count_enabled,
+                get_parms("threshold"),
+                get_parms("dir"),
+                move_det_en
 #ifdef USE_NEW_TRACKING
-              , (limit_line_Down-limit_line_Up+1)/4);
+                , (limit_line_Down-limit_line_Up+1)/4);
 #else
-              );
+                );
+#endif
+            }
+#ifdef FRAME_RATE_COMPUTATION
+            else
+              num_fr_not_processed++;
 #endif
             
             people_rec[0] = people[0];
@@ -441,8 +547,14 @@ void*main_loop(void*)
             
             // 20100521 eVS if the time background and counting are enabled
             // every 60 frames try to update the background
-            if(minuti_th!=0 && (framecounter%60==0) && count_enabled==1)
-                FindStaticObj(); 
+            // (the comparison and the update are spread on the next frames by StepStaticObj())
+            if(minuti_th!=0 && count_enabled==1)
+            {
+                if(framecounter%60==0)
+                    FindStaticObj(); 
+                else
+                    StepStaticObj();
+            }
 
             // 20100521 eVs if in wideconfiguration, i.e., (total_sys_number>1), and
             // this sensor is the last of the chain, i.e., (current_sys_number==total_sys_number)
@@ -623,6 +735,10 @@ void*main_loop(void*)
 
                 FILE *fr_file = fopen("/var/neuricam/fps.txt","w"); // create a new file
                 fprintf(fr_file,"fps: %d\n", frame_rate);
+                fprintf(fr_file,"decode skipped words/frame: %lu\n", decode_skipped_words);
+#ifdef USE_FRAME_QUEUE
+                fprintf(fr_file,"frame queue: depth %d/%d, drops %lu\n", frame_queue.depth(), frame_queue.capacity(), frame_queue.drops());
+#endif
                 fclose(fr_file);
             }
                 
@@ -646,7 +762,9 @@ void*main_loop(void*)
                 // switch del sensore di cui osservare il valor medio
                 i2cstruct.reg_addr =  0x15;
                 i2cstruct.reg_value = (sensor & 0x01);   // 0 dx, 1 sx
+                pthread_mutex_lock(&acq_dev_lock);
                 ioctl(pxa_qcp,VIDIOCSI2C,&i2cstruct);
+                pthread_mutex_unlock(&acq_dev_lock);
                 //sensor++; // mi preparo per il prossimo switch
             }
             else if( (framecounter%SWITCH_SENSOR_INTERVAL) == (SWITCH_SENSOR_INTERVAL/4) ) // 10, 50, 90, ecc
@@ -906,6 +1024,11 @@ void*main_loop(void*)
 #endif
     // 20091123 eVS
     //////////////////////
+
+#ifdef USE_FRAME_QUEUE
+    acquisition_stop = true;
+    pthread_join(aqloop, NULL);
+#endif
     
     thread_status = MAINLOOP_STOP;
 
@@ -1543,3 +1666,54 @@ inline bool check_pcn_status(
     return !o_error_code;
 }
 
+
+#ifdef USE_IDLE_GATING
+/*!
+\brief Riduzione dell'elaborazione a scena vuota (motion gating).
+
+Se da almeno #IDLE_ENTER_FRAMES frame non ci sono persone nello storico (vedi GetNumTrackedPeople()), 
+il motion detection dell'FPGA (#mov_det_left e #mov_det_right) &egrave; sotto #move_det_thr 
+e non ci sono eventi porta in corso, allora detectAndTrack() viene chiamata solo 
+un frame ogni #IDLE_FRAME_DECIMATION. Appena c'&egrave; movimento, viene rilevata una persona 
+o cambia lo stato della porta si torna subito ad elaborare tutti i frame.
+
+In wide-gate l'elaborazione non viene mai ridotta perch&eacute; le persone possono arrivare 
+dai dati degli altri sensori; lo stesso vale prima che i dati di motion detection 
+dell'FPGA siano affidabili.
+
+\return true se detectAndTrack() non deve essere chiamata sul frame corrente.
+*/
+inline bool idle_gating_skip_frame(
+    const bool i_fpga_boot_done, //<! [in] true se i dati di motion detection dell'FPGA sono affidabili
+    const int i_count_enabled)   //<! [in] stato corrente della porta (vedi #count_enabled)
+{
+    static unsigned int quiet_frames = 0; // frame consecutivi a scena vuota (saturato a IDLE_ENTER_FRAMES)
+    static unsigned int idle_frames = 0;  // frame in modalita' ridotta
+    static int prev_count_enabled = -1;
+
+    const bool active = !i_fpga_boot_done || 
+                        total_sys_number > 1 ||
+                        mov_det_left > move_det_thr || mov_det_right > move_det_thr ||
+                        ev_door_open || ev_door_close ||
+                        i_count_enabled != prev_count_enabled ||
+                        GetNumTrackedPeople(num_pers) > 0;
+
+    prev_count_enabled = i_count_enabled;
+
+    if (active)
+    {
+        quiet_frames = 0;
+        idle_frames = 0;
+        return false;
+    }
+
+    if (quiet_frames < IDLE_ENTER_FRAMES)
+    {
+        quiet_frames++;
+        return false;
+    }
+
+    idle_frames++;
+    return (idle_frames % IDLE_FRAME_DECIMATION) != 0;
+}
+#endif
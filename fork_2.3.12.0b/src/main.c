@@ -1177,7 +1177,7 @@ main (int argc, char *argv[])
       {        
         int inhi_num = 0;
         int inlo_num = 0;
-        for (int i=0; i<NUM_PERS_SING; i++)
+        for (int i=0; i<num_pers; i++)
         {
           if (inhi)
           {
@@ -20,6 +20,9 @@ le sequenze il cui nome sar&agrave identificato dalla data e dall'ora in cui &eg
 
 #include "imgserver.h"
 #include "blob_detection.h"
+#ifdef ASSIGNMENT_BENCHMARK
+#include "hungarian_method.h"
+#endif
 
 #ifdef USE_NEW_TRACKING
 #include "blob_tracking.h"
@@ -884,6 +887,31 @@ main (int argc, char *argv[])
 
   setbuf(stdout, NULL); // from now on printf is unbuffered
 
+#ifdef MORPH_BENCHMARK
+  return morph_closeopen_benchmark(1000);
+#endif
+
+#ifdef CLUSTERING_BENCHMARK
+  return peaks_clustering_benchmark(200);
+#endif
+
+#ifdef ASSIGNMENT_BENCHMARK
+  return sparse_matching_benchmark(200);
+#endif
+
+#ifdef CROWD_BENCHMARK
+  return crowd_benchmark(2000);
+#endif
+
+#ifdef STATIC_OBJ_TEST
+  return static_obj_test(6000);
+#endif
+
+#ifdef GAUSSIAN_CONV_TEST
+  // mappe casuali, poi ogni frame delle sequenze (vedi sotto)
+  int gauss_mismatches = gaussian_conv_test(200);
+#endif
+
   bool info_memory = false;  // to be set true if one want to load all the sequence in memory
   int ret;
   char* result_file_name = _create_path_file_name();  // ottengo il nome del file che voglio creare
@@ -1130,6 +1158,10 @@ main (int argc, char *argv[])
           cvShowImage("DSP", rgb);
         }
 
+#ifdef GAUSSIAN_CONV_TEST
+        gauss_mismatches += gaussian_conv_check(dsp);
+#endif
+
         detectAndTrack(
           dsp,
           people[0],
@@ -1229,7 +1261,7 @@ main (int argc, char *argv[])
           {        
             int inhi_num = 0;
             int inlo_num = 0;
-            for (int i=0; i<NUM_PERS_SING; i++)
+            for (int i=0; i<num_pers; i++)
             {
               if (inhi)
               {
@@ -1349,6 +1381,11 @@ main (int argc, char *argv[])
       fprintf(fris, "\tAccuratezza seq. %2d = %3.1f%%\n", indx_seq2, 100.0f * (1.0f - err));
     }
 
+#ifdef GAUSSIAN_CONV_TEST
+    printf("\ngaussian_conv_test(): %d confronti con risultati diversi\n", gauss_mismatches);
+    fprintf(fris, "\ngaussian_conv_test(): %d confronti con risultati diversi\n", gauss_mismatches);
+#endif
+
     fclose(fris); // Fine scrittura su file
     ret = FILE_CREATE;
   }
@@ -1415,6 +1452,7 @@ void load_background()
   memset(svec, 0, sizeof(svec));
   //vm_bkg = 0;
 #endif
+  UpdateBkgThreshold();
 }
 
 
@@ -16,142 +16,412 @@
 #endif  /* NOMINMAX */
 
 
-bool _first_gt_second(const unsigned char & first, const unsigned char & second)
+/*
+Dilatazione ed erosione con l'algoritmo di van Herk/Gil-Werman: la riga (o la colonna) viene
+divisa in blocchi lunghi quanto l'elemento strutturante e per ogni blocco si calcolano il
+massimo (minimo) progressivo da sinistra (g) e da destra (h); la finestra centrata in c
+copre al piu' due blocchi e il suo risultato e' op(h[c-radius], g[c+radius]).
+Il costo e' di 3 confronti per pixel indipendentemente dalla dimensione della finestra.
+
+Ai bordi la finestra viene troncata come nella versione originale, cioe' la mappa viene
+estesa con l'elemento neutro dell'operazione (0 per il massimo, 255 per il minimo).
+
+Il passo verticale lavora per righe intere, 4 pixel alla volta in una word a 32 bit.
+*/
+
+static const unsigned int SWAR_H = 0x80808080u;  // bit alto di ogni byte
+static const unsigned int SWAR_L = 0x7f7f7f7fu;  // 7 bit bassi di ogni byte
+
+
+// byte a byte 0xff se a >= b, 0x00 altrimenti
+static inline unsigned int
+_swar_ge_mask(const unsigned int a, const unsigned int b)
 {
-  return (first > second);
+  const unsigned int d = (a | SWAR_H) - (b & SWAR_L);  // bit alto = (a & 0x7f) >= (b & 0x7f), senza prestiti tra i byte
+  const unsigned int ge = ((a & ~b) | (~(a ^ b) & d)) & SWAR_H;
+  return (ge >> 7) * 0xffu;
 }
 
 
-bool _first_lt_second(const unsigned char & first, const unsigned char & second)
+// dilatazione
+struct MorphMax
 {
-  return (first < second);
-}
+  static const unsigned char IDENTITY = 0;
+  static inline unsigned char apply(const unsigned char a, const unsigned char b) { return (a > b) ? a : b; }
+  static inline unsigned int apply4(const unsigned int a, const unsigned int b)
+  {
+    const unsigned int mask = _swar_ge_mask(a, b);
+    return (a & mask) | (b & ~mask);
+  }
+};
 
 
-typedef bool (* func_test) (const unsigned char &, const unsigned char &);
+// erosione
+struct MorphMin
+{
+  static const unsigned char IDENTITY = 255;
+  static inline unsigned char apply(const unsigned char a, const unsigned char b) { return (a < b) ? a : b; }
+  static inline unsigned int apply4(const unsigned int a, const unsigned int b)
+  {
+    const unsigned int mask = _swar_ge_mask(a, b);
+    return (b & mask) | (a & ~mask);
+  }
+};
 
 
-// convolve horizontally
-void _immorphH(const unsigned char * const & map, const int nrows, const int ncols,
-               const int sze_orig, unsigned char * const & mapH)
+// o_row = op(i_row1, i_row2) su nwords word allineate
+template <class Op>
+static inline void
+_row_op(const unsigned int* i_row1, const unsigned int* i_row2, unsigned int* o_row, const int nwords)
 {
-  assert (map != mapH);
-  const func_test _test_passed = (sze_orig > 0) ? _first_gt_second : _first_lt_second;
-  int sze = abs(sze_orig);
-  int radius = sze/2;
+  for (int w=0; w<nwords; ++w)
+    o_row[w] = Op::apply4(i_row1[w], i_row2[w]);
+}
 
-  assert(sze >= 1);
+
+// op sulla finestra di sze pixel di una riga (g e h lunghi MORPH_PADDED(ncols, sze))
+template <class Op>
+static inline void
+_immorph_row(const unsigned char * const row, const int ncols, const int sze,
+             unsigned char * const o_row,
+             unsigned char * const g, unsigned char * const h)
+{
   if (sze == 1)
-    memcpy(mapH, map, ncols*nrows*sizeof(unsigned char));
-  else
   {
-    const unsigned char* ptr_map = map;
-    unsigned char* ptr_mapH = mapH;
+    memcpy(o_row, row, ncols);
+    return;
+  }
 
-    for (int r=0; r<nrows; ++r)
-    {
-      ptr_map = map+r*ncols;
+  const int radius = sze/2;
+  const int npad = MORPH_PADDED(ncols, sze);
 
-      for (int c=0; c<ncols; ++c, ++ptr_map, ++ptr_mapH)
-      {
-        int min_c_radius = min(c, radius);
-
-        *ptr_mapH = *(ptr_map - min_c_radius);
-        assert((ptr_map - min_c_radius) >= map);
-        
-        for (int k = 1-min_c_radius; k <= min(ncols-1-c, radius); ++k)
-        {
-          if (_test_passed(*(ptr_map+k), *ptr_mapH))
-            *ptr_mapH = *(ptr_map+k);
-          assert( (ptr_map+k) < (map + nrows*ncols) );
-        }
-      }
+  // riga estesa con l'elemento neutro (a sinistra di radius pixel, a destra fino a npad) in h,
+  // cosi' i due passi seguenti non hanno test sui bordi
+  memset(h, Op::IDENTITY, radius);
+  memcpy(h+radius, row, ncols);
+  memset(h+radius+ncols, Op::IDENTITY, npad-radius-ncols);
 
-      assert( ptr_map <= map+nrows*ncols );
-      assert( ptr_mapH <= mapH+nrows*ncols );
-    }
+  // g: op progressiva da sinistra all'interno di ogni blocco
+  for (int b=0; b<npad; b+=sze)
+  {
+    unsigned char acc = h[b];
+    g[b] = acc;
+    for (int p=b+1; p<b+sze; ++p)
+      g[p] = acc = Op::apply(acc, h[p]);
   }
+
+  // h: op progressiva da destra all'interno di ogni blocco (in place)
+  for (int b=npad-sze; b>=0; b-=sze)
+  {
+    unsigned char acc = h[b+sze-1];
+    for (int p=b+sze-2; p>=b; --p)
+      h[p] = acc = Op::apply(acc, h[p]);
+  }
+
+  for (int c=0; c<ncols; ++c)
+    o_row[c] = Op::apply(h[c], g[c+sze-1]);
 }
 
 
-// convolve vertically
-void _immorphV(const unsigned char * const & map, const int nrows, const int ncols,
-               const int sze_orig, unsigned char * const & mapV)
+// passo orizzontale: o_map (righe di o_stride byte) = op sulla finestra di sze pixel della riga di map
+template <class Op>
+static void
+_immorphH(const unsigned char * const & map, const int nrows, const int ncols,
+          const int sze, unsigned char * const & o_map, const int o_stride,
+          unsigned char * const & g, unsigned char * const & h)
 {
-  assert (map != mapV);
-  const func_test _test_passed = (sze_orig > 0) ? _first_gt_second : _first_lt_second;
-  int sze = abs(sze_orig);
-  int radius = sze/2;
+  assert(sze >= 1 && (sze%2) != 0);
+
+  for (int r=0; r<nrows; ++r)
+    _immorph_row<Op>(map+r*ncols, ncols, sze, o_map+r*o_stride, g, h);
+}
+
+
+// passo verticale: map = op sulla finestra di sze righe di i_map (righe di stride byte, allineate)
+template <class Op>
+static void
+_immorphV(const unsigned char * const & i_map, const int stride, const int nrows, const int ncols,
+          const int sze, unsigned char * const & map,
+          unsigned char * const & g, unsigned char * const & h, unsigned char * const & line)
+{
+  assert(sze >= 1 && (sze%2) != 0);
+  assert((stride%4) == 0);
+
+  const int nwords = stride/4;
 
-  assert(sze >= 1);
   if (sze == 1)
-    memcpy(mapV, map, ncols*nrows*sizeof(unsigned char));
-  else
   {
-    const unsigned char* ptr_map = map;
-    const unsigned char* tmp;
-    unsigned char* ptr_mapV = mapV;
-
     for (int r=0; r<nrows; ++r)
+      memcpy(map+r*ncols, i_map+r*stride, ncols);
+    return;
+  }
+
+  const int radius = sze/2;
+  const int npad = MORPH_PADDED(nrows, sze);
+
+  // g: op progressiva dall'alto all'interno di ogni blocco di sze righe
+  for (int b=0; b<npad; b+=sze)
+  {
+    for (int p=b; p<b+sze; ++p)
+    {
+      const int r = p-radius;
+      unsigned char* g_row = g+p*stride;
+      if (r < 0 || r >= nrows)
+      {
+        if (p == b)
+          memset(g_row, Op::IDENTITY, stride);
+        else
+          memcpy(g_row, g_row-stride, stride);
+      }
+      else if (p == b)
+        memcpy(g_row, i_map+r*stride, stride);
+      else
+        _row_op<Op>((const unsigned int*)(g_row-stride), (const unsigned int*)(i_map+r*stride), (unsigned int*)g_row, nwords);
+    }
+  }
+
+  // h: op progressiva dal basso all'interno di ogni blocco di sze righe
+  for (int b=npad-sze; b>=0; b-=sze)
+  {
+    for (int p=b+sze-1; p>=b; --p)
     {
-      for (int c=0; c<ncols; ++c, ++ptr_map, ++ptr_mapV)
+      const int r = p-radius;
+      unsigned char* h_row = h+p*stride;
+      if (r < 0 || r >= nrows)
       {
-        int min_r_radius = min(r, radius);
-
-        tmp = ptr_map-min_r_radius*ncols;
-        *ptr_mapV = *tmp;
-        tmp += ncols;
-
-        for (int k = 1-min_r_radius; k <= min(nrows-1-r, radius); ++k)
-        {
-          if (_test_passed(*tmp, *ptr_mapV))
-            *ptr_mapV = *(tmp);
-          assert(tmp < map+nrows*ncols);
-          tmp += ncols; // tmp -> map(r+k, c)
-        }
+        if (p == b+sze-1)
+          memset(h_row, Op::IDENTITY, stride);
+        else
+          memcpy(h_row, h_row+stride, stride);
       }
+      else if (p == b+sze-1)
+        memcpy(h_row, i_map+r*stride, stride);
+      else
+        _row_op<Op>((const unsigned int*)(h_row+stride), (const unsigned int*)(i_map+r*stride), (unsigned int*)h_row, nwords);
     }
   }
+
+  for (int r=0; r<nrows; ++r)
+  {
+    _row_op<Op>((const unsigned int*)(h+r*stride), (const unsigned int*)(g+(r+sze-1)*stride), (unsigned int*)line, nwords);
+    memcpy(map+r*ncols, line, ncols);
+  }
 }
 
 
-void _immorph(unsigned char * const & map, 
-              const int nrows, const int ncols,
-              int sze_h, int sze_v)
+template <class Op>
+static void
+_immorph(unsigned char * const & map,
+         const int nrows, const int ncols,
+         int sze_h, int sze_v,
+         unsigned char * const scratch)
 {
-  assert ( (sze_h%2) != 0);
-  assert(sze_h != 0);
-
-  assert ( (sze_v == 0) || ((sze_v%2) != 0) );
-  assert(sze_h != 0);
+  assert(sze_h > 0 && (sze_h%2) != 0);
+  assert(sze_v >= 0);
+  assert((sze_v == 0) || ((sze_v%2) != 0));
 
   if (sze_v == 0)
     sze_v = sze_h;
 
-  static unsigned char tmp[NN]; // support data statically allocated
+  // support data statically allocated if not provided by the caller (not reentrant)
+  static unsigned char default_scratch[MORPH_SCRATCH_MAX_SIZE(NY, NX, MORPH_MAX_STREL)];
+  unsigned char* buf = scratch;
+  if (buf == NULL)
+  {
+    assert(nrows <= NY && ncols <= NX && sze_h <= MORPH_MAX_STREL && sze_v <= MORPH_MAX_STREL);
+    buf = default_scratch;
+  }
 
-  _immorphH(map, nrows, ncols, sze_h, tmp);
-  _immorphV(tmp, nrows, ncols, sze_v, map);
+  // piani di lavoro allineati a 4 byte
+  const int stride = MORPH_STRIDE(ncols);
+  unsigned char* tmp = buf + ((4 - ((size_t)buf & 3)) & 3);
+  unsigned char* g = tmp + nrows*stride;
+  unsigned char* h = g + MORPH_PADDED(nrows, sze_v)*stride;
+  unsigned char* line = h + MORPH_PADDED(nrows, sze_v)*stride;
+  unsigned char* g_line = line + stride;
+  unsigned char* h_line = g_line + MORPH_PADDED(ncols, sze_h);
+
+  _immorphH<Op>(map, nrows, ncols, sze_h, tmp, stride, g_line, h_line);
+  _immorphV<Op>(tmp, stride, nrows, ncols, sze_v, map, g, h, line);
 }
 
 
-void _imdilate(unsigned char * const & map, 
+void _imdilate(unsigned char * const & map,
                const int nrows, const int ncols,
-               int sze_h, int sze_v)
+               int sze_h, int sze_v,
+               unsigned char * const scratch)
 {
-  assert(sze_h > 0);
-  assert(sze_v >= 0);
-  _immorph(map, nrows, ncols, sze_h, sze_v);
+  _immorph<MorphMax>(map, nrows, ncols, sze_h, sze_v, scratch);
 }
 
 
-void _imerode(unsigned char * const & map, 
+void _imerode(unsigned char * const & map,
               const int nrows, const int ncols,
-              int sze_h, int sze_v)
+              int sze_h, int sze_v,
+              unsigned char * const scratch)
 {
-  assert(sze_h > 0);
-  assert(sze_v >= 0);
-  _immorph(map, nrows, ncols, -sze_h, -sze_v);
+  _immorph<MorphMin>(map, nrows, ncols, sze_h, sze_v, scratch);
+}
+
+
+/*
+Chiusura seguita da apertura in un solo passaggio sulla mappa.
+
+Le quattro operazioni (dilatazione, erosione, erosione, dilatazione) sono stadi di una pipeline
+che procede per righe: ogni stadio filtra orizzontalmente la riga ricevuta e la conserva in un
+buffer circolare di sze_v righe; la riga r in uscita e' pronta appena lo stadio ha ricevuto la
+riga min(nrows-1, r+sze_v/2) e viene passata subito allo stadio successivo.
+Le righe dell'ultimo stadio vengono scritte in place: la riga r viene scritta solo dopo che il
+primo stadio ha letto la riga r.
+I buffer circolari occupano al piu' qualche KB (restano in cache) e la mappa viene letta e
+scritta una volta sola invece delle 8 passate (con i relativi piani di lavoro) delle operazioni
+in sequenza; il confronto dei tempi e' in morph_closeopen_benchmark() (blob_detection.cpp).
+*/
+
+typedef struct _MorphStage {
+  bool dilate;           // MorphMax o MorphMin
+  int sze_h, sze_v;
+  int received;          // righe ricevute
+  int emitted;           // righe prodotte
+  int slot;              // posizione nel buffer circolare della prossima riga ricevuta
+  unsigned char* ring;   // ultime sze_v righe filtrate orizzontalmente (righe di stride byte)
+  unsigned char* line;   // riga in uscita (stride byte)
+} tMorphStage;
+
+
+template <class Op>
+static inline void
+_stage_push(tMorphStage & s, const unsigned char * const row, const int ncols, const int stride,
+            unsigned char * const g, unsigned char * const h)
+{
+  _immorph_row<Op>(row, ncols, s.sze_h, s.ring+s.slot*stride, g, h);
+  ++s.received;
+  if (++s.slot == s.sze_v)
+    s.slot = 0;
+}
+
+
+// produce in s.line la prossima riga dello stadio, false se non e' ancora pronta
+template <class Op>
+static inline bool
+_stage_pop(tMorphStage & s, const int nrows, const int stride)
+{
+  const int r = s.emitted;
+  const int radius = s.sze_v/2;
+  const int last = min(nrows-1, r+radius);
+  if (r >= nrows || s.received <= last)
+    return false;
+
+  // le righe pronte sono sempre le ultime ricevute (last == received-1): si va a ritroso da slot
+  const unsigned int* rows[MORPH_MAX_STREL];
+  const int n = last - max(0, r-radius) + 1;
+  int slot = s.slot;
+  for (int i=0; i<n; ++i)
+  {
+    slot = (slot == 0) ? s.sze_v-1 : slot-1;
+    rows[i] = (const unsigned int*)(s.ring+slot*stride);
+  }
+
+  // ogni word viene accumulata in un registro su tutte le righe della finestra
+  unsigned int* const line = (unsigned int*)s.line;
+  const int nwords = stride/4;
+  for (int w=0; w<nwords; ++w)
+  {
+    unsigned int acc = rows[0][w];
+    for (int i=1; i<n; ++i)
+      acc = Op::apply4(acc, rows[i][w]);
+    line[w] = acc;
+  }
+
+  ++s.emitted;
+  return true;
 }
 
 
+/*
+Passa una riga allo stadio k e ogni riga che diventa pronta allo stadio successivo, prima di
+produrne un'altra: il buffer circolare di uno stadio non riceve mai piu' righe di quante
+ne possa contenere, anche quando alla fine della mappa gli stadi si svuotano.
+L'ultimo stadio scrive le sue righe in map.
+*/
+static void
+_stage_feed(tMorphStage * const stages, const int k, const int nstages,
+            const unsigned char * const row,
+            unsigned char * const map, const int nrows, const int ncols, const int stride,
+            unsigned char * const g, unsigned char * const h)
+{
+  tMorphStage & s = stages[k];
+  if (s.dilate)
+    _stage_push<MorphMax>(s, row, ncols, stride, g, h);
+  else
+    _stage_push<MorphMin>(s, row, ncols, stride, g, h);
+
+  while (s.dilate ? _stage_pop<MorphMax>(s, nrows, stride) : _stage_pop<MorphMin>(s, nrows, stride))
+  {
+    if (k == nstages-1)
+      memcpy(map+(s.emitted-1)*ncols, s.line, ncols);
+    else
+      _stage_feed(stages, k+1, nstages, s.line, map, nrows, ncols, stride, g, h);
+  }
+}
+
+
+void _imcloseopen(unsigned char * const & map,
+                  const int nrows, const int ncols,
+                  int close_h, int close_v,
+                  int open_h, int open_v,
+                  unsigned char * const scratch)
+{
+  assert(close_h >= 0 && close_v >= 0 && open_h >= 0 && open_v >= 0);
+
+  if (close_v == 0)
+    close_v = close_h;
+  if (open_v == 0)
+    open_v = open_h;
+
+  // support data statically allocated if not provided by the caller (not reentrant)
+  static unsigned char default_scratch[MORPH_CLOSEOPEN_SCRATCH_SIZE(NX, MORPH_MAX_STREL)];
+  unsigned char* buf = scratch;
+  if (buf == NULL)
+  {
+    assert(ncols <= NX && max(close_h, close_v) <= MORPH_MAX_STREL && max(open_h, open_v) <= MORPH_MAX_STREL);
+    buf = default_scratch;
+  }
+
+  const int stride = MORPH_STRIDE(ncols);
+  unsigned char* ptr = buf + ((4 - ((size_t)buf & 3)) & 3);
+
+  // stadi attivi (dimensione 0 = operazione non eseguita)
+  tMorphStage stages[4];
+  int nstages = 0;
+  const bool dilate[4] = {true, false, false, true};
+  const int sze_h[4] = {close_h, close_h, open_h, open_h};
+  const int sze_v[4] = {close_v, close_v, open_v, open_v};
+  int max_padded = 1;
+  for (int k=0; k<4; ++k)
+  {
+    if (sze_h[k] == 0)
+      continue;
+    assert((sze_h[k]%2) != 0 && (sze_v[k]%2) != 0 && sze_v[k] <= MORPH_MAX_STREL);
+    tMorphStage & s = stages[nstages++];
+    s.dilate = dilate[k];
+    s.sze_h = sze_h[k];
+    s.sze_v = sze_v[k];
+    s.received = s.emitted = s.slot = 0;
+    s.ring = ptr;
+    ptr += s.sze_v*stride;
+    s.line = ptr;
+    ptr += stride;
+    max_padded = max(max_padded, MORPH_PADDED(ncols, s.sze_h));
+  }
+  if (nstages == 0)
+    return;
+
+  unsigned char* g_line = ptr;
+  unsigned char* h_line = g_line + max_padded;
+
+  for (int r=0; r<nrows; ++r)
+    _stage_feed(stages, 0, nstages, map+r*ncols, map, nrows, ncols, stride, g_line, h_line);
+
+  assert(stages[nstages-1].emitted == nrows);
+}
@@ -1,14 +1,47 @@
 #ifndef __MORPHOLOGY__
 #define __MORPHOLOGY__
 
+#include <stddef.h>
 #include "peopledetection.h"
 
-void _imerode(unsigned char * const & map, 
+/*!
+Dimensione (in byte) del buffer di lavoro che il chiamante pu&ograve; passare a _imdilate() e _imerode()
+per una mappa nrows x ncols ed elementi strutturanti sze_h x sze_v (dimensioni dispari, positive).
+Le righe dei piani di lavoro sono allineate a 4 byte; il buffer pu&ograve; avere un allineamento qualsiasi.
+*/
+#define MORPH_STRIDE(ncols) (((ncols)+3) & ~3)
+#define MORPH_PADDED(n, sze) ((((n)+2*((sze)-1))/(sze))*(sze))
+#define MORPH_SCRATCH_SIZE(nrows, ncols, sze_h, sze_v) \
+  (MORPH_STRIDE(ncols)*((nrows) + 2*MORPH_PADDED(nrows, sze_v) + 1) + 2*MORPH_PADDED(ncols, sze_h) + 4)
+/*! Maggiorante di MORPH_SCRATCH_SIZE() per tutti gli elementi strutturanti fino a max_sze x max_sze (per i buffer statici). */
+#define MORPH_SCRATCH_MAX_SIZE(nrows, ncols, max_sze) \
+  (MORPH_STRIDE(ncols)*((nrows) + 2*((nrows)+2*((max_sze)-1)) + 1) + 2*((ncols)+2*((max_sze)-1)) + 4)
+
+/*! Dimensione del buffer di lavoro di _imcloseopen() per righe di ncols pixel ed elementi strutturanti fino a max_sze x max_sze. */
+#define MORPH_CLOSEOPEN_SCRATCH_SIZE(ncols, max_sze) \
+  (MORPH_STRIDE(ncols)*(4*(max_sze) + 4) + 2*((ncols)+2*((max_sze)-1)) + 4)
+
+const int MORPH_MAX_STREL = 31; //!< Elemento strutturante massimo supportato senza buffer del chiamante.
+
+void _imerode(unsigned char * const & map,
               const int nrows, const int ncols,
-              int sze_h = 3, int sze_v = 0);
+              int sze_h = 3, int sze_v = 0,
+              unsigned char * const scratch = NULL);
 
-void _imdilate(unsigned char * const & map, 
+void _imdilate(unsigned char * const & map,
                const int nrows, const int ncols,
-               int sze_h = 3, int sze_v = 0);
+               int sze_h = 3, int sze_v = 0,
+               unsigned char * const scratch = NULL);
+
+/*!
+Chiusura (close_h x close_v) seguita da apertura (open_h x open_v) in un solo passaggio sulla mappa,
+con lo stesso risultato di _imdilate(), _imerode(), _imerode(), _imdilate() in sequenza.
+Una dimensione orizzontale nulla disabilita la rispettiva operazione.
+*/
+void _imcloseopen(unsigned char * const & map,
+                  const int nrows, const int ncols,
+                  int close_h, int close_v,
+                  int open_h, int open_v,
+                  unsigned char * const scratch = NULL);
 
 #endif
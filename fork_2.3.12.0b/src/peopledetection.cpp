@@ -101,6 +101,12 @@ presenti pi&ugrave; persone. */
 #include "time.h"
 #endif
 
+#ifdef __GNUC__
+#  define BKG_ALIGN4 __attribute__ ((aligned (4)))  //!< Allineamento a word dei piani usati da image_binning_bg_subtraction().
+#else
+#  define BKG_ALIGN4
+#endif
+
 #if defined(USE_NEW_TRACKING) && !defined(PCN_VERSION)
 bool reset = false;
 #endif
@@ -120,7 +126,7 @@ void drawtrack(unsigned char *img);
 extern void SaveBkg();
 #endif
 
-unsigned char Bkgvec[NN]; //!< Vettore di elementi che contiene lo sfondo.
+unsigned char Bkgvec[NN] BKG_ALIGN4; //!< Vettore di elementi che contiene lo sfondo.
 //unsigned char Pasvec[NN]; //< Vettore di elementi che contiene la mappa di disparit&agrave; elaborata.
 //unsigned char min_m; //!< ???
 
@@ -128,7 +134,7 @@ unsigned char Bkgvec[NN]; //!< Vettore di elementi che contiene lo sfondo.
 \var disparityMapOriginal
 \brief Vettore di elementi che contiene la mappa di disparit&agrave; originale prima del processing fatto in detectAndTrack().
 */
-unsigned char disparityMapOriginal[NN];
+unsigned char disparityMapOriginal[NN] BKG_ALIGN4;
 
 /*!
 \var Bkgvectmp
@@ -225,6 +231,15 @@ int svec[NN];
 */
 int svectmp[NN];
 
+/*!
+\var BkgThr
+\brief Soglia per la sottrazione dello sfondo derivata da #Bkgvec e #svec (vedi UpdateBkgThreshold()).
+
+Un pixel della mappa di disparit&agrave; viene mantenuto se &egrave; strettamente maggiore 
+della soglia oppure se vale #UNIFORM_ZONE_OR_DISP_1, altrimenti viene spento.
+*/
+unsigned char BkgThr[NN] BKG_ALIGN4;
+
 
 /*!
 \var numFrameClean
@@ -360,6 +375,34 @@ int inst_dist = INST_DIST;
 */
 unsigned char handle_oor = HANDLE_OOR; // 20130715 eVS
 
+/*!
+\var crowd_capacity
+\brief Numero massimo di persone rilevate e tracciate da ogni sensore (da #NUM_PERS_SING a #MAX_PERS_SING, 
+default #CROWD_CAPACITY). Valori alti servono per le porte larghe molto affollate (es. stazioni) ma aumentano
+il tempo di elaborazione per frame (vedi #CROWD_BENCHMARK in directives.h). Un nuovo valore viene applicato 
+appena la scena &egrave; vuota (vedi SetTrackingCapacity()).
+
+Attenzione: che 40 persone per sensore stiano nei 18 ms di un frame sul target (XScale) non &egrave; stato misurato, 
+ci sono solo i tempi sull'host di crowd_benchmark(). Per questo il default resta #NUM_PERS_SING: valori pi&ugrave; 
+alti vanno verificati sul target prima dell'installazione.
+*/
+unsigned char crowd_capacity = CROWD_CAPACITY;
+
+/*!
+\var processing_decimation
+\brief detectAndTrack() elabora un frame ogni processing_decimation (da 1 a #MAX_PROCESSING_DECIMATION, default 
+#PROCESSING_DECIMATION): il tracking compensa i frame saltati con la velocit&agrave; stimata dei blob. Con 2 si 
+dimezza il carico dei sensori pi&ugrave; impegnati (master del widegate, registrazione in corso).
+*/
+unsigned char processing_decimation = PROCESSING_DECIMATION;
+
+/*!
+\var WG_PERS_PER_PACKET
+\brief Persone per sensore trasmesse al master in widegate (il pacchetto #persdata &egrave; lungo 54 bytes
+indipendentemente da #crowd_capacity).
+*/
+static const int WG_PERS_PER_PACKET = NUM_PERS_SING;
+
 static const int NUMBER_OF_FRAMES_BEFORE_OOR_CKECK = 5*54;
 
 /*!
@@ -407,6 +450,15 @@ sia maggiore della soglia.
 */
 //int framecounter_bkg=0;  //??? DEFINITA MA NON UTILIZZATA ???
 ogg_static BkgStatic;      //!< E' una struttura dati che contiene lo sfondo statico, la deviazione standard dello sfondo e l'istante di acquisizione.
+
+#if defined(PCN_VERSION) || defined(STATIC_OBJ_TEST)
+#define STATIC_TILE_ROWS 8 //!< Numero di righe della mappa elaborate ad ogni frame da StepStaticObj().
+
+static unsigned char StaticSnapshot[NN]; //!< Mappa di disparit&agrave; acquisita da FindStaticObj() ed elaborata a blocchi da StepStaticObj().
+static int static_count_row = NY;  //!< Prossima riga da confrontare con lo sfondo statico (#NY se il confronto non &egrave; in corso).
+static int static_update_row = NY; //!< Prossima riga da aggiornare nello sfondo statico (#NY se l'aggiornamento non &egrave; in corso).
+static int static_count = 0;       //!< Numero di pixel diversi dallo sfondo statico trovati fino ad ora.
+#endif
 #endif
 
 bool ev_door_open=false;     //!< Evento di porta appena aperta.
@@ -528,12 +580,12 @@ unsigned char mov_dect_15_23r;
 
 Di default viene settata a #NUM_PERS_SING, ovvero non possono essere trovate pi&ugrave; di #NUM_PERS_SING persone nella scena).
 Si noti che in base alla configurazione del PCN (standalone o widegate) il numero massimo di persone
-cambia in in base: se standalone e' pari al default #NUM_PERS_SING ma se in widegate allora
-ogni sensore puo' vedere al piu' #NUM_PERS_SING persone e quindi il numero massimo di 
-persone persone individuabili e' #NUM_PERS_SING*#total_sys_number.
+cambia in in base: se standalone e' pari a #crowd_capacity (default #NUM_PERS_SING) ma se in widegate allora
+ogni sensore puo' vedere al piu' GetTrackingCapacity() persone e quindi il numero massimo di 
+persone persone individuabili e' GetTrackingCapacity()*#total_sys_number (mai oltre #MAX_NUM_PERS).
 
-Questa variabile e' usata in initpeople() per l'allocazione della memoria delle strutture 
-dati #inhi e #inlo usate per il tracking e in detectAndTrack() per le strutture dati usate per 
+Questa variabile e' usata in initpeople() e track() per la lunghezza delle liste
+#inhi e #inlo usate per il tracking e in detectAndTrack() per le strutture dati usate per 
 la detection (dimpers, hpers, and people_coor).
 
 */
@@ -630,11 +682,19 @@ void SetBkgThreshold(unsigned char soglia)
 #ifdef time_bkg
 
 
+#ifdef STATIC_OBJ_TEST
+static int static_test_min = -1;  //!< Minuti simulati restituiti da GetMin() durante static_obj_test() (-1: orologio di sistema).
+#endif
+
 /*!
 \brief Torna data e ora espresse in minuti.
 */
 unsigned char GetMin()
 {
+#ifdef STATIC_OBJ_TEST
+  if (static_test_min >= 0)
+    return (unsigned char)static_test_min;
+#endif
   time_t timer;
   unsigned char minuti;
   struct tm *tblock;
@@ -647,6 +707,61 @@ unsigned char GetMin()
 }
 
 
+/*!
+\brief Ricalcola la soglia #BkgThr usata per la sottrazione dello sfondo.
+
+Va chiamata ogni volta che cambiano #Bkgvec o #svec (caricamento da file, acquisizione 
+dello sfondo, CheckStatic()). La condizione originale della sottrazione dello sfondo
+\code
+if ((map <= MIN_M || (map - Bkgvec[i]) < 3*svec[i]) && map != UNIFORM_ZONE_OR_DISP_1) map = 0;
+\endcode
+equivale a spegnere il pixel se map <= BkgThr[i] con
+\verbatim
+BkgThr[i] = min(255, max(MIN_M, Bkgvec[i] + 3*svec[i] - 1))
+\endverbatim
+(la saturazione a 255 &egrave; esatta perch&eacute; map non pu&ograve; superare 255).
+In questo modo detectAndTrack() legge un solo byte per pixel invece del byte di 
+#Bkgvec e dell'intero di #svec.
+*/
+void UpdateBkgThreshold()
+{
+  for (int i=NN-1; i>=0; --i)
+  {
+    const int thr = (int)Bkgvec[i] + 3*svec[i] - 1;
+    BkgThr[i] = (thr <= MIN_M) ? MIN_M : ((thr >= 255) ? 255 : (unsigned char)thr);
+  }
+}
+
+
+#if defined(PCN_VERSION) || defined(STATIC_OBJ_TEST)
+/*!
+\brief Radice quadrata intera (troncata) calcolata bit a bit, senza virgola mobile.
+
+D&agrave; lo stesso risultato di (int)sqrt((float)x) per i valori usati nell'aggiornamento 
+dello sfondo statico (x <= 255*255) ma non richiede l'emulazione software della virgola mobile.
+*/
+static int isqrt(unsigned int x)
+{
+  unsigned int res = 0;
+  unsigned int bit = 1u << 30;
+  while (bit > x)
+    bit >>= 2;
+  while (bit != 0)
+  {
+    if (x >= res + bit)
+    {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    }
+    else
+      res >>= 1;
+    bit >>= 2;
+  }
+  return (int)res;
+}
+#endif
+
+
 /*!
 \brief Controlla se il background usato per la sottrazione dello sfondo pu&ograve; essere aggiornato.
 
@@ -662,7 +777,7 @@ L'aggiornamento viene fatto sia in memoria, aggiornando le variabili
 Prima di concludere, deve re-inizializzare la struttura dati #BkgStatic con InitStaticObj() per prepararla
 ad essere elaborata per i prossimi #minuti_th minuti.
 */
-#ifdef PCN_VERSION
+#if defined(PCN_VERSION) || defined(STATIC_OBJ_TEST)
 void CheckStatic()
 {
   //controlla se una persona statica puo' essere cancellata
@@ -695,7 +810,10 @@ void CheckStatic()
     for(int h=NN-1;h>=0;h--) svec[h]= BkgStatic.svec[h];//la setto d'ufficio ad un livello poi si autoaggiorna da sola
     memcpy(Bkgvec,BkgStatic.BkgTmpStatic,NN);
     memcpy(Bkgvectmp,BkgStatic.BkgTmpStatic,NN);//sincronizza l'altro aggio di bkg
+    UpdateBkgThreshold();
+#ifdef PCN_VERSION
     SaveBkg();
+#endif
 #ifdef debug_
     printf("Bkg aggiornato per tempo minuti=%d min_ferma=%d minuti_th=%d\n",minuti,min_ferma,minuti_th);
 #endif
@@ -708,17 +826,15 @@ void CheckStatic()
 \brief Inizializza le strutture dati per il mantenimento del background.
 
 Lo sfondo statico (#BkgStatic.%BkgTmpStatic) viene inizializzato con la mappa di
-disparit&agrave; acquisita e la deviazione standard dei singoli pixel (#BkgStatic.%svec) 
+disparit&agrave; acquisita da FindStaticObj() e la deviazione standard dei singoli pixel (#BkgStatic.%svec) 
 viene posta a zero. Inoltre, memorizzo una informazione su data e ora di 
 inizializzazione (#BkgStatic.%min).
 */
 void InitStaticObj()
 {
-  for(int i=NN-1;i>=0;i--)
-  {
-    BkgStatic.BkgTmpStatic[i]=disparityMapOriginal[i];
-    BkgStatic.svec[i]=0;
-  }
+  static_count_row = static_update_row = NY;  // eventuale elaborazione in corso annullata
+  memcpy(BkgStatic.BkgTmpStatic,StaticSnapshot,NN);
+  memset(BkgStatic.svec,0,sizeof(BkgStatic.svec));
   BkgStatic.min=GetMin();
 #ifdef debug_
   printf("Inizializzazione completa, minuti %d \n",BkgStatic.min);
@@ -743,12 +859,16 @@ con la mappa di disparit&agrave; attuale solo quando essa &egrave; simile al
 background statico attualmente in memoria. 
 
 L'aggiornamento dall'istante i all'istante i+1 avviene come media 
-pesata nel seguente modo:
+pesata nel seguente modo (tutto in aritmetica intera, vedi isqrt()):
 \verbatim
 BkgTmpStatic(i+1) = (15*BkgTmpStatic(i) + disparityMapOriginal(i))/16
-svec(i+1) = sqrt[15*svec(i)^2 + (BkgTmpStatic(i) - disparityMapOriginal(i))^2]
+svec(i+1) = sqrt[15*svec(i)^2 + (BkgTmpStatic(i+1) - disparityMapOriginal(i))^2]
 \endverbatim
 
+Per non concentrare il costo in un solo frame, FindStaticObj() memorizza solo 
+la mappa corrente in #StaticSnapshot: il confronto e l'aggiornamento vengono poi fatti 
+da StepStaticObj() #STATIC_TILE_ROWS righe alla volta nei frame successivi.
+
 L'aggiornamento &egrave; poi seguito da una fase di controllo. La funzione
 CheckStatic() &egrave; legata alle continue re-inizializzazioni del background
 statico fatte con InitStaticObj(). Infatti, queste re-inizializzazioni
@@ -768,10 +888,12 @@ disco) con quello in #BkgStatic.%BkgTmpStatic e #BkgStatic.%svec.
 */
 void FindStaticObj() //int *people,int person
 {
-  //rivedere puntatori
-  unsigned char *bkgvec,*disvec;
-  int count=0;
-  int r2;
+  // completo l'eventuale elaborazione rimasta in sospeso (conteggio disabilitato nel frattempo)
+  while (static_count_row < NY || static_update_row < NY)
+    StepStaticObj();
+
+  memcpy(StaticSnapshot,disparityMapOriginal,NN);
+
   if(BkgStatic.min==255)
   {
 #ifdef debug_
@@ -780,33 +902,238 @@ void FindStaticObj() //int *people,int person
     InitStaticObj();
     return;
   }
-  for(int i=17912;i>=1288;i--)
+
+  static_count = 0;
+  static_count_row = 0;
+}
+
+
+/*!
+\brief Esegue un passo del confronto o dell'aggiornamento del background statico iniziato da FindStaticObj().
+
+Ad ogni chiamata vengono elaborate #STATIC_TILE_ROWS righe di #StaticSnapshot: prima si contano 
+i pixel diversi dallo sfondo statico (solo nell'intervallo di indici 1288..17912, come in origine) 
+e, completato il conteggio, si decide se aggiornare lo sfondo statico o re-inizializzarlo; 
+nel primo caso nei frame successivi viene aggiornato lo sfondo e, all'ultima riga, viene chiamata CheckStatic().
+*/
+void StepStaticObj()
+{
+  if(BkgStatic.min==255)  // struttura da re-inizializzare (vedi SetStaticTh())
   {
-    if(abs(BkgStatic.BkgTmpStatic[i]-disparityMapOriginal[i])>16) count++;
+    static_count_row = static_update_row = NY;
+    return;
   }
-  if (count < static_th) 
+
+  if (static_count_row < NY)
   {
+    const int last_row = min(NY, static_count_row+STATIC_TILE_ROWS);
+    const int first = max(1288, static_count_row*NX);
+    const int last = min(17912, last_row*NX-1);
+    for(int i=first;i<=last;i++)
+    {
+      if(abs(BkgStatic.BkgTmpStatic[i]-StaticSnapshot[i])>16) static_count++;
+    }
+    static_count_row = last_row;
 
-    for(int y2=0;y2<NY;y2++)for(int x2=0;x2<NX;x2++)
+    if (static_count_row == NY)
     {
-      r2=y2*NX+x2;
-      disvec = &disparityMapOriginal[r2];
-      bkgvec = &BkgStatic.BkgTmpStatic[r2];
-      if(*disvec > 0 || BkgStatic.svec[r2]>0)
+      if (static_count < static_th)
+        static_update_row = 0;
+      else
+        InitStaticObj();
+    }
+  }
+  else if (static_update_row < NY)
+  {
+    const int last_row = min(NY, static_update_row+STATIC_TILE_ROWS);
+    const unsigned char* disvec = &StaticSnapshot[static_update_row*NX];
+    unsigned char* bkgvec = &BkgStatic.BkgTmpStatic[static_update_row*NX];
+    int* ptr_svec = &BkgStatic.svec[static_update_row*NX];
+    for (int i=(last_row-static_update_row)*NX; i>0; --i, ++disvec, ++bkgvec, ++ptr_svec)
+    {
+      if(*disvec > 0 || *ptr_svec>0)
       {
         *bkgvec=(15*(*bkgvec)+(*disvec)) >> 4;
-        BkgStatic.svec[r2]=((int)sqrt((float)((15*BkgStatic.svec[r2]*BkgStatic.svec[r2]+(*disvec-*bkgvec)*(*disvec-*bkgvec)) >> 4)));
+        const int diff = *disvec-*bkgvec;
+        *ptr_svec=isqrt((15*(*ptr_svec)*(*ptr_svec)+diff*diff) >> 4);
       }
-    } 
-    CheckStatic();
+    }
+    static_update_row = last_row;
+
+    if (static_update_row == NY)
+      CheckStatic();
+  }
+}
+
+
+#ifdef STATIC_OBJ_TEST
+/*!
+\struct tStaticRef
+\brief Stato dell'aggiornamento originale (non a blocchi) dello sfondo statico usato da static_obj_test().
+*/
+typedef struct
+{
+  ogg_static bs;              ///< come #BkgStatic
+  unsigned char bkgvec[NN];   ///< come #Bkgvec
+  int svec[NN];               ///< come #svec
+  int updates;                ///< aggiornamenti dello sfondo fatti da CheckStatic()
+  int inits;                  ///< re-inizializzazioni dello sfondo statico (InitStaticObj())
+} tStaticRef;
+
+static void _ref_init_static(tStaticRef & ref, const unsigned char* const map)
+{
+  memcpy(ref.bs.BkgTmpStatic, map, NN);
+  memset(ref.bs.svec, 0, sizeof(ref.bs.svec));
+  ref.bs.min = GetMin();
+  ref.inits++;
+}
+
+// CheckStatic() originale
+static void _ref_check_static(tStaticRef & ref, const unsigned char* const map)
+{
+  const unsigned char minuti = GetMin();
+  const unsigned char min_ferma = ref.bs.min;
+  const bool aggiorna = (min_ferma > minuti) ? ((60-min_ferma + minuti) >= minuti_th) : ((minuti-min_ferma) >= minuti_th);
+  if (aggiorna)
+  {
+    for (int h=NN-1; h>=0; h--) ref.svec[h] = ref.bs.svec[h];
+    memcpy(ref.bkgvec, ref.bs.BkgTmpStatic, NN);
+    ref.updates++;
+    _ref_init_static(ref, map);
+  }
+}
+
+// FindStaticObj() originale: confronto e aggiornamento di tutta la mappa in una sola chiamata
+static void _ref_find_static_obj(tStaticRef & ref, const unsigned char* const map)
+{
+  if (ref.bs.min == 255)
+  {
+    _ref_init_static(ref, map);
+    return;
+  }
+  int count = 0;
+  for (int i=17912; i>=1288; i--)
+  {
+    if (abs(ref.bs.BkgTmpStatic[i]-map[i]) > 16) count++;
+  }
+  if (count < static_th)
+  {
+    for (int r2=0; r2<NN; r2++)
+    {
+      const unsigned char* disvec = &map[r2];
+      unsigned char* bkgvec = &ref.bs.BkgTmpStatic[r2];
+      if (*disvec > 0 || ref.bs.svec[r2] > 0)
+      {
+        *bkgvec = (15*(*bkgvec)+(*disvec)) >> 4;
+        ref.bs.svec[r2] = ((int)sqrt((float)((15*ref.bs.svec[r2]*ref.bs.svec[r2]+(*disvec-*bkgvec)*(*disvec-*bkgvec)) >> 4)));
+      }
+    }
+    _ref_check_static(ref, map);
   }
   else
   {
-    InitStaticObj();
+    _ref_init_static(ref, map);
   }
+}
+
+
+/*!
+\brief Replica di una sequenza sintetica con un oggetto statico: confronta FindStaticObj()/StepStaticObj()
+con l'aggiornamento originale in un solo frame.
+
+La sequenza (pavimento con rumore, persone che passano, un oggetto che compare e resta fermo, 
+una folla che costringe a re-inizializzare lo sfondo statico) viene elaborata come nel main_loop(): 
+FindStaticObj() ogni 60 frame e StepStaticObj() negli altri. Al termine di ogni periodo lo sfondo statico, 
+#Bkgvec e #svec devono coincidere con quelli del riferimento, e alla fine l'oggetto deve far parte dello sfondo.
+I minuti di GetMin() sono simulati (un minuto ogni 600 frame).
+\return numero di periodi con risultati diversi (0 se il test &egrave; superato)
+*/
+int static_obj_test(const int frames)
+{
+  static tStaticRef ref;
+  const int FRAMES_PER_MIN = 600;  // multiplo di 60: il confine tra i minuti cade sempre all'inizio di un periodo
+  const int OBJ_START = 900;       // frame in cui compare l'oggetto statico
+  const int CROWD_START = 2100;    // frame della folla (troppi pixel diversi: re-inizializzazione)
+  const unsigned char OBJ_DISP = 150;
+
+  memset(&ref, 0, sizeof(ref));
+  SetStaticTh(1000);
+  SetMinBkgTh(2);
+  ref.bs.min = 255;
+  memset(Bkgvec, 0, sizeof(Bkgvec));
+  memset(svec, 0, sizeof(svec));
+  UpdateBkgThreshold();
+
+  int mismatches = 0;
+  int periods = 0;
+  srand(1);
+  for (int f=0; f<frames; ++f)
+  {
+    static_test_min = (f/FRAMES_PER_MIN) % 60;
+
+    // mappa sintetica
+    for (int i=0; i<NN; ++i)
+      disparityMapOriginal[i] = ((rand() & 255) == 0) ? 0 : (unsigned char)(40 + (rand() & 3));
+    if (f >= OBJ_START)
+    {
+      for (int y=30; y<70; ++y)
+        for (int x=40; x<80; ++x)
+          disparityMapOriginal[y*NX+x] = (unsigned char)(OBJ_DISP + (rand() & 1));
+    }
+    if ((f/90) & 1)  // una persona che attraversa la scena ogni tanto
+    {
+      const int py = (f*3) % (NY-20);
+      for (int y=py; y<py+20; ++y)
+        for (int x=100; x<120; ++x)
+          disparityMapOriginal[y*NX+x] = 200;
+    }
+    if (f >= CROWD_START && f < CROWD_START+120)
+      memset(&disparityMapOriginal[20*NX], 180, 60*NX);
+
+    // come nel main_loop()
+    if (f%60 == 0)
+    {
+      FindStaticObj();
+      _ref_find_static_obj(ref, disparityMapOriginal);
+    }
+    else
+      StepStaticObj();
 
+    if (f%60 == 59)
+    {
+      ++periods;
+      if (memcmp(BkgStatic.BkgTmpStatic, ref.bs.BkgTmpStatic, NN) != 0 ||
+          memcmp(BkgStatic.svec, ref.bs.svec, sizeof(ref.bs.svec)) != 0 ||
+          BkgStatic.min != ref.bs.min ||
+          memcmp(Bkgvec, ref.bkgvec, NN) != 0 ||
+          memcmp(svec, ref.svec, sizeof(ref.svec)) != 0)
+      {
+        if (mismatches == 0)
+          printf("static_obj_test(): primo periodo diverso al frame %d\n", f);
+        ++mismatches;
+      }
+    }
+  }
+  static_test_min = -1;
+
+  // l'oggetto deve essere stato inglobato nello sfondo usato per la sottrazione
+  int obj_in_bkg = 0;
+  for (int y=30; y<70; ++y)
+    for (int x=40; x<80; ++x)
+      if (abs((int)Bkgvec[y*NX+x]-(int)OBJ_DISP) <= 2) obj_in_bkg++;
+
+  printf("static_obj_test(): %d periodi, %d diversi; aggiornamenti sfondo %d, re-inizializzazioni %d; "
+    "oggetto nello sfondo %d/%d pixel\n", periods, mismatches, ref.updates, ref.inits, obj_in_bkg, 40*40);
+  if (ref.updates == 0 || ref.inits < 2 || obj_in_bkg < 40*40)
+  {
+    printf("static_obj_test(): la sequenza non ha dato gli aggiornamenti attesi!\n");
+    ++mismatches;
+  }
+
+  return mismatches;
 }
 #endif
+#endif
 
 
 /*!
@@ -1107,12 +1434,25 @@ _check_false_counts(
 
   // printf("in=%ld; out=%ld; prev_in=%ld; prev_out=%ld\n", peoplein, peopleout, prev_peoplein, prev_peopleout);
 
+#ifdef USE_TRACK_EVENTS
+  const unsigned long cnt_in = peoplein;
+  const unsigned long cnt_out = peopleout;
+#endif
+
   // Controllo conteggi in IN
   _check_false_counts_one_dir(peoplein, prev_peoplein, indx_in, buffer_cnt_in, real_buf_sze, number_of_frames);
 
   // Controllo conteggi in OUT
   _check_false_counts_one_dir(peopleout, prev_peopleout, indx_out, buffer_cnt_out, real_buf_sze, number_of_frames);
 
+#ifdef USE_TRACK_EVENTS
+  // i conteggi scartati vengono segnalati anche a chi legge gli eventi del tracking
+  for (unsigned long n = peoplein; n < cnt_in; ++n)
+    TrackEventCountDropped(true);
+  for (unsigned long n = peopleout; n < cnt_out; ++n)
+    TrackEventCountDropped(false);
+#endif
+
   ++number_of_frames;
 }
 
@@ -1206,7 +1546,7 @@ void detectAndTrack(unsigned char *disparityMap,
   in termini di disparit&agrave;).
   */
 #ifdef USE_HANDLE_OUT_OF_RANGE
-  static tPersonDetected *prev_persone = new tPersonDetected[num_pers];  // essendo static ad ogni chiamata di detectAndTrack() in persone ho la lista delle detection precedenti
+  static tPersonDetected *prev_persone = new tPersonDetected[MAX_NUM_PERS];  // essendo static ad ogni chiamata di detectAndTrack() in persone ho la lista delle detection precedenti (num_pers cambia con crowd_capacity e total_sys_number)
   static int prev_pp=0;  // essendo static ad ogni chiamata di detectAndTrack() in pp ho il numero di detection precedenti
 #endif
 
@@ -1221,6 +1561,25 @@ void detectAndTrack(unsigned char *disparityMap,
     peopleout = people_count_output;
     return;
   }
+
+#ifdef USE_NEW_TRACKING
+  // decimazione dell'elaborazione: il tracking compensa i frame saltati con la velocita' stimata 
+  // dei blob (vedi SetTrackingFrameStep()). Gli eventi porta e i sensori che non fanno il 
+  // tracking (slave del widegate) elaborano sempre tutti i frame.
+  static int frames_since_processed = 0;
+  frames_since_processed++;
+  if (frames_since_processed < processing_decimation && !ev_door_close && !ev_door_open &&
+      (total_sys_number<2 || total_sys_number==current_sys_number))
+  {
+    peoplein = people_count_input;
+    peopleout = people_count_output;
+    return;
+  }
+  SetTrackingFrameStep(frames_since_processed);
+  frames_since_processed = 0;
+  if (SetTrackingCapacity(crowd_capacity))
+    num_pers = GetTrackingCapacity(total_sys_number)*max(1, (int)total_sys_number);  // applicata a scena vuota
+#endif
 #ifdef CHECK_FALSE_COUNTS
   _set_prev_counters(total_sys_number, people_count_input, people_count_output);
 #endif
@@ -1407,21 +1766,40 @@ void detectAndTrack(unsigned char *disparityMap,
   \endcode
   */
 
+#ifndef USE_NEW_DETECTION
   memcpy(disparityMapOriginal,disparityMap,NN);  // for InitStaticObj
-
-#ifdef USE_NEW_DETECTION
-  // binning
+#else
+  // binning, sottrazione del background sulla mappa a piena risoluzione (soglia precalcolata 
+  // in BkgThr da UpdateBkgThreshold()) e conteggio dei pixel neri in una sola passata
   static unsigned char bmap[NN]; 
   static unsigned char BP_map[NN];
   static unsigned char BP_BG[NN];
   static unsigned char bmap_original[NN];
   static int counter_frames_before_oor_check = 0;
   int bnrows, bncols;
-  image_binning(disparityMap, NY, NX, binning, BORDER_X, BORDER_Y, bmap, BP_map, bnrows, bncols);
+  // risoluzione della detection (cambia solo con l'altezza di installazione)
+#  if DETECTION_BINNING > 0
+  const bool binning_changed = set_detection_binning(DETECTION_BINNING);
+#  else
+  const bool binning_changed = set_detection_binning(select_detection_binning(inst_height));
+#  endif
+  const int black_pixel_cnt = image_binning_bg_subtraction(disparityMap, BkgThr, NY, NX, binning, BORDER_X, BORDER_Y, 
+                                                           disparityMapOriginal, bmap, BP_map, bnrows, bncols);
   memcpy(bmap_original,bmap,NN);  // for InitStaticObj
   // update black pixels model
   static BPmodeling bp_model(bncols, bnrows, 0, 0);
+  if (binning_changed)
+  {
+    // modello dei pixel neri e out-of-range lavorano sulla mappa binnata
+    bp_model.Resize(bncols, bnrows);
+    counter_frames_before_oor_check = 0;
 #  ifdef USE_HANDLE_OUT_OF_RANGE
+    OutOfRangeManager::getInstance().SetBinning();
+#  endif
+  }
+#  ifdef USE_HANDLE_OUT_OF_RANGE
+  OutOfRangeManager::getInstance().SetBlackPixelCount(black_pixel_cnt);
+  bool update_bp_model = false;
   if (ev_door_open && OutOfRangeManager::getInstance().IsOutOfRangeEnabled())
   {
     printf("Imparo il bkg !\n");
@@ -1437,12 +1815,16 @@ void detectAndTrack(unsigned char *disparityMap,
       bp_model.Reset();
     }
 #endif
-    bp_model.UpdateModel(BP_map, bncols, bnrows);  // Aggiorno il modello dei BP solo se le porte sono aperte e non sono in ORR
+    update_bp_model = true;  // Aggiorno il modello dei BP solo se le porte sono aperte e non sono in ORR
     counter_frames_before_oor_check++;
   }
 
   // controllo out-of-range
-  bp_model.GetMask(BP_BG, bncols, bnrows);  // Recupero la maschera creata dal modello e in caso di persone detectate gestico la situazione di OOR
+  // Recupero la maschera creata dal modello e in caso di persone detectate gestico la situazione di OOR
+  if (update_bp_model)
+    bp_model.UpdateModelAndGetMask(BP_map, BP_BG, bncols, bnrows);
+  else
+    bp_model.GetMask(BP_BG, bncols, bnrows);
   if (prev_pp != 0 && counter_frames_before_oor_check >= NUMBER_OF_FRAMES_BEFORE_OOR_CKECK)
   { 
     OutOfRangeManager::getInstance().HandleOutOfRange(prev_persone,
@@ -1461,28 +1843,14 @@ void detectAndTrack(unsigned char *disparityMap,
 
 
 
-  // sottrazione del background
-    unsigned char* ptr_map;
-  for (int r=BORDER_Y; r< NY-BORDER_Y; ++r)
-  {
-     ptr_map = &disparityMapOriginal[r*NX+BORDER_X];
-    unsigned char* ptr_bkgvec = &Bkgvec[r*NX+BORDER_X];
-    int* ptr_svec = &svec[r*NX+BORDER_X];
-    for (int c=BORDER_X; c<NX - BORDER_X; ++c, ++ptr_map, ++ptr_bkgvec, ++ptr_svec)
-    {
-      if ((*ptr_map <= MIN_M || (*ptr_map - *ptr_bkgvec) < 3*(*ptr_svec)) && *ptr_map != UNIFORM_ZONE_OR_DISP_1)
-        *ptr_map = 0;
-    }
-  }
-
+  // sottrazione del background sulla mappa binnata (dopo l'eventuale blob virtuale dell'out-of-range)
   unsigned char* ptr_bmap = bmap;
   for (int r=BORDER_Y; r< NY-BORDER_Y; r+=binning)
   {
-    unsigned char* ptr_bkgvec = &Bkgvec[r*NX+BORDER_X];
-    int* ptr_svec = &svec[r*NX+BORDER_X];
-    for (int c=BORDER_X; c<NX-BORDER_X; c+=binning, ++ptr_bmap, ptr_bkgvec+=binning, ptr_svec+=binning)
+    const unsigned char* ptr_thr = &BkgThr[r*NX+BORDER_X];
+    for (int c=BORDER_X; c<NX-BORDER_X; c+=binning, ++ptr_bmap, ptr_thr+=binning)
     {
-      if ((*ptr_bmap <= MIN_M || (*ptr_bmap - *ptr_bkgvec) < 3*(*ptr_svec)) && *ptr_bmap != UNIFORM_ZONE_OR_DISP_1)
+      if (*ptr_bmap <= *ptr_thr && *ptr_bmap != UNIFORM_ZONE_OR_DISP_1)
         *ptr_bmap = 0;
     }
   }
@@ -1490,7 +1858,7 @@ void detectAndTrack(unsigned char *disparityMap,
 
 #endif
   // Re-inizializzo le persone
-  static tPersonDetected *persone = new tPersonDetected[num_pers];
+  static tPersonDetected *persone = new tPersonDetected[MAX_NUM_PERS];  // num_pers cambia con crowd_capacity e total_sys_number
   int pp=0;
   InitPers(persone);
 
@@ -1516,8 +1884,12 @@ void detectAndTrack(unsigned char *disparityMap,
 #if defined(USE_NEW_ALGORITHM_MATLAB)
     pp = g_current_num_pers;
 #else
-    assert(num_peaks<=NUM_PERS_SING);
-    pp = min(NUM_PERS_SING, num_peaks);
+    {
+      // gli slave del widegate trasmettono al master al piu' WG_PERS_PER_PACKET persone
+      const bool is_slave = (total_sys_number>1 && total_sys_number!=current_sys_number);
+      const int max_pp = is_slave ? WG_PERS_PER_PACKET : GetTrackingCapacity(total_sys_number);
+      pp = min(max_pp, num_peaks);
+    }
 #endif
     for (int i=0; i<pp; ++i)
     {
@@ -2926,7 +3298,7 @@ void detectAndTrack(unsigned char *disparityMap,
       sincro=data_wide_gate[sys*54+3];
       pers=0;
       pers_aggiunte=0;
-      while((pers<NUM_PERS_SING)&&(data_wide_gate[sys*54+4+pers*5]!=0))
+      while((pers<WG_PERS_PER_PACKET)&&(data_wide_gate[sys*54+4+pers*5]!=0))
       {
         persone[pp].h=data_wide_gate[sys*54+4+pers*5];
         persone[pp].x=data_wide_gate[sys*54+5+pers*5];
@@ -3701,13 +4073,13 @@ void Merge_and_Filter_people(tPersonDetected* persone, int &num_pers)
 
 
 /*!
-\brief Once people are detected (at most 10 otherwise error arises) they are copied in a vector persdata
+\brief Once people are detected (at most #WG_PERS_PER_PACKET otherwise error arises) they are copied in a vector persdata
 then used in widegate to be sent to the master PCN (see "persdetwidegate" in serial_port.cpp).
 */
 void WritePersDetected(tPersonDetected* persone, const int num_pers_det)
 {
   memset(persdata,0,sizeof(persdata));
-  if(num_pers_det>10) 
+  if(num_pers_det>WG_PERS_PER_PACKET) 
   {
     printf("Error in WritePersDet num_pers troppo grande! %d\n",num_pers_det);
     return;
@@ -119,6 +119,8 @@ void WritePersDetected(tPersonDetected* persone, const int num_pers_det);
 void initpeople(unsigned long pi,unsigned long po, unsigned char & total_sys_number, int & num_pers);
 void deinitpeople(const int & num_pers);
 
+void UpdateBkgThreshold();
+
 #ifdef debug_
 void WritePersDebug(unsigned char* vect);
 void WriteRealXDebug(unsigned char* vect);
@@ -129,8 +131,12 @@ unsigned char GetMin();
 void InitStaticObj();
 void CheckStatic();
 void FindStaticObj();
+void StepStaticObj();
 void SetStaticTh(int soglia);
 void SetMinBkgTh(unsigned char soglia);
+#ifdef STATIC_OBJ_TEST
+int static_obj_test(const int frames);
+#endif
 #endif
 /***************************************************************/
 
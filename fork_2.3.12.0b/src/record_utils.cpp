@@ -11,6 +11,7 @@
 #include <limits.h>
 
 #include "peopledetection.h"
+#include "frame_ring.h"
 #include "directives.h"
 
 //#define _DEBUG_
@@ -173,8 +174,8 @@ static void _acq_loop_stop(tAcqData & ad, tSyncData & sd);
 static bool _is_sync_running(tSyncData & sd);
 static bool _wait_send_or_stop_requests(tSyncData & sd, const bool check_stop);
 static void _wait_enough_data_or_buffer_full(tAcqData & ad);
-//static void _get_disp_map(unsigned char* const & Frame_DSP, unsigned char* const & orig);
-static void _get_images(unsigned char* const & Frame_SX, unsigned char* const & Frame_DX, unsigned char* const & Frame_DSP, unsigned char* const & orig);
+//static void _get_disp_map(unsigned char* const & Frame_DSP, const unsigned char* const & orig);
+static void _get_images(unsigned char* const & Frame_SX, unsigned char* const & Frame_DX, unsigned char* const & Frame_DSP, const unsigned char* const & orig);
 
 #ifdef _COUNT_DURING_RECORD_
 static void _buffer_insert_elem(unsigned char* const & i_img_sx, unsigned char* const & i_img_dx, unsigned char* const & i_disp_map, unsigned long i_cnt[2], unsigned char i_input_test0, unsigned char i_input_test1, tAcqData & io_ad);
@@ -229,13 +230,13 @@ _get_disp_map(unsigned char* const & Frame_DSP, unsigned char* const & orig)
 ////////////////////////////////////////////////////////////////////////////////
 static void
 _get_images(unsigned char* const & Frame_SX, unsigned char* const & Frame_DX, 
-            unsigned char* const & Frame_DSP, unsigned char* const & orig)
+            unsigned char* const & Frame_DSP, const unsigned char* const & orig)
 {
-  unsigned long* ptr;
+  const unsigned long* ptr;
   unsigned char* ptrd, * ptrsx, * ptrdx;
   int i,j;
 
-  ptr = (unsigned long *) orig; // puntatore ad una zona di memoria a 32bits
+  ptr = (const unsigned long *) orig; // puntatore ad una zona di memoria a 32bits
   ptrd = Frame_DSP;
   ptrsx = Frame_SX;
   ptrdx = Frame_DX;
@@ -544,9 +545,17 @@ void *acq_loop(void *arg)
     usleep(100000);  // for debug purposes
 #endif
 
-    read(ad.pxa_qcp,Frame,imagesize);    
+    // same capture ring used by the main_loop(), the frame is decoded directly from the ring buffer
+    int frame_slot;
+    const unsigned char* frame = fr_acquire(frame_slot);
+    if (frame == NULL)
+    {
+      read(ad.pxa_qcp,Frame,imagesize);
+      frame = Frame;
+    }
     //_get_disp_map(Frame_DSP,Frame);
-    _get_images(Frame_SX, Frame_DX, Frame_DSP, Frame);
+    _get_images(Frame_SX, Frame_DX, Frame_DSP, frame);
+    fr_release(frame_slot);
     
     ad.frame_count++;
     
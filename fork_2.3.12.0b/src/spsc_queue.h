@@ -0,0 +1,108 @@
+/*!
+\file spsc_queue.h
+\brief Coda circolare lock-free a singolo produttore e singolo consumatore.
+
+Usata tra il thread di acquisizione (acquisition_loop()) e il thread di elaborazione (main_loop())
+in loops.cpp. Gli elementi sono preallocati: il produttore riempie direttamente lo slot restituito
+da write_slot() e lo pubblica con push(); il consumatore elabora in place lo slot restituito da
+front() e lo libera con pop().
+
+L'indice di scrittura viene modificato solo dal produttore e quello di lettura solo dal
+consumatore, quindi non servono istruzioni atomiche di tipo compare-and-swap (non disponibili
+sull'XScale): basta che le scritture degli indici (word allineate) vengano viste dopo quelle dei dati.
+
+Se la coda &egrave; piena il produttore scarta l'elemento appena scritto (non si blocca mai) e lo conta 
+in drops(). Scartare invece il piu' vecchio richiederebbe che anche il produttore spostasse l'indice 
+di lettura mentre il consumatore lo usa, cosa che senza compare-and-swap non si pu&ograve; fare in sicurezza.
+*/
+
+#ifndef __SPSC_QUEUE__
+#define __SPSC_QUEUE__
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#  define SPSC_BARRIER() __sync_synchronize()
+#else
+// gcc 4.0.2 (XScale, single core): basta impedire al compilatore di riordinare gli accessi
+#  define SPSC_BARRIER() __asm__ __volatile__ ("" : : : "memory")
+#endif
+
+/*!
+\class SpscQueue
+\brief Coda lock-free di N elementi di tipo T (N+1 slot fisici: lo slot di scrittura non &egrave; mai visibile al consumatore).
+*/
+template <typename T, int N>
+class SpscQueue
+{
+public:
+  SpscQueue()
+    : m_r(0), m_w(0), m_drops(0)
+  {}
+
+  void reset(void)  ///< da chiamare solo con produttore e consumatore fermi
+  {
+    m_r = m_w = 0;
+    m_drops = 0;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // producer side
+
+  /*! \brief Slot da riempire con il prossimo elemento (sempre disponibile). */
+  T* write_slot(void) { return &m_slots[m_w]; }
+
+  /*!
+  \brief Pubblica lo slot restituito da write_slot().
+  \return false se la coda era piena e l'elemento &egrave; stato scartato.
+  */
+  bool push(void)
+  {
+    const int w = m_w;
+    const int next_w = _next(w);
+    if (next_w == m_r)  // coda piena
+    {
+      ++m_drops;
+      return false;
+    }
+    SPSC_BARRIER();  // i dati dello slot devono essere visibili prima dell'indice
+    m_w = next_w;
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // consumer side
+
+  /*! \brief Elemento piu' vecchio in coda (NULL se vuota); resta valido fino a pop(). */
+  T* front(void)
+  {
+    const int r = m_r;
+    if (r == m_w)
+      return NULL;
+
+    SPSC_BARRIER();  // lettura dei dati dopo quella dell'indice
+    return &m_slots[r];
+  }
+
+  /*! \brief Libera l'elemento restituito da front(). */
+  void pop(void)
+  {
+    SPSC_BARRIER();  // lo slot non deve piu' essere letto quando il produttore lo vede libero
+    m_r = _next(m_r);
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // statistics (can be read by any thread)
+  int depth(void) const { return _count(m_r, m_w); }
+  int capacity(void) const { return N; }
+  unsigned long drops(void) const { return m_drops; }
+
+private:
+  static int _next(const int i) { return (i == N) ? 0 : i+1; }
+  static int _count(const int from, const int to) { return (to >= from) ? to-from : to+N+1-from; }
+
+  T m_slots[N+1];
+  volatile int m_r;                   ///< modificato solo dal consumatore
+  volatile int m_w;                   ///< modificato solo dal produttore
+  volatile unsigned long m_drops;     ///< scarti del produttore (coda piena)
+};
+
+#endif